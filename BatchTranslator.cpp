@@ -0,0 +1,522 @@
+#include "BatchTranslator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <sss/util/PostionThrow.hpp>
+
+#include "ByteStreamEditor.hpp"
+#include "Compression.hpp"
+#include "IoUring.hpp"
+#include "TaskScheduler.hpp"
+
+namespace  {
+    // NOTE user_data 的低 8 位是操作，其余是 slot 下标
+    enum Op {
+        OP_OPEN_IN,
+        OP_READ,
+        OP_CLOSE_IN,    // 结果不关心
+        OP_OPEN_OUT,
+        OP_WRITE,
+        OP_CLOSE_OUT,
+        OP_EVENT        // eventfd 上的读：有翻译完的文件
+    };
+
+    inline uint64_t user_data(size_t slot, Op op)
+    {
+        return uint64_t(slot) << 8 | op;
+    }
+
+    class StringSink : public SequenceSM::Sink
+    {
+    public:
+        explicit StringSink(std::string& out)
+            : m_out(out)
+        {}
+        void write(const char * data, size_t len) override
+        {
+            this->m_out.append(data, len);
+        }
+
+    private:
+        std::string& m_out;
+    };
+
+    std::string errno_text(int err)
+    {
+        return std::strerror(err);
+    }
+} // namespace
+
+/**
+ * @brief 一个在途的文件
+ */
+struct BatchTranslator::Slot
+{
+    size_t          m_index = 0u;
+    const FileJob * m_job = nullptr;
+    int             m_fd = -1;
+    std::string     m_in;               // 读缓冲；size() 为容量
+    size_t          m_in_len = 0u;
+    std::string     m_out;
+    size_t          m_out_done = 0u;
+    std::string     m_out_path;
+    bool            m_write = false;    // 翻译之后，是否还要写出 m_out
+    bool            m_ok = false;
+    std::string     m_log;
+    FileStats       m_stats;
+    bool            m_with_stats = false;
+    SequenceSM::MatchStats * m_scratch = nullptr;  // --skip-noop 且不统计时，只用其中的 m_matches
+
+    void reset(size_t index, const FileJob& job, bool with_stats)
+    {
+        this->m_index = index;
+        this->m_job = &job;
+        this->m_fd = -1;
+        this->m_in.resize(std::min<uint64_t>(job.m_size, max_file_size) + 1u);
+        this->m_in_len = 0u;
+        this->m_out.clear();
+        this->m_out_done = 0u;
+        this->m_out_path.clear();
+        this->m_write = false;
+        this->m_ok = false;
+        this->m_log.clear();
+        this->m_stats = FileStats();
+        this->m_stats.m_path = job.m_path;
+        this->m_with_stats = with_stats;
+    }
+
+    void fail(const std::string& msg)
+    {
+        this->m_ok = false;
+        this->m_write = false;
+        this->m_log += msg + "\n";
+    }
+
+    // NOTE 还没读完就出错：提示信息与 ByteStreamEditor::translate() 相同，先报
+    // 输出文件名，再报错
+    void fail_input(const std::string& msg)
+    {
+        this->m_log += "translate from `" + this->m_job->m_path + "` to `" + this->m_job->m_path + ".ts`\n";
+        this->fail(msg);
+    }
+
+    // NOTE 读满了缓冲区：文件比 m_size 大（或者变大了），扩大后接着读
+    bool in_full() const
+    {
+        return this->m_in_len == this->m_in.size();
+    }
+
+    void grow_in()
+    {
+        this->m_in.resize(this->m_in.size() * 2u);
+    }
+};
+
+BatchTranslator::BatchTranslator(const ByteStreamEditor& editor, size_t worker_cnt, Engine engine)
+    : m_editor(editor),
+      m_worker_cnt(worker_cnt ? worker_cnt : TaskScheduler::hardware_concurrency()),
+      m_engine(engine)
+{
+    if (this->m_engine == E_AUTO) {
+        this->m_engine = IoUring::available() ? E_URING : E_BLOCKING;
+    }
+}
+
+const char * BatchTranslator::engine_name(Engine engine)
+{
+    switch (engine) {
+    case E_URING:
+        return "io_uring";
+
+    case E_BLOCKING:
+        return "blocking";
+
+    default:
+        return "auto";
+    }
+}
+
+void BatchTranslator::run(const std::vector<FileJob>& jobs, bool with_stats, const Done& done) const
+{
+    if (this->m_engine == E_URING) {
+        this->run_uring(jobs, with_stats, done);
+    }
+    else {
+        this->run_blocking(jobs, with_stats, done);
+    }
+}
+
+// NOTE 压缩的输入或输出，交给 ByteStreamEditor 逐个处理；它自己打开、读写
+void BatchTranslator::translate(Slot& slot) const
+{
+    const std::string& src = slot.m_job->m_path;
+    FileStats * stats = slot.m_with_stats ? &slot.m_stats : nullptr;
+    try {
+        const compression::Codec codec = compression::detect(slot.m_in.data(), slot.m_in_len);
+        if (codec != compression::C_NONE || this->m_editor.output_codec(codec) != compression::C_NONE) {
+            std::ostringstream log;
+            this->m_editor.translate(src, this->m_editor.output_path(src), false, log, stats);
+            slot.m_log += log.str();
+            slot.m_ok = true;
+            slot.m_write = false;
+            return;
+        }
+
+        StopWatch watch;
+        slot.m_out_path = compression::output_path(src, codec, codec, ".ts");
+        SequenceSM::Matcher matcher(this->m_editor.sm());
+        SequenceSM::MatchStats * match = slot.m_scratch;
+        if (stats) {
+            stats->m_match = SequenceSM::MatchStats(this->m_editor.sm().table().m_state_cnt);
+            match = &stats->m_match;
+        }
+        if (match) {
+            match->m_matches = 0u;
+            matcher.set_stats(match);
+        }
+        ::StringSink sink(slot.m_out);
+        slot.m_out.reserve(slot.m_in_len + slot.m_in_len / 8u);
+        matcher.feed(slot.m_in.data(), slot.m_in_len, sink);
+        matcher.finish(sink);
+        if (stats) {
+            stats->m_bytes_in = slot.m_in_len;
+            stats->m_bytes_out = slot.m_out.size();
+            stats->m_translate_s = watch.seconds();
+        }
+
+        // NOTE 与 ByteStreamEditor::translate() 的 --skip-noop 相同：没有匹配，
+        // 不写，删掉旧的输出
+        if (this->m_editor.skip_noop() && match && !match->m_matches) {
+            slot.m_log += "skip `" + src + "`: nothing to replace\n";
+            ::unlink(slot.m_out_path.c_str());
+            if (stats) {
+                stats->m_skipped = FileStats::S_NOOP;
+            }
+            slot.m_ok = true;
+            slot.m_write = false;
+            return;
+        }
+        slot.m_log += "translate from `" + src + "` to `" + slot.m_out_path + "`\n";
+        slot.m_write = true;
+        slot.m_ok = true;
+    }
+    catch (std::exception& e) {
+        slot.fail(e.what());
+    }
+}
+
+void BatchTranslator::run_blocking(const std::vector<FileJob>& jobs, bool with_stats, const Done& done) const
+{
+    std::atomic<size_t> next(0u);
+    auto work = [&]() {
+        Slot slot;
+        const bool need_scratch = this->m_editor.skip_noop() && !with_stats;
+        SequenceSM::MatchStats scratch(0u);
+        slot.m_scratch = need_scratch ? &scratch : nullptr;
+        for (size_t i = next++; i < jobs.size(); i = next++) {
+            slot.reset(i, jobs[i], with_stats);
+            const std::string& src = jobs[i].m_path;
+            int fd = ::open(src.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1) {
+                slot.fail_input("unable to open file `" + src + "` to read: " + ::errno_text(errno));
+            }
+            // NOTE 与 io_uring 一样：读不满缓冲区，就是到了结尾，省掉最后那次返回
+            // 0 的 read
+            while (fd != -1) {
+                ssize_t len = ::read(fd, &slot.m_in[slot.m_in_len], slot.m_in.size() - slot.m_in_len);
+                if (len < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (len < 0) {
+                    slot.fail_input("read `" + src + "` failed: " + ::errno_text(errno));
+                    ::close(fd);
+                    break;
+                }
+                slot.m_in_len += len;
+                if (slot.in_full()) {
+                    slot.grow_in();
+                    continue;
+                }
+                ::close(fd);
+                this->translate(slot);
+                break;
+            }
+
+            if (slot.m_write) {
+                const std::string& out = slot.m_out_path;
+                int out_fd = ::open(out.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+                if (out_fd == -1) {
+                    slot.fail("unable to open file `" + out + "` to write: " + ::errno_text(errno));
+                }
+                while (out_fd != -1 && slot.m_out_done < slot.m_out.size()) {
+                    ssize_t len = ::write(out_fd, slot.m_out.data() + slot.m_out_done,
+                                          slot.m_out.size() - slot.m_out_done);
+                    if (len < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (len < 0) {
+                        slot.fail("write `" + out + "` failed: " + ::errno_text(errno));
+                        break;
+                    }
+                    slot.m_out_done += len;
+                }
+                if (out_fd != -1 && ::close(out_fd) != 0 && slot.m_ok) {
+                    slot.fail("close `" + out + "` failed: " + ::errno_text(errno));
+                }
+            }
+            slot.m_stats.m_ok = slot.m_ok;
+            done(i, slot.m_ok, slot.m_log, slot.m_stats);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < this->m_worker_cnt; ++i) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto& w : workers) {
+        w.join();
+    }
+}
+
+// NOTE I/O 线程（即调用者）只提交与收割，从不阻塞在单个文件上；翻译线程取走
+// 读完的 slot，翻译完放回 finished，再写 eventfd；I/O 线程在 eventfd 上始终挂着
+// 一个读，借此在 io_uring_enter 的等待中被唤醒
+void BatchTranslator::run_uring(const std::vector<FileJob>& jobs, bool with_stats, const Done& done) const
+{
+    // NOTE 在途的操作引用着 slots 与 event_buf，它们须比 ring 活得久
+    std::vector<Slot> slots(std::min<size_t>(max_in_flight, jobs.size()));
+    uint64_t event_buf = 0u;
+    IoUring ring(4u * max_in_flight);
+    int event_fd = ::eventfd(0u, EFD_CLOEXEC);
+    if (event_fd == -1) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "eventfd failed: " << std::strerror(errno));
+    }
+
+    std::mutex todo_mutex;
+    std::condition_variable todo_cond;
+    std::deque<Slot *> todo;
+    bool stop = false;
+    std::mutex finished_mutex;
+    std::vector<Slot *> finished;
+
+    const bool need_scratch = this->m_editor.skip_noop() && !with_stats;
+    auto work = [&]() {
+        SequenceSM::MatchStats scratch(0u);
+        while (true) {
+            Slot * slot = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(todo_mutex);
+                todo_cond.wait(lock, [&]() { return stop || !todo.empty(); });
+                if (todo.empty()) {
+                    return;
+                }
+                slot = todo.front();
+                todo.pop_front();
+            }
+            slot->m_scratch = need_scratch ? &scratch : nullptr;
+            this->translate(*slot);
+            {
+                std::lock_guard<std::mutex> lock(finished_mutex);
+                finished.push_back(slot);
+            }
+            const uint64_t one = 1u;
+            ssize_t ret = ::write(event_fd, &one, sizeof(one));
+            (void) ret;
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < this->m_worker_cnt; ++i) {
+        workers.emplace_back(work);
+    }
+
+    std::vector<size_t> free_slots;
+    for (size_t i = slots.size(); i > 0; --i) {
+        free_slots.push_back(i - 1u);
+    }
+    size_t next_job = 0u;
+    size_t active = 0u;
+    bool event_pending = false;
+
+    auto complete = [&](size_t idx) {
+        Slot& slot = slots[idx];
+        slot.m_stats.m_ok = slot.m_ok;
+        done(slot.m_index, slot.m_ok, slot.m_log, slot.m_stats);
+        free_slots.push_back(idx);
+        --active;
+    };
+    auto start_write = [&](size_t idx) {
+        Slot& slot = slots[idx];
+        if (!slot.m_write) {
+            complete(idx);
+            return;
+        }
+        ring.prep_openat(slot.m_out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666,
+                         ::user_data(idx, OP_OPEN_OUT));
+    };
+    auto write_rest = [&](size_t idx) {
+        Slot& slot = slots[idx];
+        if (slot.m_out_done < slot.m_out.size()) {
+            ring.prep_write(slot.m_fd, slot.m_out.data() + slot.m_out_done,
+                            slot.m_out.size() - slot.m_out_done, slot.m_out_done,
+                            ::user_data(idx, OP_WRITE));
+        }
+        else {
+            ring.prep_close(slot.m_fd, ::user_data(idx, OP_CLOSE_OUT));
+        }
+    };
+    auto on_complete = [&](uint64_t data, int res) {
+        const Op op = Op(data & 0xffu);
+        if (op == OP_EVENT) {
+            event_pending = false;
+            return;
+        }
+        const size_t idx = data >> 8;
+        Slot& slot = slots[idx];
+        const std::string& src = slot.m_job->m_path;
+        switch (op) {
+        case OP_OPEN_IN:
+            if (res < 0) {
+                slot.fail_input("unable to open file `" + src + "` to read: " + ::errno_text(-res));
+                complete(idx);
+                break;
+            }
+            slot.m_fd = res;
+            ring.prep_read(slot.m_fd, &slot.m_in[0], slot.m_in.size(), 0u, ::user_data(idx, OP_READ));
+            break;
+
+        case OP_READ:
+            if (res < 0) {
+                ring.prep_close(slot.m_fd, ::user_data(idx, OP_CLOSE_IN));
+                slot.fail_input("read `" + src + "` failed: " + ::errno_text(-res));
+                complete(idx);
+                break;
+            }
+            slot.m_in_len += res;
+            if (slot.in_full()) {
+                slot.grow_in();
+                ring.prep_read(slot.m_fd, &slot.m_in[slot.m_in_len], slot.m_in.size() - slot.m_in_len,
+                               slot.m_in_len, ::user_data(idx, OP_READ));
+                break;
+            }
+            // NOTE 不满：到了文件结尾；关闭与翻译同时进行
+            ring.prep_close(slot.m_fd, ::user_data(idx, OP_CLOSE_IN));
+            slot.m_fd = -1;
+            {
+                std::lock_guard<std::mutex> lock(todo_mutex);
+                todo.push_back(&slot);
+            }
+            todo_cond.notify_one();
+            break;
+
+        case OP_CLOSE_IN:
+            break;
+
+        case OP_OPEN_OUT:
+            if (res < 0) {
+                slot.fail("unable to open file `" + slot.m_out_path + "` to write: " + ::errno_text(-res));
+                complete(idx);
+                break;
+            }
+            slot.m_fd = res;
+            write_rest(idx);
+            break;
+
+        case OP_WRITE:
+            if (res < 0) {
+                ring.prep_close(slot.m_fd, ::user_data(idx, OP_CLOSE_IN));
+                slot.fail("write `" + slot.m_out_path + "` failed: " + ::errno_text(-res));
+                complete(idx);
+                break;
+            }
+            slot.m_out_done += res;
+            write_rest(idx);
+            break;
+
+        case OP_CLOSE_OUT:
+            if (res < 0) {
+                slot.fail("close `" + slot.m_out_path + "` failed: " + ::errno_text(-res));
+            }
+            complete(idx);
+            break;
+
+        default:
+            break;
+        }
+    };
+
+    auto arm_event = [&]() {
+        ring.prep_read(event_fd, &event_buf, sizeof(event_buf), 0u, ::user_data(0u, OP_EVENT));
+        event_pending = true;
+    };
+
+    std::exception_ptr error;
+    try {
+        arm_event();
+        while (next_job < jobs.size() || active) {
+            while (!free_slots.empty() && next_job < jobs.size()) {
+                const size_t idx = free_slots.back();
+                free_slots.pop_back();
+                slots[idx].reset(next_job, jobs[next_job], with_stats);
+                ring.prep_openat(jobs[next_job].m_path.c_str(), O_RDONLY | O_CLOEXEC, 0u,
+                                 ::user_data(idx, OP_OPEN_IN));
+                ++next_job;
+                ++active;
+            }
+            ring.submit(1u);
+            ring.reap(on_complete);
+
+            std::vector<Slot *> ready;
+            {
+                std::lock_guard<std::mutex> lock(finished_mutex);
+                ready.swap(finished);
+            }
+            for (Slot * slot : ready) {
+                start_write(slot - slots.data());
+            }
+            if (!event_pending) {
+                arm_event();
+            }
+        }
+    }
+    catch (...) {
+        error = std::current_exception();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(todo_mutex);
+        stop = true;
+    }
+    todo_cond.notify_all();
+    for (auto& w : workers) {
+        w.join();
+    }
+    // NOTE eventfd 上挂着的读，须在 event_buf 失效之前完成
+    if (!error && event_pending) {
+        const uint64_t one = 1u;
+        ssize_t ret = ::write(event_fd, &one, sizeof(one));
+        (void) ret;
+        while (event_pending) {
+            ring.submit(1u);
+            ring.reap(on_complete);
+        }
+    }
+    ::close(event_fd);
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
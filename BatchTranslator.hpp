@@ -0,0 +1,103 @@
+#ifndef __BATCHTRANSLATOR_HPP_1468631522__
+#define __BATCHTRANSLATOR_HPP_1468631522__
+
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "DirWalker.hpp"
+#include "RunStats.hpp"
+
+class ByteStreamEditor;
+
+/**
+ * @brief 大量小文件的批量翻译（不覆盖原文件，输出到 .ts）；
+ *
+ *  小文件的开销主要在 open、read、write、close 这些系统调用上，而不在翻译本身；
+ *  E_URING 时，由一个 I/O 线程经 io_uring 同时保持许多个文件的 open/read/
+ *  write/close 在途，读完的文件交给翻译线程池，翻译结果再交回 I/O 线程写出
+ *  （经 eventfd 唤醒）；整个文件一次读入内存，一次写出；
+ *  E_BLOCKING 时，各翻译线程自己用普通的阻塞系统调用读写（仍然是整读整写，
+ *  不经 iostream）；
+ *
+ *  结果与 ByteStreamEditor::translate(src, output_path(src)) 相同，包括提示
+ *  信息与 --skip-noop；压缩的文件，或者要求压缩输出时，交回
+ *  ByteStreamEditor::translate() 逐个处理；不查清单（set_manifest()）——
+ *  有清单时，调用方不应使用本类；
+ */
+class BatchTranslator
+{
+public:
+    enum Engine {
+        E_AUTO,         // 能用 io_uring 就用，否则 E_BLOCKING
+        E_URING,
+        E_BLOCKING
+    };
+
+    /**
+     * @brief 每个文件处理完时调用一次；index 为 jobs 中的下标，log 为提示或
+     *        出错信息；stats 的 m_path、m_ok 已填好；
+     *        可能在多个线程中同时调用
+     */
+    typedef std::function<void(size_t index, bool ok, const std::string& log, FileStats& stats)> Done;
+
+public:
+    /**
+     * @param worker_cnt 翻译线程数；0 表示按 CPU 核数
+     */
+    BatchTranslator(const ByteStreamEditor& editor, size_t worker_cnt, Engine engine = E_AUTO);
+
+public:
+    BatchTranslator(const BatchTranslator& ) = delete;
+    BatchTranslator& operator = (const BatchTranslator& ) = delete;
+
+public:
+    /**
+     * @brief 处理全部文件，直到完成；jobs 的 m_size 用于决定读缓冲的大小，
+     *        不必精确；with_stats 时，填写各文件的统计
+     */
+    void run(const std::vector<FileJob>& jobs, bool with_stats, const Done& done) const;
+
+    /**
+     * @brief 实际使用的引擎（E_AUTO 已按 IoUring::available() 确定）
+     */
+    Engine engine() const
+    {
+        return this->m_engine;
+    }
+
+    /**
+     * @brief "auto" "io_uring" "blocking"
+     */
+    static const char * engine_name(Engine engine);
+
+public:
+    // NOTE 更大的文件，系统调用的开销占比已经不大，且整读整写占内存；调用方
+    // 应交给 ByteStreamEditor::translate()
+    enum { max_file_size = 256 * 1024 };
+
+    // NOTE 少于这么多个小文件，起线程与建环不划算
+    enum { min_batch = 64 };
+
+    // NOTE 在途的文件数；每个文件同时至多两个操作（关闭输入与写输出重叠），
+    // 再加上 eventfd 上的一个读
+    enum { max_in_flight = 128 };
+
+private:
+    struct Slot;
+
+    void run_uring(const std::vector<FileJob>& jobs, bool with_stats, const Done& done) const;
+    void run_blocking(const std::vector<FileJob>& jobs, bool with_stats, const Done& done) const;
+
+    // NOTE 在翻译线程中：翻译 slot 的输入，决定是否还要写出
+    void translate(Slot& slot) const;
+
+private:
+    const ByteStreamEditor &    m_editor;
+    size_t                      m_worker_cnt;
+    Engine                      m_engine;
+};
+
+
+#endif /* __BATCHTRANSLATOR_HPP_1468631522__ */
@@ -0,0 +1,229 @@
+#include "ByteScanner.hpp"
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BSE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+ByteScanner::ByteScanner()
+    : m_empty(true), m_full(false), m_kernel(k_none), m_find(&ByteScanner::find_none)
+{
+    std::memset(this->m_member, 0, sizeof(this->m_member));
+    std::memset(this->m_lo_nibble, 0, sizeof(this->m_lo_nibble));
+    std::memset(this->m_hi_nibble, 0, sizeof(this->m_hi_nibble));
+    std::memset(this->m_min, 0, sizeof(this->m_min));
+    std::memset(this->m_max, 0, sizeof(this->m_max));
+}
+
+// NOTE 按高 4 位分组：对每个高 4 位 h，集合中低 4 位的分布是一个 16 位掩码；
+// 掩码相同的 h 归为一组；分组不超过 8 个时，
+//   c 属于集合  <=>  m_lo_nibble[c & 0xF] & m_hi_nibble[c >> 4]
+// 是精确的；超过 8 个，则把多出来的分组并入最后一组，得到超集。
+void ByteScanner::assign(const bool member[256])
+{
+    size_t cnt = 0;
+    size_t half_cnt[2] = {0u, 0u};
+    for (size_t c = 0; c < 256u; ++c) {
+        this->m_member[c] = member[c] ? 1u : 0u;
+        if (member[c]) {
+            size_t half = c >> 7;
+            if (!half_cnt[half]++) {
+                this->m_min[half] = c;
+            }
+            this->m_max[half] = c;
+            cnt++;
+        }
+    }
+    this->m_empty = !cnt;
+    this->m_full = cnt == 256u;
+    // NOTE 某一半为空时，照抄另一半，两个区间取并集时不影响结果
+    for (size_t half = 0; half < 2u; ++half) {
+        if (!half_cnt[half]) {
+            this->m_min[half] = this->m_min[1 - half];
+            this->m_max[half] = this->m_max[1 - half];
+        }
+    }
+
+    std::memset(this->m_lo_nibble, 0, sizeof(this->m_lo_nibble));
+    std::memset(this->m_hi_nibble, 0, sizeof(this->m_hi_nibble));
+    uint16_t groups[8];
+    size_t group_cnt = 0;
+    for (size_t hi = 0; hi < 16u; ++hi) {
+        uint16_t mask = 0;
+        for (size_t lo = 0; lo < 16u; ++lo) {
+            if (member[hi << 4 | lo]) {
+                mask |= uint16_t(1u << lo);
+            }
+        }
+        if (!mask) {
+            continue;
+        }
+        size_t g = 0;
+        while (g < group_cnt && groups[g] != mask) {
+            ++g;
+        }
+        if (g == group_cnt) {
+            if (group_cnt < 8u) {
+                groups[group_cnt++] = mask;
+            }
+            else {
+                g = 7u;
+                groups[7] |= mask;
+            }
+        }
+        this->m_hi_nibble[hi] |= uint8_t(1u << g);
+    }
+    for (size_t g = 0; g < group_cnt; ++g) {
+        for (size_t lo = 0; lo < 16u; ++lo) {
+            if (groups[g] & (1u << lo)) {
+                this->m_lo_nibble[lo] |= uint8_t(1u << g);
+            }
+        }
+    }
+
+    this->set_kernel(best_kernel());
+}
+
+ByteScanner::Kernel ByteScanner::best_kernel()
+{
+#ifdef BSE_X86_SIMD
+    if (__builtin_cpu_supports("avx2")) {
+        return k_avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return k_sse2;
+    }
+#endif
+    return k_scalar;
+}
+
+void ByteScanner::set_kernel(Kernel kernel)
+{
+    Kernel best = best_kernel();
+    if (kernel > best) {
+        kernel = best;
+    }
+    this->m_kernel = kernel;
+    if (this->m_full || kernel == k_none) {
+        this->m_find = &ByteScanner::find_none;
+    }
+    else if (kernel == k_avx2) {
+        this->m_find = &ByteScanner::find_avx2;
+    }
+    else if (kernel == k_sse2) {
+        this->m_find = &ByteScanner::find_sse2;
+    }
+    else {
+        this->m_find = &ByteScanner::find_scalar;
+    }
+}
+
+const char * ByteScanner::kernel_name(Kernel kernel)
+{
+    switch (kernel) {
+    case k_none:
+        return "none";
+
+    case k_scalar:
+        return "scalar";
+
+    case k_sse2:
+        return "sse2";
+
+    case k_avx2:
+        return "avx2";
+    }
+    return "unknown";
+}
+
+const char * ByteScanner::find_none(const ByteScanner& , const char * it, const char * )
+{
+    return it;
+}
+
+const char * ByteScanner::find_scalar(const ByteScanner& s, const char * it, const char * end)
+{
+    if (s.m_empty) {
+        return end;
+    }
+    while (it != end && !s.m_member[uint8_t(*it)]) {
+        ++it;
+    }
+    return it;
+}
+
+#ifdef BSE_X86_SIMD
+
+const char * ByteScanner::find_sse2(const ByteScanner& s, const char * it, const char * end)
+{
+    if (s.m_empty) {
+        return end;
+    }
+    // NOTE 无符号区间判断：(c - min) <= (max - min)
+    const __m128i base0 = _mm_set1_epi8(char(s.m_min[0]));
+    const __m128i range0 = _mm_set1_epi8(char(s.m_max[0] - s.m_min[0]));
+    const __m128i base1 = _mm_set1_epi8(char(s.m_min[1]));
+    const __m128i range1 = _mm_set1_epi8(char(s.m_max[1] - s.m_min[1]));
+    while (end - it >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(it));
+        __m128i v0 = _mm_sub_epi8(v, base0);
+        __m128i v1 = _mm_sub_epi8(v, base1);
+        unsigned mask = _mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(_mm_max_epu8(v0, range0), range0),
+                         _mm_cmpeq_epi8(_mm_max_epu8(v1, range1), range1)));
+        while (mask) {
+            unsigned bit = __builtin_ctz(mask);
+            if (s.m_member[uint8_t(it[bit])]) {
+                return it + bit;
+            }
+            mask &= mask - 1;
+        }
+        it += 16;
+    }
+    return find_scalar(s, it, end);
+}
+
+__attribute__((target("avx2")))
+const char * ByteScanner::find_avx2(const ByteScanner& s, const char * it, const char * end)
+{
+    if (s.m_empty) {
+        return end;
+    }
+    const __m256i lo_tbl = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(s.m_lo_nibble)));
+    const __m256i hi_tbl = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(s.m_hi_nibble)));
+    const __m256i low4 = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    while (end - it >= 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(it));
+        __m256i lo = _mm256_shuffle_epi8(lo_tbl, _mm256_and_si256(v, low4));
+        __m256i hi = _mm256_shuffle_epi8(hi_tbl, _mm256_and_si256(_mm256_srli_epi16(v, 4), low4));
+        unsigned mask = ~unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), zero)));
+        while (mask) {
+            unsigned bit = __builtin_ctz(mask);
+            if (s.m_member[uint8_t(it[bit])]) {
+                return it + bit;
+            }
+            mask &= mask - 1;
+        }
+        it += 32;
+    }
+    return find_scalar(s, it, end);
+}
+
+#else
+
+const char * ByteScanner::find_sse2(const ByteScanner& s, const char * it, const char * end)
+{
+    return find_scalar(s, it, end);
+}
+
+const char * ByteScanner::find_avx2(const ByteScanner& s, const char * it, const char * end)
+{
+    return find_scalar(s, it, end);
+}
+
+#endif
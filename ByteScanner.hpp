@@ -0,0 +1,91 @@
+#ifndef __BYTESCANNER_HPP_1468390215__
+#define __BYTESCANNER_HPP_1468390215__
+
+#include <cstdint>
+#include <cstdlib>
+
+/**
+ * @brief 在字节序列中，查找第一个属于给定字节集合的字节；
+ *        SequenceSM 用它跳过 S0 下不可能开始任何匹配的字节；
+ *
+ *  内核按运行时 CPU 特性选择：
+ *      k_avx2   每次 32 字节；按高低 4 位查表(vpshufb)，集合可分解时精确，否
+ *               则为超集；
+ *      k_sse2   每次 16 字节；ASCII 与非 ASCII 两半，各按 [最小值, 最大值]
+ *               区间筛选，为超集；
+ *      k_scalar 逐字节查表；
+ *      k_none   不跳过，直接返回起点——用于对比测试；
+ *  超集内核找到的候选字节，都会再逐字节查表确认，所以结果总是精确的。
+ */
+class ByteScanner
+{
+public:
+    enum Kernel {
+        k_none,
+        k_scalar,
+        k_sse2,
+        k_avx2
+    };
+
+public:
+    ByteScanner();
+
+public:
+    /**
+     * @brief 设置字节集合；member[c] 非零表示 c 属于集合；
+     *        同时按 CPU 特性，选择最快的内核
+     */
+    void assign(const bool member[256]);
+
+    /**
+     * @brief 强制使用某内核；CPU 不支持时，退回能用的最好的那个
+     */
+    void set_kernel(Kernel kernel);
+
+    Kernel kernel() const
+    {
+        return this->m_kernel;
+    }
+
+    static const char * kernel_name(Kernel kernel);
+
+    static Kernel best_kernel();
+
+    bool contains(char ch) const
+    {
+        return this->m_member[uint8_t(ch)];
+    }
+
+    /**
+     * @brief 返回 [it, end) 中第一个属于集合的字节位置；没有则返回 end
+     */
+    const char * find(const char * it, const char * end) const
+    {
+        if (it != end && this->m_member[uint8_t(*it)]) {
+            return it;
+        }
+        return (*this->m_find)(*this, it, end);
+    }
+
+private:
+    typedef const char * (*find_fn)(const ByteScanner&, const char *, const char *);
+
+    static const char * find_none(const ByteScanner& s, const char * it, const char * end);
+    static const char * find_scalar(const ByteScanner& s, const char * it, const char * end);
+    static const char * find_sse2(const ByteScanner& s, const char * it, const char * end);
+    static const char * find_avx2(const ByteScanner& s, const char * it, const char * end);
+
+private:
+    uint8_t     m_member[256];
+    uint8_t     m_lo_nibble[16];    // 低 4 位 -> 所属高位分组的位掩码
+    uint8_t     m_hi_nibble[16];    // 高 4 位 -> 分组位
+    uint8_t     m_min[2];           // [0] 为 < 0x80 的一半，[1] 为 >= 0x80 的一半
+    uint8_t     m_max[2];
+    bool        m_empty;
+    bool        m_full;
+    Kernel      m_kernel;
+    find_fn     m_find;
+};
+
+
+#endif /* __BYTESCANNER_HPP_1468390215__ */
@@ -3,249 +3,598 @@
 #include <stdexcept>
 #include <sstream>
 #include <cctype>
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
 
-#include <sss/spliter.hpp>
-#include <sss/util/Parser.hpp>
 #include <sss/util/PostionThrow.hpp>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
 #include "ByteStreamEditor.hpp"
+#include "WritevSink.hpp"
+#include "ChunkTranslator.hpp"
+#include "RuleCache.hpp"
+#include "EmbeddedRules.hpp"
+#include "Manifest.hpp"
+#include "RuleLoader.hpp"
+#include "MappedFile.hpp"
+#include "PipelineTranslator.hpp"
 
 #ifndef VALUE_MSG
 #define VALUE_MSG(a) (#a) << " = `" << a << "`"
 #endif
 
 namespace  {
-    typedef std::string::const_iterator Iter_t;
-    typedef sss::util::Parser<Iter_t> parser_t;
-    typedef parser_t::Rewinder rewinder_t;
-    bool skip_space(Iter_t& it_beg, Iter_t it_end)
+    /**
+     * @brief 统计用：数出输出字节数，并累计阻塞在 flush() 上的时间；
+     *        stats 为空时不应使用——调用方直接用被包装的 Sink，免去一层转发
+     */
+    class TimedSink : public SequenceSM::Sink
     {
-        while (it_beg != it_end && std::isspace(*it_beg)) {
-            it_beg++;
+    public:
+        TimedSink(SequenceSM::Sink& out, FileStats * stats)
+            : m_out(out), m_stats(stats), m_size(0u), m_write_s(0.0)
+        {}
+
+        void write(const char * data, size_t len) override
+        {
+            this->m_size += len;
+            this->m_out.write(data, len);
         }
-        return true;
-    }
-    bool parse_es_hex(Iter_t& it_beg, Iter_t it_end, char& content) {
-        // std::cout << __func__ << ":" << __LINE__ << " " << VALUE_MSG(*it_beg) << std::endl;
-        char buf[2];
-        bool is_ok =
-            parser_t::parseChar(it_beg, it_end, 'x') &&
-            parser_t::parseHexChar(it_beg, it_end, buf[0]) &&
-            parser_t::parseHexChar(it_beg, it_end, buf[1]);
-        if (is_ok) {
-            content = parser_t::hexchar2number(buf[0]) << 4 | (parser_t::hexchar2number(buf[1]));
-            // std::cout << __func__ << ":" << __LINE__ << ":" << buf[0] << buf[1] << "=" << int(content) << std::endl;
-        }
-        return is_ok;
-    }
-    bool parse_es_oct(Iter_t& it_beg, Iter_t it_end, char& content) {
-        // std::cout << __func__ << ":" << __LINE__ << " " << VALUE_MSG(*it_beg) << std::endl;
-        char buf[3];
-        bool is_ok =
-            parser_t::parseRangeChar(it_beg, it_end, '0', '7', buf[0]) &&
-            parser_t::parseRangeChar(it_beg, it_end, '0', '7', buf[1]);
-        if (is_ok) {
-            content = (buf[0] - '0') << 3 | (buf[1] - '0');
-        }
-        if (is_ok && buf[0] <= '3') {
-            if (parser_t::parseRangeChar(it_beg, it_end, '0', '7', buf[2])) {
-                content *= 8;
-                content += buf[2] - '0';
-            }
+        void write_ref(const char * data, size_t len) override
+        {
+            this->m_size += len;
+            this->m_out.write_ref(data, len);
+        }
+        void flush() override
+        {
+            StopWatch watch;
+            this->m_out.flush();
+            this->m_write_s += watch.seconds();
         }
-        return is_ok;
-    }
-    bool parse_es_reserved(Iter_t& it_beg, Iter_t it_end, char& content) {
-        // std::cout << __func__ << ":" << __LINE__ << " " << VALUE_MSG(*it_beg) << std::endl;
-        bool is_ok = parser_t::parseSetChar(it_beg, it_end, "0\\abfnrtv'\"", content);
-        if (is_ok) {
-            switch (content) {
-            case '\\':
-            case '"':
-                break;
 
-            case '0':
-                content = '\0';
-                break;
+        // NOTE 输入字节数由输出字节数与替换的增量反推
+        void finish(const StopWatch& total) const
+        {
+            this->m_stats->m_bytes_out = this->m_size;
+            this->m_stats->m_bytes_in = this->m_size - this->m_stats->m_match.m_delta;
+            this->m_stats->m_write_s = this->m_write_s;
+            this->m_stats->m_translate_s = total.seconds();
+        }
 
-            case 'a':
-                content = '\a';
-                break;
+    private:
+        SequenceSM::Sink&   m_out;
+        FileStats *         m_stats;
+        uint64_t            m_size;
+        double              m_write_s;
+    };
 
-            case 'b':
-                content = '\b';
-                break;
+    // NOTE 只扫描、不输出（ByteStreamEditor::has_match()）
+    class NullSink : public SequenceSM::Sink
+    {
+    public:
+        void write(const char * , size_t ) override
+        {
+        }
+    };
 
-            case 'f':
-                content = '\f';
-                break;
+    std::string dir_of(const std::string& path)
+    {
+        std::string::size_type pos = path.find_last_of('/');
+        if (pos == std::string::npos) {
+            return ".";
+        }
+        return pos ? path.substr(0, pos) : "/";
+    }
+} // namespace 
 
-            case 'n':
-                content = '\n';
-                break;
+ByteStreamEditor::ByteStreamEditor()
+    : m_use_mmap(false), m_chunk_workers(1u), m_use_cache(false), m_fsync(false),
+      m_skip_noop(false), m_output_codec(compression::C_SAME), m_manifest(nullptr),
+      m_source_hash(0u)
+{
+}
 
-            case 'r':
-                content = '\r';
-                break;
+ByteStreamEditor::ByteStreamEditor(const std::string& rule_path)
+    : m_use_mmap(false), m_chunk_workers(1u), m_use_cache(false), m_fsync(false),
+      m_skip_noop(false), m_output_codec(compression::C_SAME), m_manifest(nullptr),
+      m_source_hash(0u)
+{
+    this->load(rule_path);
+}
 
-            case 't':
-                content = '\t';
-                break;
+void ByteStreamEditor::load(const std::string& rule_path)
+{
+    // std::cout << __func__ << " `" << rule_path << "`" << std::endl;
+    this->m_load_times = LoadTimes();
+    this->m_load_issues.clear();
+    this->m_cache_path.clear();
+    const size_t prefix_len = std::strlen(EmbeddedRules::path_prefix);
+    if (rule_path.compare(0, prefix_len, EmbeddedRules::path_prefix) == 0) {
+        const EmbeddedRuleSet * rule_set = EmbeddedRules::find(rule_path.substr(prefix_len));
+        if (!rule_set) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              "no built-in rule set `" << rule_path.substr(prefix_len) << "`");
+        }
+        // NOTE 常量数组与程序同寿命，不需要 storage
+        this->m_sm.adopt(rule_set->m_table, nullptr);
+        this->m_load_times.m_embedded = true;
+        return;
+    }
+    StopWatch read_watch;
+    MappedFile mapped;
+    try {
+        mapped.open(rule_path);
+    }
+    catch (std::exception& ) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "unable to read rule file `" << rule_path << "`");
+    }
 
-            case 'v':
-                content = '\v';
-                break;
+    // NOTE 规则文件未变时，直接映射上次编译的结果；缓存只是加速手段，读写失败
+    // 都不影响正常处理；缓存只存稠密表，双数组后端不用缓存
+    uint64_t source_hash = RuleCache::hash(mapped.data(), mapped.size());
+    this->m_load_times.m_read_s = read_watch.seconds();
+    std::string cache_path;
+    const bool use_cache = this->m_use_cache && this->m_sm.backend() == SequenceSM::B_DENSE;
+    if (use_cache) {
+        StopWatch cache_watch;
+        cache_path = RuleCache::cache_path(rule_path);
+        try {
+            if (RuleCache::load(cache_path, source_hash, this->m_sm)) {
+                this->m_cache_path = cache_path;
+                this->m_source_hash = source_hash;
+                this->m_load_times.m_from_cache = true;
+                this->m_load_times.m_trained = this->m_sm.table().m_trained != 0u;
+                this->m_load_times.m_cache_s = cache_watch.seconds();
+                return;
             }
-            // std::cout << __func__ << " " << VALUE_MSG(content) << std::endl;
         }
-        return is_ok;
+        catch (std::exception& ) {
+        }
+        this->m_load_times.m_cache_s = cache_watch.seconds();
     }
 
-    bool parse_escape(Iter_t& it_beg, Iter_t it_end, char& content)
+    StopWatch parse_watch;
     {
-        rewinder_t r(it_beg);
-
-        if (parser_t::parseChar(it_beg, it_end, '\\')) {
-            // std::cout << __func__ << ":" << __LINE__ << " " << VALUE_MSG(*it_beg) << std::endl;
-            rewinder_t r_in(it_beg);
-            if (r_in.commit(::parse_es_hex(it_beg, it_end, content)) ||
-                r_in.commit(::parse_es_oct(it_beg, it_end, content)) ||
-                r_in.commit(::parse_es_reserved(it_beg, it_end, content))) {
-                r.commit(true);
-            }
+        RuleLoader loader(mapped.data(), mapped.size());
+        this->m_load_issues = loader.issues();
+        for (const RuleLoader::Issue& issue : this->m_load_issues) {
+            ++(issue.m_kind == RuleLoader::Issue::I_DUPLICATE
+               ? this->m_load_times.m_duplicates : this->m_load_times.m_conflicts);
         }
-        return r.is_commited();
+        this->m_sm.add_sorted_rules(loader.rules());
     }
+    this->m_load_times.m_parse_s = parse_watch.seconds();
+    StopWatch compile_watch;
+    this->m_sm.compile();
+    this->m_load_times.m_compile_s = compile_watch.seconds();
 
-    bool parse_dq_str(Iter_t& it_beg, Iter_t it_end, std::string& content)
-    {
-        content.resize(0);
-        bool is_ok = parser_t::parseChar(it_beg, it_end, '"');
-        if (is_ok) {
-            while (it_beg != it_end && *it_beg != '"') {
-                // this->c_str_escapseq_p =
-                //     ( ss1x::parser::char_p('\\') >>
-                //      (   ss1x::parser::char_set_p("\\abfnrtv'\"")
-                //       | (ss1x::parser::char_range_p('0', '3') >> ss1x::parser::char_range_p('0', '7') >> ss1x::parser::char_range_p('0', '7'))
-                //       | (ss1x::parser::char_range_p('0', '7') || ss1x::parser::char_range_p('0', '7'))
-                //       | (ss1x::parser::char_p('x') > (ss1x::parser::xdigit_p || ss1x::parser::xdigit_p))
-                //      )
-                //     ) [sfunc_escape];
-                char escape_char = '\0';
-                if (*it_beg == '\\') {
-                    if (!::parse_escape(it_beg, it_end, escape_char)) {
-                        // std::cout << __func__ << " failed" << std::endl;
-                        SSS_POSTION_THROW(std::runtime_error,
-                                          "parse_escape error `" << sss::util::make_slice(it_beg, it_end));
-                    }
-                    content += escape_char;
-                }
-                else {
-                    content += *it_beg++;
-                }
-            }
+    if (use_cache) {
+        StopWatch cache_watch;
+        this->m_cache_path = cache_path;
+        this->m_source_hash = source_hash;
+        try {
+            RuleCache::save(cache_path, source_hash, this->m_sm);
         }
-        if (is_ok) {
-            is_ok = parser_t::parseChar(it_beg, it_end, '"');
+        catch (std::exception& ) {
         }
-        return is_ok;
+        this->m_load_times.m_cache_s += cache_watch.seconds();
     }
-    bool parse_comma(Iter_t& it_beg, Iter_t it_end)
-    {
-        return parser_t::parseChar(it_beg, it_end, ',');
+}
+
+void ByteStreamEditor::translate(const std::string& src, const std::string& out, bool replace,
+                                 std::ostream& log, FileStats * stats) const
+{
+    if (this->m_manifest && this->m_manifest->check(src, out, replace, this->m_skip_noop)) {
+        log << "skip unchanged `" << src << "`" << std::endl;
+        if (stats) {
+            stats->m_skipped = FileStats::S_UNCHANGED;
+        }
+        return;
     }
-    bool parse_rule(const std::string& line, std::string& key, std::string& value)
-    {
-        Iter_t it_beg = line.begin();
-        Iter_t it_end = line.end();
-        bool is_ok =
-            ::skip_space(it_beg, it_end) &&
-            ::parse_dq_str(it_beg, it_end, key) &&
-            ::skip_space(it_beg, it_end) &&
-            ::parse_comma(it_beg, it_end) &&
-            ::skip_space(it_beg, it_end) &&
-            ::parse_dq_str(it_beg, it_end, value);
-        return is_ok;
+    if (this->m_skip_noop && !this->has_match(src, stats)) {
+        log << "skip `" << src << "`: nothing to replace" << std::endl;
+        if (!replace) {
+            ::unlink(out.c_str());
+        }
+        if (this->m_manifest) {
+            this->m_manifest->record(src, out, replace ? Manifest::M_REPLACE : Manifest::M_NOOP);
+        }
+        return;
     }
-} // namespace 
+    this->translate_file(src, out, replace, log, stats);
+    if (this->m_manifest) {
+        this->m_manifest->record(src, out, replace ? Manifest::M_REPLACE : Manifest::M_OUTPUT);
+    }
+}
 
-ByteStreamEditor::ByteStreamEditor()
+// NOTE 只要知道有没有匹配：第一处匹配所在的块处理完就停；没有匹配时，stats
+// 记下读入的字节数与扫描时间，输出为 0
+bool ByteStreamEditor::has_match(const std::string& src, FileStats * stats) const
 {
+    if (this->m_sm.has_callbacks()) {
+        return true;
+    }
+    StopWatch watch;
+    SequenceSM::MatchStats match(0u);
+    uint64_t size = this->scan(src, match, true);
+    if (!match.m_matches && stats) {
+        stats->m_skipped = FileStats::S_NOOP;
+        stats->m_bytes_in = size;
+        stats->m_translate_s = watch.seconds();
+    }
+    return match.m_matches != 0u;
 }
 
-ByteStreamEditor::ByteStreamEditor(const std::string& rule_path)
+// NOTE 指定了 --mmap 时，不压缩的大文件直接映射，省去一次拷贝；其余按块读
+// （压缩的，边读边解压）
+uint64_t ByteStreamEditor::scan(const std::string& src, SequenceSM::MatchStats& match, bool first_only) const
 {
-    this->load(rule_path);
+    SequenceSM::Matcher matcher(this->m_sm);
+    matcher.set_stats(&match);
+    matcher.set_match_only(true);
+    ::NullSink sink;
+    const uint64_t base = match.m_matches;
+    const compression::Codec codec = compression::detect_file(src);
+    struct stat src_st;
+    if (this->m_use_mmap && codec == compression::C_NONE &&
+        ::stat(src.c_str(), &src_st) == 0 && src_st.st_size >= mmap_threshold)
+    {
+        MappedFile mapped(src);
+        size_t done = 0u;
+        while (done < mapped.size() && !(first_only && match.m_matches != base)) {
+            size_t len = std::min<size_t>(mapped.size() - done, block_size);
+            matcher.feed(mapped.data() + done, len, sink);
+            done += len;
+        }
+        if (done == mapped.size()) {
+            matcher.finish(sink);
+        }
+        return done;
+    }
+
+    int fd = ::open(src.c_str(), O_RDONLY);
+    if (fd == -1) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "unable to open file `" << src << "` to read");
+    }
+    std::unique_ptr<char[]> block(new char[block_size]);
+    uint64_t size = 0u;
+    try {
+        compression::Decoder decoder(fd, codec);
+        while (!(first_only && match.m_matches != base)) {
+            size_t len = decoder.read(block.get(), block_size);
+            if (len == 0) {
+                matcher.finish(sink);
+                break;
+            }
+            size += len;
+            matcher.feed(block.get(), len, sink);
+        }
+    }
+    catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+    return size;
 }
 
-void ByteStreamEditor::load(const std::string& rule_path)
+// NOTE 与 load() 不同，训练是明确要求的，写缓存失败就是失败
+TrainStats ByteStreamEditor::train(const std::vector<std::string>& corpus_paths)
 {
-    // std::cout << __func__ << " `" << rule_path << "`" << std::endl;
-    std::string line;
-    std::ifstream ifs(rule_path, std::ios_base::in);
-    if (!ifs.good()) {
+    const SequenceSM::Table& table = this->m_sm.table();
+    if (table.m_backend != SequenceSM::B_DENSE) {
         SSS_POSTION_THROW(std::runtime_error,
-                          "unable to read rule file `" << rule_path << "`");
+                          "only dense tables can be trained");
     }
-
-    while (std::getline(ifs, line)) {
-        std::string key;
-        std::string value;
-        if (::parse_rule(line, key, value)) {
-            this->add_rule(key, value);
+    TrainStats ret;
+    ret.m_state_cnt = table.m_state_cnt;
+    std::vector<uint64_t> visits(table.m_state_cnt, 0u);
+    std::unique_ptr<char[]> block(new char[block_size]);
+    for (const std::string& path : corpus_paths) {
+        const compression::Codec codec = compression::detect_file(path);
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              "unable to open file `" << path << "` to read");
         }
+        try {
+            compression::Decoder decoder(fd, codec);
+            uint32_t st = 0u;
+            while (size_t len = decoder.read(block.get(), block_size)) {
+                st = this->m_sm.count_visits(block.get(), len, visits, st);
+                ret.m_bytes += len;
+            }
+        }
+        catch (...) {
+            ::close(fd);
+            throw;
+        }
+        ::close(fd);
+    }
+    for (size_t st = 1; st < visits.size(); ++st) {
+        if (visits[st]) {
+            ++ret.m_visited;
+        }
+    }
+
+    this->m_sm.renumber(visits);
+    this->m_load_times.m_trained = true;
+    if (!this->m_cache_path.empty()) {
+        RuleCache::save(this->m_cache_path, this->m_source_hash, this->m_sm);
+        ret.m_saved = true;
     }
+    return ret;
 }
 
-void ByteStreamEditor::translate(const std::string& src, const std::string& out, bool replace)
+void ByteStreamEditor::translate_file(const std::string& src, const std::string& out, bool replace,
+                                      std::ostream& log, FileStats * stats) const
 {
     if (replace) {
-        std::cout << __func__ << " and replace localy `" << src << "`" << std::endl;
+        log << "translate and replace localy `" << src << "`" << std::endl;
+        this->replace_file(src, stats);
+        return;
     }
-    else {
-        std::cout << __func__ << " from `" << src << "` to `" << out << "`" << std::endl;
+    log << "translate from `" << src << "` to `" << out << "`" << std::endl;
+    // NOTE 统计写出耗时，须经由 fd 路径（见 TimedSink）；压缩也只在 fd 路径上
+    const compression::Codec codec = compression::detect_file(src);
+    struct stat src_st;
+    if (::stat(src.c_str(), &src_st) == 0 &&
+        (stats || codec != compression::C_NONE || this->output_codec(codec) != compression::C_NONE ||
+         (this->m_use_mmap && src_st.st_size >= mmap_threshold)))
+    {
+        int fd = ::open(out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd == -1) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              "unable to open file `" << out << "` to write");
+        }
+        try {
+            this->translate_to_fd(src, src_st.st_size, codec, fd, stats);
+        }
+        catch (...) {
+            ::close(fd);
+            throw;
+        }
+        ::close(fd);
+        return;
     }
     std::ifstream ifs(src, std::ios_base::in | std::ios_base::binary);
     if (!ifs.good()) {
         SSS_POSTION_THROW(std::runtime_error,
                           "unable to open file `" << src << "` to read");
     }
-    if (replace) {
-        std::ostringstream oss;
-        this->m_sm.translate(ifs, oss);
-        std::ofstream ofs(src, std::ios_base::out | std::ios_base::binary);
-        if (!ofs.good()) {
+    std::ofstream ofs(out, std::ios_base::out | std::ios_base::binary);
+    if (!ofs.good()) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "unable to open file `" << out << "` to write");
+    }
+    SequenceSM::OstreamSink sink(ofs);
+    this->translate(ifs, sink);
+}
+
+// NOTE 压缩的输入或输出走流水线；指定了 --mmap 时，大文件走 mmap（以及切块
+// 并行），再其余按块 read
+void ByteStreamEditor::translate_to_fd(const std::string& src, uint64_t size, compression::Codec codec,
+                                       int fd, FileStats * stats) const
+{
+    if (codec != compression::C_NONE || this->output_codec(codec) != compression::C_NONE) {
+        int in_fd = ::open(src.c_str(), O_RDONLY);
+        if (in_fd == -1) {
             SSS_POSTION_THROW(std::runtime_error,
-                              "unable to open file `" << src << "` to write");
+                              "unable to open file `" << src << "` to read");
+        }
+        try {
+            compression::Decoder decoder(in_fd, codec);
+            this->translate_compressed(decoder, fd, stats);
         }
-        ofs << oss.str();
+        catch (...) {
+            ::close(in_fd);
+            throw;
+        }
+        ::close(in_fd);
+        return;
     }
-    else {
-        std::ofstream ofs(out, std::ios_base::out | std::ios_base::binary);
-        if (!ofs.good()) {
+    if (this->m_use_mmap && size >= mmap_threshold) {
+        MappedFile mapped(src);
+        this->translate(mapped, fd, stats);
+        return;
+    }
+    int in_fd = ::open(src.c_str(), O_RDONLY);
+    if (in_fd == -1) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "unable to open file `" << src << "` to read");
+    }
+    try {
+        this->translate(in_fd, fd, stats);
+    }
+    catch (...) {
+        ::close(in_fd);
+        throw;
+    }
+    ::close(in_fd);
+}
+
+// NOTE 临时文件必须与目标在同一目录（同一文件系统），rename(2) 才是原子的；
+// 符号链接先解析，替换的是链接指向的文件，而不是链接本身
+void ByteStreamEditor::replace_file(const std::string& src, FileStats * stats) const
+{
+    std::unique_ptr<char, decltype(&std::free)> real(::realpath(src.c_str(), nullptr), &std::free);
+    if (!real) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "unable to resolve `" << src << "`: " << std::strerror(errno));
+    }
+    const std::string target = real.get();
+    struct stat src_st;
+    if (::stat(target.c_str(), &src_st) != 0) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "unable to stat `" << target << "`: " << std::strerror(errno));
+    }
+    const std::string dir = ::dir_of(target);
+    std::string tmp_path = target + ".bse-XXXXXX";
+    int fd = ::mkstemp(&tmp_path[0]);
+    if (fd == -1) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "unable to create temporary file in `" << dir << "`: " << std::strerror(errno));
+    }
+    try {
+        // NOTE 保留原文件的权限与属主；属主一般只有 root 能改，改不了就算了
+        int chown_ret = ::fchown(fd, src_st.st_uid, src_st.st_gid);
+        (void) chown_ret;
+        ::fchmod(fd, src_st.st_mode & 07777);
+        this->translate_to_fd(target, src_st.st_size, compression::detect_file(target), fd, stats);
+        if (this->m_fsync) {
+            StopWatch watch;
+            if (::fsync(fd) != 0) {
+                SSS_POSTION_THROW(std::runtime_error,
+                                  "fsync `" << tmp_path << "` failed: " << std::strerror(errno));
+            }
+            if (stats) {
+                stats->m_write_s += watch.seconds();
+                stats->m_translate_s += watch.seconds();
+            }
+        }
+        int ret = ::close(fd);
+        fd = -1;
+        if (ret != 0) {
             SSS_POSTION_THROW(std::runtime_error,
-                              "unable to open file `" << out << "` to write");
+                              "close `" << tmp_path << "` failed: " << std::strerror(errno));
+        }
+        if (::rename(tmp_path.c_str(), target.c_str()) != 0) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              "rename `" << tmp_path << "` to `" << target << "` failed: " << std::strerror(errno));
+        }
+    }
+    catch (...) {
+        if (fd != -1) {
+            ::close(fd);
         }
+        ::unlink(tmp_path.c_str());
+        throw;
+    }
+    if (this->m_fsync) {
+        // NOTE 让目录项的变更（rename）也落盘
+        int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+        if (dir_fd != -1) {
+            ::fsync(dir_fd);
+            ::close(dir_fd);
+        }
+    }
+}
 
-        this->m_sm.translate(ifs, ofs);
+// NOTE 按块读入，整块交给 Matcher；未替换的字节，由 Matcher 按段写出
+void ByteStreamEditor::translate(std::istream& in, SequenceSM::Sink& out) const
+{
+    SequenceSM::Matcher matcher(this->m_sm);
+    std::unique_ptr<char[]> block(new char[block_size]);
+    while (in.read(block.get(), block_size) || in.gcount()) {
+        matcher.feed(block.get(), in.gcount(), out);
     }
+    matcher.finish(out);
 }
 
-void ByteStreamEditor::add_rule(const std::string& key, const std::string& value)
+void ByteStreamEditor::translate_compressed(compression::Decoder& in, int out_fd, FileStats * stats) const
 {
-    // std::cout << __func__ << " " << VALUE_MSG(key) << " " << VALUE_MSG(value) << std::endl;
-    size_t st_id = 0;
-    for (size_t i = 0; i < key.length(); ++i) {
-        if (i == key.length() - 1) {
-            st_id = this->m_sm.ensure_jump(st_id, key[i],
-                                           std::bind([=](const std::string& value)->std::string {
-                                               return value;
-                                           }, value));
-            // std::cout << __func__ << ":" << __LINE__ << ":" << st_id << ",`" << value << "`" << std::endl;
+    compression::Encoder encoder(out_fd, this->output_codec(in.codec()));
+    PipelineTranslator(this->m_sm).translate(in, encoder, stats);
+}
+
+// NOTE 每块处理完就 flush：WritevSink 只记录了块内的指针，下一次 read 之前，
+// 必须写出去；
+// 第一块先读够判断格式所需的字节：压缩的输入，连同读走的这些字节交给流水线
+void ByteStreamEditor::translate(int in_fd, int out_fd, FileStats * stats) const
+{
+    StopWatch watch;
+    std::unique_ptr<char[]> block(new char[block_size]);
+    size_t head = 0u;
+    while (head < compression::magic_size) {
+        ssize_t len = ::read(in_fd, block.get() + head, block_size - head);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            SSS_POSTION_THROW(std::runtime_error,
+                              "read failed: " << std::strerror(errno));
+        }
+        if (len == 0) {
+            break;
         }
-        else {
-            st_id = this->m_sm.ensure_jump(st_id, key[i]);
-            // std::cout << __func__ << ":" << __LINE__ << ":" << st_id << std::endl;
+        head += len;
+    }
+    const compression::Codec codec = compression::detect(block.get(), head);
+    if (codec != compression::C_NONE || this->output_codec(codec) != compression::C_NONE) {
+        compression::Decoder decoder(in_fd, codec, std::string(block.get(), head));
+        this->translate_compressed(decoder, out_fd, stats);
+        return;
+    }
+
+    SequenceSM::Matcher matcher(this->m_sm);
+    WritevSink writev_sink(out_fd);
+    ::TimedSink timed_sink(writev_sink, stats);
+    SequenceSM::Sink& sink = stats ? static_cast<SequenceSM::Sink&>(timed_sink) : writev_sink;
+    if (stats) {
+        stats->m_match = SequenceSM::MatchStats(this->m_sm.table().m_state_cnt);
+        matcher.set_stats(&stats->m_match);
+    }
+    for (ssize_t len = head; len != 0; ) {
+        matcher.feed(block.get(), len, sink);
+        sink.flush();
+        do {
+            len = ::read(in_fd, block.get(), block_size);
+        } while (len < 0 && errno == EINTR);
+        if (len < 0) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              "read failed: " << std::strerror(errno));
         }
     }
+    matcher.finish(sink);
+    sink.flush();
+    if (stats) {
+        timed_sink.finish(watch);
+    }
+}
+
+// NOTE 整个映射作为一个数据块；原样字节只以指针的形式进入 iovec
+void ByteStreamEditor::translate(const MappedFile& in, int fd, FileStats * stats) const
+{
+    StopWatch watch;
+    WritevSink writev_sink(fd);
+    ::TimedSink timed_sink(writev_sink, stats);
+    SequenceSM::Sink& sink = stats ? static_cast<SequenceSM::Sink&>(timed_sink) : writev_sink;
+    SequenceSM::MatchStats * match = nullptr;
+    if (stats) {
+        stats->m_match = SequenceSM::MatchStats(this->m_sm.table().m_state_cnt);
+        match = &stats->m_match;
+    }
+    if (this->m_chunk_workers > 1 && in.size() >= ChunkTranslator::parallel_threshold) {
+        ChunkTranslator(this->m_sm, this->m_chunk_workers).translate(in.data(), in.size(), sink, match);
+    }
+    else {
+        SequenceSM::Matcher matcher(this->m_sm);
+        matcher.set_stats(match);
+        matcher.feed(in.data(), in.size(), sink);
+        matcher.finish(sink);
+    }
+    sink.flush();
+    if (stats) {
+        timed_sink.finish(watch);
+    }
+}
+
+void ByteStreamEditor::add_rule(const std::string& key, const std::string& value)
+{
+    // std::cout << __func__ << " " << VALUE_MSG(key) << " " << VALUE_MSG(value) << std::endl;
+    this->m_sm.add_rule(key, value);
+}
+
+std::string ByteStreamEditor::output_path(const std::string& src) const
+{
+    return compression::output_path(src, compression::detect_file(src), this->m_output_codec, ".ts");
 }
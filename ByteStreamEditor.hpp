@@ -2,8 +2,15 @@
 #define __BYTESTREAMEDITOR_HPP_1467685696__
 
 #include <string>
+#include <iostream>
 
 #include "SequenceSM.hpp"
+#include "MappedFile.hpp"
+#include "RunStats.hpp"
+#include "RuleLoader.hpp"
+#include "Compression.hpp"
+
+class Manifest;
 
 class ByteStreamEditor
 {
@@ -21,12 +28,208 @@ public:
     ByteStreamEditor& operator = (const ByteStreamEditor& ) = default;
 
 public:
+    /**
+     * @brief 读入并编译规则文件；rule_path 为 builtin:<name> 时，直接采用内置
+     *        的规则集（见 EmbeddedRules）
+     */
     void load(const std::string& rule_path);
-    void translate(const std::string& src, const std::string& out, bool replace = false);
+    /**
+     * @brief 处理单个文件；进度信息写到 log；
+     *        编译后的规则只读，多个线程可以同时对同一对象调用本函数；
+     *        replace 时，先写到同目录下的临时文件，成功后再 rename 覆盖原文件；
+     *        中途出错，原文件保持不变；
+     *        stats 非空时，填写本文件的统计（m_path 与 m_ok 由调用方填写）；
+     *        设置了清单（set_manifest()）时，先查清单，未变的文件直接跳过，处理
+     *        完再记入清单；
+     *        gzip/zstd 压缩的输入（按魔数判断）边解压边翻译；输出的格式见
+     *        set_output_codec()；
+     */
+    void translate(const std::string& src, const std::string& out, bool replace = false,
+                   std::ostream& log = std::cout, FileStats * stats = nullptr) const;
+    void translate(std::istream& in, SequenceSM::Sink& out) const;
+    void translate(const MappedFile& in, int fd, FileStats * stats = nullptr) const;
+    /**
+     * @brief 从 in_fd 按块读到结束，结果写到 out_fd；内存占用与输入大小无关；
+     *        可用于管道（stdin -> stdout）；压缩的输入同样按魔数判断
+     */
+    void translate(int in_fd, int out_fd, FileStats * stats = nullptr) const;
+    /**
+     * @brief 只扫描、不产生输出（--scan）：src 中的匹配累加到 match；压缩的文件，
+     *        扫描的是解压后的内容；match 的状态数须与规则集一致，或者为 0（只
+     *        计总数）；其 m_locate 为真时，同时记下各处匹配的位置；
+     *        first_only 时，第一处匹配所在的块处理完就停；回调规则不调用；
+     *        set_use_mmap(true) 时，不压缩的大文件映射读入；
+     *        多个线程可以同时调用
+     *
+     * @return 扫描过的字节数
+     */
+    uint64_t scan(const std::string& src, SequenceSM::MatchStats& match, bool first_only = false) const;
+    /**
+     * @brief 按样本 corpus_paths 上的访问次数，给状态重新编号（--train；见
+     *        SequenceSM::renumber()），让常走的状态在跳转表中挨在一起；压缩的
+     *        样本按解压后的内容统计；
+     *        load() 用了缓存时，新的编号随即写入缓存，之后的 load() 直接得到；
+     *        内置规则集只在本对象内生效；只适用于稠密表；
+     *        匹配结果与 Manifest::fingerprint() 都不变
+     */
+    TrainStats train(const std::vector<std::string>& corpus_paths);
     void add_rule(const std::string& key, const std::string& value);
+    /**
+     * @brief src 对应的输出文件名：src 加上 .ts；压缩的输入，.ts 加在格式后缀
+     *        之前，再换成输出格式的后缀（见 compression::output_path()）
+     */
+    std::string output_path(const std::string& src) const;
+    /**
+     * @brief 逐条 add_rule() 之后，编译跳转表；load() 已经包含这一步
+     */
+    void compile()
+    {
+        this->m_sm.compile();
+    }
+
+    const SequenceSM& sm() const
+    {
+        return this->m_sm;
+    }
+
+    /**
+     * @brief 最近一次 load() 各阶段的耗时
+     */
+    const LoadTimes& load_times() const
+    {
+        return this->m_load_times;
+    }
+
+    /**
+     * @brief 最近一次 load() 中，重复或冲突的键（只在解析规则文件时检查；命中
+     *        缓存或内置规则集时为空）
+     */
+    const std::vector<RuleLoader::Issue>& load_issues() const
+    {
+        return this->m_load_issues;
+    }
+
+    /**
+     * @brief load() 时，是否使用/生成已编译规则的缓存文件(RuleCache)；
+     *        须在 load() 之前设置
+     */
+    void set_use_cache(bool use_cache)
+    {
+        this->m_use_cache = use_cache;
+    }
+
+    /**
+     * @brief 编译所用的后端（见 SequenceSM::Backend）；须在 load() 之前设置；
+     *        B_DOUBLE_ARRAY 不读写缓存；内置规则集总是稠密表
+     */
+    void set_backend(SequenceSM::Backend backend)
+    {
+        this->m_sm.set_backend(backend);
+    }
+
+    /**
+     * @brief 是否对大文件使用 mmap 读入 + writev 写出；
+     *        小于 mmap_threshold 的文件，仍然走缓冲读写；
+     */
+    void set_use_mmap(bool use_mmap)
+    {
+        this->m_use_mmap = use_mmap;
+    }
+
+    /**
+     * @brief 单个大文件（不小于 ChunkTranslator::parallel_threshold）切块并行
+     *        翻译时，所用的线程数；1 表示不切块；切块只对 mmap 读入的文件
+     *        进行，见 set_use_mmap()
+     */
+    void set_chunk_workers(size_t worker_cnt)
+    {
+        this->m_chunk_workers = worker_cnt;
+    }
+
+    /**
+     * @brief replace 时，rename 之前 fsync 临时文件，之后 fsync 所在目录；
+     *        保证掉电后，看到的要么是旧文件，要么是完整的新文件
+     */
+    void set_fsync(bool use_fsync)
+    {
+        this->m_fsync = use_fsync;
+    }
+
+    /**
+     * @brief 输出的压缩格式；默认 compression::C_SAME，即与输入相同——replace 时，
+     *        压缩的文件仍是同一格式的压缩文件；
+     *        输入或输出有一端压缩时，解压、翻译、压缩各占一个线程（见
+     *        PipelineTranslator），此时不用 mmap，也不切块并行
+     */
+    void set_output_codec(compression::Codec codec)
+    {
+        this->m_output_codec = codec;
+    }
+
+    /**
+     * @brief 输入为 in 格式时，输出的格式（C_SAME 已换成 in）
+     */
+    compression::Codec output_codec(compression::Codec in) const
+    {
+        return this->m_output_codec == compression::C_SAME ? in : this->m_output_codec;
+    }
+
+    /**
+     * @brief 增量处理所用的清单；由调用方持有，须比本对象活得久；nullptr 表示
+     *        不用
+     */
+    void set_manifest(Manifest * manifest)
+    {
+        this->m_manifest = manifest;
+    }
+
+    /**
+     * @brief 先扫描一遍，没有任何匹配的文件，不写：replace 时原文件保持原样
+     *        （mtime 也不变）；否则不生成输出文件（已有的旧输出文件删除）；
+     *        有匹配的文件，扫描在第一处匹配所在的块就停下，然后照常处理；
+     *        规则集含回调时不扫描——回调不能执行两遍
+     */
+    void set_skip_noop(bool skip_noop)
+    {
+        this->m_skip_noop = skip_noop;
+    }
+
+    bool skip_noop() const
+    {
+        return this->m_skip_noop;
+    }
+
+public:
+    enum { block_size = 1024 * 1024 };
+
+    // NOTE 实测的交叉点（page cache 命中时）：256 KiB 以下，两条路径的差别在
+    // 噪声以内，而 mmap 还要额外付出 mmap/munmap 与缺页的开销；更大的文件，省
+    // 下的拷贝才开始稳定地体现出来；
+    enum { mmap_threshold = 256 * 1024 };
 
 private:
     SequenceSM m_sm;
+    bool       m_use_mmap;
+    size_t     m_chunk_workers;
+    bool       m_use_cache;
+    bool       m_fsync;
+    bool       m_skip_noop;
+    compression::Codec m_output_codec;
+    Manifest * m_manifest;
+    LoadTimes  m_load_times;
+    std::vector<RuleLoader::Issue> m_load_issues;
+    // NOTE 最近一次 load() 所用的缓存；train() 据此写回；空表示没有用缓存
+    std::string m_cache_path;
+    uint64_t    m_source_hash;
+
+private:
+    void translate_file(const std::string& src, const std::string& out, bool replace,
+                        std::ostream& log, FileStats * stats) const;
+    bool has_match(const std::string& src, FileStats * stats) const;
+    void translate_to_fd(const std::string& src, uint64_t size, compression::Codec codec,
+                         int fd, FileStats * stats) const;
+    void translate_compressed(compression::Decoder& in, int out_fd, FileStats * stats) const;
+    void replace_file(const std::string& src, FileStats * stats) const;
 };
 
 
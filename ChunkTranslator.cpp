@@ -0,0 +1,309 @@
+#include "ChunkTranslator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace  {
+    /**
+     * @brief 收集一块的输出；原样字节只保存指针，替换串复制到 m_arena
+     */
+    class PieceSink : public SequenceSM::Sink
+    {
+    public:
+        PieceSink()
+            : m_size(0u)
+        {}
+
+        void write(const char * data, size_t len) override
+        {
+            if (!len) {
+                return;
+            }
+            if (!this->m_pieces.empty() && !this->m_pieces.back().m_ref &&
+                this->m_pieces.back().m_off + this->m_pieces.back().m_len == this->m_arena.size())
+            {
+                this->m_pieces.back().m_len += len;
+            }
+            else {
+                this->m_pieces.push_back(Piece{nullptr, this->m_arena.size(), len});
+            }
+            this->m_arena.append(data, len);
+            this->m_size += len;
+        }
+
+        void write_ref(const char * data, size_t len) override
+        {
+            if (!len) {
+                return;
+            }
+            if (!this->m_pieces.empty() && this->m_pieces.back().m_ref &&
+                this->m_pieces.back().m_ref + this->m_pieces.back().m_len == data)
+            {
+                this->m_pieces.back().m_len += len;
+            }
+            else {
+                this->m_pieces.push_back(Piece{data, 0u, len});
+            }
+            this->m_size += len;
+        }
+
+        size_t size() const
+        {
+            return this->m_size;
+        }
+
+        /**
+         * @brief 跳过开头 skip 个字节，其余全部交给 out
+         */
+        void replay(SequenceSM::Sink& out, size_t skip) const
+        {
+            for (const auto& piece : this->m_pieces) {
+                if (skip >= piece.m_len) {
+                    skip -= piece.m_len;
+                    continue;
+                }
+                const char * data = piece.m_ref ? piece.m_ref : this->m_arena.data() + piece.m_off;
+                out.write_ref(data + skip, piece.m_len - skip);
+                skip = 0;
+            }
+        }
+
+    private:
+        struct Piece
+        {
+            const char *    m_ref;  // nullptr 表示在 m_arena 中
+            size_t          m_off;
+            size_t          m_len;
+        };
+        std::vector<Piece>  m_pieces;
+        std::string         m_arena;
+        size_t              m_size;
+    };
+
+    /**
+     * @brief 推测翻译时，状态机空闲的位置
+     */
+    struct IdlePoint
+    {
+        const char *    m_pos;
+        size_t          m_out_size;     // 此时已有的输出字节数
+        size_t          m_event_cnt;    // 此时窗口内已有的命中数
+    };
+
+    /**
+     * @brief 推测翻译一块的结果
+     */
+    struct Chunk
+    {
+        const char *    m_beg;
+        const char *    m_end;
+        PieceSink       m_out;
+        std::vector<IdlePoint> m_idle;  // 只记录窗口内的
+        std::unique_ptr<SequenceSM::Matcher> m_exit;   // 块结束时的状态
+        bool            m_done;
+
+        // NOTE 统计时，窗口内的命中逐条记下，缝合时可能要作废其中一部分
+        SequenceSM::MatchStats m_window_stats;
+        SequenceSM::MatchStats m_rest_stats;
+
+        Chunk(const char * beg, const char * end)
+            : m_beg(beg), m_end(end), m_done(false)
+        {}
+    };
+
+    void speculate(const SequenceSM& sm, Chunk& chunk, size_t window, bool with_stats)
+    {
+        SequenceSM::Matcher matcher(sm);
+        if (with_stats) {
+            chunk.m_window_stats = SequenceSM::MatchStats(sm.table().m_state_cnt);
+            chunk.m_window_stats.m_log = true;
+            chunk.m_rest_stats = SequenceSM::MatchStats(sm.table().m_state_cnt);
+            matcher.set_stats(&chunk.m_window_stats);
+        }
+        const char * it = chunk.m_beg;
+        const char * win_end = std::min(chunk.m_end, chunk.m_beg + window);
+        for (; it != win_end; ++it) {
+            matcher.feed(it, 1u, chunk.m_out);
+            if (matcher.idle()) {
+                chunk.m_idle.push_back(IdlePoint{it + 1, chunk.m_out.size(),
+                                                 chunk.m_window_stats.m_events.size()});
+            }
+        }
+        if (with_stats) {
+            matcher.set_stats(&chunk.m_rest_stats);
+        }
+        matcher.feed(it, chunk.m_end - it, chunk.m_out);
+        chunk.m_exit.reset(new SequenceSM::Matcher(matcher));
+    }
+
+    /**
+     * @brief 采用推测结果时，把它的命中计入 stats；
+     *        窗口内第 event_beg 条之前的命中，已被重跑的结果取代
+     */
+    void adopt_stats(SequenceSM::MatchStats * stats, const Chunk& chunk, size_t event_beg)
+    {
+        if (!stats) {
+            return;
+        }
+        const auto& events = chunk.m_window_stats.m_events;
+        for (size_t i = event_beg; i < events.size(); ++i) {
+            stats->hit(events[i].first, events[i].second);
+        }
+        stats->merge(chunk.m_rest_stats);
+    }
+
+    /**
+     * @brief 从真实的入口状态 entry 出发，重跑 chunk 开头，直到与推测结果汇合；
+     *        entry 随之变为本块的真实结束状态；
+     *        fixup 保存重跑的输出，须在 out.flush() 之后才能释放
+     */
+    void stitch(SequenceSM::Matcher& entry, Chunk& chunk, PieceSink& fixup, SequenceSM::Sink& out,
+                SequenceSM::MatchStats * stats)
+    {
+        if (entry.idle()) {
+            chunk.m_out.replay(out, 0u);
+            entry = *chunk.m_exit;
+            entry.set_stats(stats);
+            ::adopt_stats(stats, chunk, 0u);
+            return;
+        }
+        auto idle = chunk.m_idle.begin();
+        for (const char * it = chunk.m_beg; it != chunk.m_end; ++it) {
+            entry.feed(it, 1u, fixup);
+            while (idle != chunk.m_idle.end() && idle->m_pos <= it) {
+                ++idle;
+            }
+            if (idle == chunk.m_idle.end()) {
+                // NOTE 窗口内未能汇合，整块重跑
+                entry.feed(it + 1, chunk.m_end - it - 1, fixup);
+                fixup.replay(out, 0u);
+                return;
+            }
+            if (entry.idle() && idle->m_pos == it + 1) {
+                fixup.replay(out, 0u);
+                chunk.m_out.replay(out, idle->m_out_size);
+                entry = *chunk.m_exit;
+                entry.set_stats(stats);
+                ::adopt_stats(stats, chunk, idle->m_event_cnt);
+                return;
+            }
+        }
+        fixup.replay(out, 0u);
+    }
+} // namespace 
+
+ChunkTranslator::ChunkTranslator(const SequenceSM& sm, size_t worker_cnt, size_t chunk_size)
+    : m_sm(sm), m_worker_cnt(std::max<size_t>(worker_cnt, 1u)), m_chunk_size(chunk_size)
+{
+}
+
+void ChunkTranslator::translate(const char * data, size_t len, SequenceSM::Sink& out,
+                                SequenceSM::MatchStats * stats) const
+{
+    const size_t window = std::max<size_t>(this->m_sm.max_jump_cnt() * 4u, 64u);
+    const size_t chunk_size = this->m_chunk_size ? this->m_chunk_size :
+        std::min<size_t>(max_chunk_size,
+                         std::max<size_t>(min_chunk_size, len / (this->m_worker_cnt * 4u) + 1u));
+
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    for (size_t off = 0; off < len; off += chunk_size) {
+        chunks.emplace_back(new Chunk(data + off, data + std::min(len, off + chunk_size)));
+    }
+
+    // NOTE 以字节限制推测的领先量：内存占用与文件大小无关，只与线程数有关；
+    // 但至少领先 worker_cnt + 1 块，各线程才不至于空等
+    const size_t ahead_bytes = this->m_worker_cnt * size_t(ahead_bytes_per_worker);
+    const size_t ahead = std::max<size_t>(this->m_worker_cnt + 1u, ahead_bytes / chunk_size);
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t next_chunk = 0;
+    size_t written = 0;
+    std::exception_ptr error;
+
+    auto worker = [&]() {
+        for (;;) {
+            size_t idx;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [&]() {
+                    return next_chunk >= chunks.size() || next_chunk < written + ahead;
+                });
+                if (next_chunk >= chunks.size()) {
+                    return;
+                }
+                idx = next_chunk++;
+            }
+            try {
+                ::speculate(this->m_sm, *chunks[idx], window, stats != nullptr);
+            }
+            catch (...) {
+                // NOTE 只留第一个异常；停止派发剩余块，由拼接线程在 join 后重新抛出
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                    next_chunk = chunks.size();
+                }
+                cond.notify_all();
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                chunks[idx]->m_done = true;
+            }
+            cond.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    SequenceSM::Matcher entry(this->m_sm);
+    entry.set_stats(stats);
+    try {
+        // NOTE 创建线程也可能失败；已启动的线程要在 catch 中 join
+        for (size_t i = 0; i < this->m_worker_cnt; ++i) {
+            workers.emplace_back(worker);
+        }
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [&]() { return chunks[i]->m_done || error; });
+                if (!chunks[i]->m_done) {
+                    break;
+                }
+            }
+            PieceSink fixup;
+            ::stitch(entry, *chunks[i], fixup, out, stats);
+            out.flush();
+            chunks[i].reset();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                written = i + 1;
+            }
+            cond.notify_all();
+        }
+    }
+    catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            next_chunk = chunks.size();
+        }
+        cond.notify_all();
+        for (auto& w : workers) {
+            w.join();
+        }
+        throw;
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    entry.finish(out);
+}
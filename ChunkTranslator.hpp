@@ -0,0 +1,60 @@
+#ifndef __CHUNKTRANSLATOR_HPP_1468051240__
+#define __CHUNKTRANSLATOR_HPP_1468051240__
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "SequenceSM.hpp"
+
+/**
+ * @brief 单个大文件的块内并行翻译；
+ *
+ *  输入切成若干块，各块从 S0 开始，并行地"推测"翻译；推测时，记下块开头一段
+ *  窗口内、状态机空闲(Matcher::idle())的位置；
+ *
+ *  之后按顺序缝合：如果前一块结束时，真实状态恰好空闲，推测结果就是正确的；
+ *  否则，从前一块的真实结束状态出发，在本块开头逐字节重跑，直到某个位置上，
+ *  重跑与推测同时空闲——此后两者的输出必然相同，拼接即可；窗口内始终未能汇合，
+ *  就把整块重跑一遍。所以，结果与顺序执行逐字节相同。
+ *
+ *  窗口长度取 m_max_jump_cnt 的若干倍——最长的匹配不超过这个长度，一般跨过缝隙
+ *  后很快就会汇合。
+ */
+class ChunkTranslator
+{
+public:
+    /**
+     * @param chunk_size 每块的字节数；0 表示按线程数自动选取
+     */
+    ChunkTranslator(const SequenceSM& sm, size_t worker_cnt, size_t chunk_size = 0u);
+
+public:
+    /**
+     * @brief 翻译整段内存（通常是 MappedFile）；按顺序写入 out；
+     *        原样的字节，以 write_ref() 的方式输出，data 须一直有效；
+     *        stats 非空时，命中计入其中——与顺序执行时的统计相同；
+     */
+    void translate(const char * data, size_t len, SequenceSM::Sink& out,
+                   SequenceSM::MatchStats * stats = nullptr) const;
+
+public:
+    // NOTE 自动选取时，块长在这两者之间；推测的输出（PieceSink）每段 24 字节，
+    // 匹配密集时可达输入的二十倍，块长不能随文件增长
+    enum { min_chunk_size = 256 * 1024 };
+    enum { max_chunk_size = 1024 * 1024 };
+
+    // NOTE 推测翻译领先写出进度的输入，每个线程不超过这么多字节
+    enum { ahead_bytes_per_worker = 1024 * 1024 };
+
+    // NOTE 小于此值的文件，线程启动与缝合的开销不值得
+    enum { parallel_threshold = 16 * 1024 * 1024 };
+
+private:
+    const SequenceSM &  m_sm;
+    size_t              m_worker_cnt;
+    size_t              m_chunk_size;
+};
+
+
+#endif /* __CHUNKTRANSLATOR_HPP_1468051240__ */
@@ -0,0 +1,71 @@
+#include "CodepointTable.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+std::shared_ptr<const CodepointTable> CodepointTable::build(const SequenceSM& sm)
+{
+    const SequenceSM::Table& table = sm.table();
+    if (!sm.is_compiled()) {
+        return nullptr;
+    }
+    for (uint32_t st = 0; st < table.m_state_cnt; ++st) {
+        if (table.m_flags[st] & SequenceSM::F_CALLBACK) {
+            return nullptr;
+        }
+    }
+
+    std::shared_ptr<CodepointTable> cp_table = std::make_shared<CodepointTable>();
+    cp_table->m_index.assign((max_codepoint >> 8) + 1u, 0u);
+    cp_table->m_blocks.assign(256u, 0u);
+    const std::vector<std::string> keys = sm.terminal_keys();
+    size_t single_cnt = 0u;
+    size_t multibyte_cnt = 0u;
+    size_t defer_cnt = 0u;
+    for (uint32_t st = 1; st < keys.size(); ++st) {
+        const std::string& key = keys[st];
+        if (key.empty()) {
+            continue;
+        }
+        // NOTE 逐个码位检查；只有第一个码位进表
+        uint32_t first_cp = 0u;
+        size_t first_len = 0u;
+        for (size_t off = 0; off < key.size(); ) {
+            char buf[4] = {0, 0, 0, 0};
+            std::memcpy(buf, key.data() + off, std::min<size_t>(4u, key.size() - off));
+            uint32_t cp = 0u;
+            size_t len = CodepointTable::decode(buf, cp);
+            if (!len || off + len > key.size()) {
+                return nullptr;
+            }
+            if (!off) {
+                first_cp = cp;
+                first_len = len;
+            }
+            off += len;
+        }
+        uint16_t& block = cp_table->m_index[first_cp >> 8];
+        if (!block) {
+            block = cp_table->m_blocks.size() >> 8;
+            cp_table->m_blocks.resize(cp_table->m_blocks.size() + 256u, 0u);
+        }
+        uint32_t& entry = cp_table->m_blocks[(size_t(block) << 8) | (first_cp & 0xFFu)];
+        if (first_len == key.size()) {
+            ++single_cnt;
+            multibyte_cnt += first_len > 1u ? 1u : 0u;
+            // NOTE 同时是更长规则的前缀（F_PREFIX）：仍交给跳转表
+            if (entry != defer) {
+                entry = (table.m_flags[st] & SequenceSM::F_PREFIX) ? defer : st;
+                defer_cnt += entry == defer ? 1u : 0u;
+            }
+        }
+        else if (entry != defer) {
+            entry = defer;
+            ++defer_cnt;
+        }
+    }
+    if (!multibyte_cnt || defer_cnt * 8u > single_cnt) {
+        return nullptr;
+    }
+    return cp_table;
+}
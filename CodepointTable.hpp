@@ -0,0 +1,109 @@
+#ifndef __CODEPOINTTABLE_HPP_1468402519__
+#define __CODEPOINTTABLE_HPP_1468402519__
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "SequenceSM.hpp"
+
+/**
+ * @brief 单码位规则集的专用引擎所用的查找表；
+ *
+ *  规则集的键（几乎）全部是单个 UTF-8 码位（如 rule/ts.rule 的繁简对照）时，
+ *  字节 trie 可以换成：解码一个码位，查一次表。按码位两级索引：
+ *      m_index[cp >> 8]                   块号；0 号块全空，没有规则的区段共用
+ *      m_blocks[块号 * 256 + (cp & 0xFF)] 该码位对应的终态；0 表示没有规则；
+ *                                         defer 表示它是某条多码位规则的开头
+ *  查到的仍是 SequenceSM 的终态编号——替换串、统计都照旧按终态处理；遇到
+ *  defer，则从该位置起交还给跳转表，直到回到 S0。
+ *
+ *  键与输入都按严格的 UTF-8 解码：过长编码、代理区码位、超出 U+10FFFF 的，都
+ *  不算合法码位；键中出现这些，规则集就不适用本引擎；输入中出现这些，则按单个
+ *  字节原样输出——与字节 trie 的结果一致，因为合法码位的编码互不为前缀，匹配
+ *  只可能从码位的首字节开始。
+ */
+class CodepointTable
+{
+public:
+    /**
+     * @brief 规则集适用时建表，否则返回空；适用的条件：
+     *        没有回调；所有键都是合法的 UTF-8；至少有一条多字节的单码位规则
+     *        （全是 ASCII 单字节规则时，跳转表本来就是一字节一次查表）；多码位
+     *        规则的开头码位，不超过单码位规则数的 1/8
+     */
+    static std::shared_ptr<const CodepointTable> build(const SequenceSM& sm);
+
+public:
+    uint32_t find(uint32_t cp) const
+    {
+        return this->m_blocks[(size_t(this->m_index[cp >> 8]) << 8) | (cp & 0xFFu)];
+    }
+
+    /**
+     * @brief 解码 it 处的一个码位；调用方须保证 it 之后至少有 4 个字节可读；
+     *
+     * @return 码位的字节数；不是合法的 UTF-8 时返回 0
+     */
+    static size_t decode(const char * it, uint32_t& cp)
+    {
+        const uint8_t * s = reinterpret_cast<const uint8_t *>(it);
+        uint8_t b0 = s[0];
+        if (b0 < 0x80u) {
+            cp = b0;
+            return 1u;
+        }
+        if (b0 < 0xC2u) {
+            // NOTE 后续字节，或者过长的双字节编码
+            return 0u;
+        }
+        if (b0 < 0xE0u) {
+            if ((s[1] & 0xC0u) != 0x80u) {
+                return 0u;
+            }
+            cp = (uint32_t(b0 & 0x1Fu) << 6) | (s[1] & 0x3Fu);
+            return 2u;
+        }
+        if (b0 < 0xF0u) {
+            if ((s[1] & 0xC0u) != 0x80u || (s[2] & 0xC0u) != 0x80u ||
+                (b0 == 0xE0u && s[1] < 0xA0u) ||   // 过长编码
+                (b0 == 0xEDu && s[1] >= 0xA0u))     // 代理区
+            {
+                return 0u;
+            }
+            cp = (uint32_t(b0 & 0x0Fu) << 12) | (uint32_t(s[1] & 0x3Fu) << 6) | (s[2] & 0x3Fu);
+            return 3u;
+        }
+        if (b0 < 0xF5u) {
+            if ((s[1] & 0xC0u) != 0x80u || (s[2] & 0xC0u) != 0x80u || (s[3] & 0xC0u) != 0x80u ||
+                (b0 == 0xF0u && s[1] < 0x90u) ||   // 过长编码
+                (b0 == 0xF4u && s[1] >= 0x90u))     // 超出 U+10FFFF
+            {
+                return 0u;
+            }
+            cp = (uint32_t(b0 & 0x07u) << 18) | (uint32_t(s[1] & 0x3Fu) << 12) |
+                (uint32_t(s[2] & 0x3Fu) << 6) | (s[3] & 0x3Fu);
+            return 4u;
+        }
+        return 0u;
+    }
+
+    /**
+     * @brief 两级表占用的字节数
+     */
+    size_t byte_size() const
+    {
+        return this->m_index.size() * sizeof(uint16_t) + this->m_blocks.size() * sizeof(uint32_t);
+    }
+
+public:
+    enum { max_codepoint = 0x10FFFF };
+    static const uint32_t defer = 0xFFFFFFFFu;
+
+private:
+    std::vector<uint16_t>   m_index;
+    std::vector<uint32_t>   m_blocks;
+};
+
+
+#endif /* __CODEPOINTTABLE_HPP_1468402519__ */
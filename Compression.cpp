@@ -0,0 +1,494 @@
+#include "Compression.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sss/util/PostionThrow.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef BSE_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef BSE_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace  {
+    const unsigned char gzip_magic[] = {0x1f, 0x8b};
+    const unsigned char zstd_magic[] = {0x28, 0xb5, 0x2f, 0xfd};
+
+    bool has_suffix(const std::string& name, const std::string& suffix)
+    {
+        return !suffix.empty() && name.size() >= suffix.size() &&
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    void check_supported(compression::Codec codec)
+    {
+        if (!compression::is_supported(codec)) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              compression::codec_name(codec) << " support is not built in");
+        }
+    }
+} // namespace
+
+namespace compression {
+
+const char * codec_name(Codec codec)
+{
+    switch (codec) {
+    case C_GZIP:
+        return "gzip";
+
+    case C_ZSTD:
+        return "zstd";
+
+    case C_SAME:
+        return "same";
+
+    default:
+        return "none";
+    }
+}
+
+bool parse_codec(const std::string& name, Codec& codec)
+{
+    for (Codec c : {C_NONE, C_GZIP, C_ZSTD, C_SAME}) {
+        if (name == codec_name(c)) {
+            codec = c;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char * codec_suffix(Codec codec)
+{
+    switch (codec) {
+    case C_GZIP:
+        return ".gz";
+
+    case C_ZSTD:
+        return ".zst";
+
+    default:
+        return "";
+    }
+}
+
+bool is_supported(Codec codec)
+{
+    switch (codec) {
+    case C_GZIP:
+#ifdef BSE_HAVE_ZLIB
+        return true;
+#else
+        return false;
+#endif
+
+    case C_ZSTD:
+#ifdef BSE_HAVE_ZSTD
+        return true;
+#else
+        return false;
+#endif
+
+    default:
+        return true;
+    }
+}
+
+Codec detect(const char * data, size_t len)
+{
+    if (len >= sizeof(gzip_magic) && std::memcmp(data, gzip_magic, sizeof(gzip_magic)) == 0) {
+        return C_GZIP;
+    }
+    if (len >= sizeof(zstd_magic) && std::memcmp(data, zstd_magic, sizeof(zstd_magic)) == 0) {
+        return C_ZSTD;
+    }
+    return C_NONE;
+}
+
+Codec detect_file(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return C_NONE;
+    }
+    char head[magic_size];
+    ssize_t len = 0;
+    do {
+        len = ::pread(fd, head, sizeof(head), 0);
+    } while (len < 0 && errno == EINTR);
+    ::close(fd);
+    return len > 0 ? detect(head, len) : C_NONE;
+}
+
+std::string output_path(const std::string& src, Codec in, Codec out, const std::string& suffix)
+{
+    std::string path = src;
+    const std::string in_suffix = codec_suffix(in);
+    if (::has_suffix(path, in_suffix) && path.size() > in_suffix.size()) {
+        path.resize(path.size() - in_suffix.size());
+    }
+    return path + suffix + codec_suffix(out == C_SAME ? in : out);
+}
+
+// ---------------------------------------------------------------------------
+
+struct Decoder::State
+{
+    bool            m_open = true;  // 当前的 gzip 成员/zstd 帧尚未结束
+#ifdef BSE_HAVE_ZLIB
+    z_stream        m_zs;
+    bool            m_zs_inited = false;
+#endif
+#ifdef BSE_HAVE_ZSTD
+    ZSTD_DStream *  m_ds = nullptr;
+#endif
+
+    ~State()
+    {
+#ifdef BSE_HAVE_ZLIB
+        if (this->m_zs_inited) {
+            ::inflateEnd(&this->m_zs);
+        }
+#endif
+#ifdef BSE_HAVE_ZSTD
+        ::ZSTD_freeDStream(this->m_ds);
+#endif
+    }
+};
+
+Decoder::Decoder(int fd, Codec codec, const std::string& head)
+    : m_fd(fd), m_codec(codec), m_head(head), m_head_taken(false),
+      m_in_data(nullptr), m_in_len(0u), m_eof(false), m_done(false), m_raw_bytes(head.size()),
+      m_state(new State)
+{
+    ::check_supported(codec);
+    if (codec != C_NONE) {
+        this->m_input.reset(new char[input_size]);
+    }
+#ifdef BSE_HAVE_ZLIB
+    if (codec == C_GZIP) {
+        z_stream& zs = this->m_state->m_zs;
+        std::memset(&zs, 0, sizeof(zs));
+        // NOTE 15 + 16：只接受 gzip 封装
+        if (::inflateInit2(&zs, 15 + 16) != Z_OK) {
+            SSS_POSTION_THROW(std::runtime_error, "inflateInit2 failed");
+        }
+        this->m_state->m_zs_inited = true;
+    }
+#endif
+#ifdef BSE_HAVE_ZSTD
+    if (codec == C_ZSTD) {
+        this->m_state->m_ds = ::ZSTD_createDStream();
+        if (!this->m_state->m_ds) {
+            SSS_POSTION_THROW(std::runtime_error, "ZSTD_createDStream failed");
+        }
+        ::ZSTD_initDStream(this->m_state->m_ds);
+    }
+#endif
+}
+
+Decoder::~Decoder() = default;
+
+size_t Decoder::read_fd(char * buf, size_t cap)
+{
+    while (true) {
+        ssize_t len = ::read(this->m_fd, buf, cap);
+        if (len >= 0) {
+            this->m_raw_bytes += len;
+            return len;
+        }
+        if (errno != EINTR) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              "read failed: " << std::strerror(errno));
+        }
+    }
+}
+
+bool Decoder::fill()
+{
+    if (!this->m_head_taken) {
+        this->m_head_taken = true;
+        if (!this->m_head.empty()) {
+            this->m_in_data = this->m_head.data();
+            this->m_in_len = this->m_head.size();
+            return true;
+        }
+    }
+    this->m_in_data = this->m_input.get();
+    this->m_in_len = this->read_fd(this->m_input.get(), input_size);
+    return this->m_in_len != 0u;
+}
+
+size_t Decoder::read(char * buf, size_t cap)
+{
+    if (this->m_codec == C_GZIP) {
+        return this->read_gzip(buf, cap);
+    }
+    if (this->m_codec == C_ZSTD) {
+        return this->read_zstd(buf, cap);
+    }
+    // NOTE 不压缩：head 之后，直接读到 buf
+    size_t got = 0u;
+    if (!this->m_head_taken) {
+        this->m_head_taken = true;
+        this->m_in_data = this->m_head.data();
+        this->m_in_len = this->m_head.size();
+    }
+    while (got < cap && !this->m_done) {
+        if (this->m_in_len) {
+            size_t len = std::min(cap - got, this->m_in_len);
+            std::memcpy(buf + got, this->m_in_data, len);
+            this->m_in_data += len;
+            this->m_in_len -= len;
+            got += len;
+            continue;
+        }
+        size_t len = this->read_fd(buf + got, cap - got);
+        this->m_done = len == 0u;
+        got += len;
+    }
+    return got;
+}
+
+// NOTE 输入读完后，解码器中可能还积压着输出，所以仍以空输入调用，直到没有进展；
+// 此时成员/帧尚未结束，就是被截断了
+size_t Decoder::read_gzip(char * buf, size_t cap)
+{
+#ifdef BSE_HAVE_ZLIB
+    z_stream& zs = this->m_state->m_zs;
+    zs.next_out = reinterpret_cast<Bytef *>(buf);
+    zs.avail_out = cap;
+    while (zs.avail_out && !this->m_done) {
+        if (!this->m_in_len && !this->m_eof && !this->fill()) {
+            this->m_eof = true;
+        }
+        if (this->m_eof && !this->m_state->m_open) {
+            this->m_done = true;
+            break;
+        }
+        zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(this->m_in_data));
+        zs.avail_in = this->m_in_len;
+        const uInt avail_out = zs.avail_out;
+        int ret = ::inflate(&zs, Z_NO_FLUSH);
+        const bool progress = zs.avail_in != this->m_in_len || zs.avail_out != avail_out;
+        this->m_in_data += this->m_in_len - zs.avail_in;
+        this->m_in_len = zs.avail_in;
+        if (ret == Z_STREAM_END) {
+            // NOTE 多个成员首尾相接（如 cat a.gz b.gz），也是合法的 gzip 流
+            this->m_state->m_open = false;
+            ::inflateReset(&zs);
+            continue;
+        }
+        if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              "gzip data error: " << (zs.msg ? zs.msg : "unknown"));
+        }
+        if (progress) {
+            this->m_state->m_open = true;
+        }
+        else if (this->m_eof) {
+            SSS_POSTION_THROW(std::runtime_error, "gzip data truncated");
+        }
+    }
+    return cap - zs.avail_out;
+#else
+    (void) buf;
+    (void) cap;
+    return 0u;
+#endif
+}
+
+size_t Decoder::read_zstd(char * buf, size_t cap)
+{
+#ifdef BSE_HAVE_ZSTD
+    ZSTD_outBuffer out = {buf, cap, 0u};
+    while (out.pos < out.size && !this->m_done) {
+        if (!this->m_in_len && !this->m_eof && !this->fill()) {
+            this->m_eof = true;
+        }
+        if (this->m_eof && !this->m_state->m_open) {
+            this->m_done = true;
+            break;
+        }
+        ZSTD_inBuffer in = {this->m_in_data, this->m_in_len, 0u};
+        const size_t out_pos = out.pos;
+        size_t ret = ::ZSTD_decompressStream(this->m_state->m_ds, &out, &in);
+        if (::ZSTD_isError(ret)) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              "zstd data error: " << ::ZSTD_getErrorName(ret));
+        }
+        this->m_in_data += in.pos;
+        this->m_in_len -= in.pos;
+        // NOTE 返回 0 表示一帧结束并已全部输出；之后的字节是下一帧
+        this->m_state->m_open = ret != 0u;
+        if (this->m_eof && this->m_state->m_open && !in.pos && out.pos == out_pos) {
+            SSS_POSTION_THROW(std::runtime_error, "zstd data truncated");
+        }
+    }
+    return out.pos;
+#else
+    (void) buf;
+    (void) cap;
+    return 0u;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+
+struct Encoder::State
+{
+#ifdef BSE_HAVE_ZLIB
+    z_stream        m_zs;
+    bool            m_zs_inited = false;
+#endif
+#ifdef BSE_HAVE_ZSTD
+    ZSTD_CStream *  m_cs = nullptr;
+#endif
+
+    ~State()
+    {
+#ifdef BSE_HAVE_ZLIB
+        if (this->m_zs_inited) {
+            ::deflateEnd(&this->m_zs);
+        }
+#endif
+#ifdef BSE_HAVE_ZSTD
+        ::ZSTD_freeCStream(this->m_cs);
+#endif
+    }
+};
+
+Encoder::Encoder(int fd, Codec codec)
+    : m_fd(fd), m_codec(codec), m_raw_bytes(0u), m_state(new State)
+{
+    ::check_supported(codec);
+    if (codec != C_NONE) {
+        this->m_output.reset(new char[output_size]);
+    }
+#ifdef BSE_HAVE_ZLIB
+    if (codec == C_GZIP) {
+        z_stream& zs = this->m_state->m_zs;
+        std::memset(&zs, 0, sizeof(zs));
+        if (::deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            SSS_POSTION_THROW(std::runtime_error, "deflateInit2 failed");
+        }
+        this->m_state->m_zs_inited = true;
+        zs.next_out = reinterpret_cast<Bytef *>(this->m_output.get());
+        zs.avail_out = output_size;
+    }
+#endif
+#ifdef BSE_HAVE_ZSTD
+    if (codec == C_ZSTD) {
+        this->m_state->m_cs = ::ZSTD_createCStream();
+        if (!this->m_state->m_cs) {
+            SSS_POSTION_THROW(std::runtime_error, "ZSTD_createCStream failed");
+        }
+        ::ZSTD_initCStream(this->m_state->m_cs, ZSTD_CLEVEL_DEFAULT);
+    }
+#endif
+}
+
+Encoder::~Encoder() = default;
+
+void Encoder::write_fd(const char * data, size_t len)
+{
+    while (len) {
+        ssize_t ret = ::write(this->m_fd, data, len);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            SSS_POSTION_THROW(std::runtime_error,
+                              "write failed: " << std::strerror(errno));
+        }
+        this->m_raw_bytes += ret;
+        data += ret;
+        len -= ret;
+    }
+}
+
+void Encoder::write(const char * data, size_t len)
+{
+    if (this->m_codec == C_NONE) {
+        this->write_fd(data, len);
+        return;
+    }
+#ifdef BSE_HAVE_ZLIB
+    if (this->m_codec == C_GZIP) {
+        z_stream& zs = this->m_state->m_zs;
+        zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        zs.avail_in = len;
+        while (zs.avail_in) {
+            ::deflate(&zs, Z_NO_FLUSH);
+            if (!zs.avail_out) {
+                this->write_fd(this->m_output.get(), output_size);
+                zs.next_out = reinterpret_cast<Bytef *>(this->m_output.get());
+                zs.avail_out = output_size;
+            }
+        }
+    }
+#endif
+#ifdef BSE_HAVE_ZSTD
+    if (this->m_codec == C_ZSTD) {
+        ZSTD_inBuffer in = {data, len, 0u};
+        while (in.pos < in.size) {
+            ZSTD_outBuffer out = {this->m_output.get(), output_size, 0u};
+            size_t ret = ::ZSTD_compressStream2(this->m_state->m_cs, &out, &in, ZSTD_e_continue);
+            if (::ZSTD_isError(ret)) {
+                SSS_POSTION_THROW(std::runtime_error,
+                                  "zstd compress failed: " << ::ZSTD_getErrorName(ret));
+            }
+            this->write_fd(this->m_output.get(), out.pos);
+        }
+    }
+#endif
+}
+
+void Encoder::finish()
+{
+#ifdef BSE_HAVE_ZLIB
+    if (this->m_codec == C_GZIP) {
+        z_stream& zs = this->m_state->m_zs;
+        zs.next_in = nullptr;
+        zs.avail_in = 0u;
+        while (true) {
+            int ret = ::deflate(&zs, Z_FINISH);
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                SSS_POSTION_THROW(std::runtime_error, "deflate failed: " << ret);
+            }
+            this->write_fd(this->m_output.get(), output_size - zs.avail_out);
+            zs.next_out = reinterpret_cast<Bytef *>(this->m_output.get());
+            zs.avail_out = output_size;
+            if (ret == Z_STREAM_END) {
+                break;
+            }
+        }
+    }
+#endif
+#ifdef BSE_HAVE_ZSTD
+    if (this->m_codec == C_ZSTD) {
+        ZSTD_inBuffer in = {nullptr, 0u, 0u};
+        size_t remaining = 0u;
+        do {
+            ZSTD_outBuffer out = {this->m_output.get(), output_size, 0u};
+            remaining = ::ZSTD_compressStream2(this->m_state->m_cs, &out, &in, ZSTD_e_end);
+            if (::ZSTD_isError(remaining)) {
+                SSS_POSTION_THROW(std::runtime_error,
+                                  "zstd compress failed: " << ::ZSTD_getErrorName(remaining));
+            }
+            this->write_fd(this->m_output.get(), out.pos);
+        } while (remaining);
+    }
+#endif
+}
+
+} // namespace compression
@@ -0,0 +1,174 @@
+#ifndef __COMPRESSION_HPP_1468547702__
+#define __COMPRESSION_HPP_1468547702__
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+/**
+ * @brief gzip/zstd 压缩流的读写；
+ *
+ *  输入的格式按开头的魔数判断（gzip: 1f 8b；zstd: 28 b5 2f fd），与文件名无关；
+ *  gzip 依赖 zlib（BSE_HAVE_ZLIB），zstd 依赖 libzstd（BSE_HAVE_ZSTD），编译时
+ *  没有的，遇到时报错；
+ */
+namespace compression {
+
+enum Codec {
+    C_NONE,
+    C_GZIP,
+    C_ZSTD,
+    C_SAME      // 只用于选择输出格式：与输入相同
+};
+
+// NOTE 判断格式所需的字节数
+enum { magic_size = 4 };
+
+/**
+ * @brief "none" "gzip" "zstd" "same"
+ */
+const char * codec_name(Codec codec);
+
+/**
+ * @brief 按 codec_name() 解析；失败返回 false
+ */
+bool parse_codec(const std::string& name, Codec& codec);
+
+/**
+ * @brief 惯用的文件名后缀："" ".gz" ".zst"
+ */
+const char * codec_suffix(Codec codec);
+
+/**
+ * @brief 编译时是否带了该格式的支持
+ */
+bool is_supported(Codec codec);
+
+/**
+ * @brief 按开头的字节判断；len 不足 magic_size 时，只能认出 gzip
+ */
+Codec detect(const char * data, size_t len);
+
+/**
+ * @brief 读文件开头判断；打不开的文件，返回 C_NONE（留给之后的读取报错）
+ */
+Codec detect_file(const std::string& path);
+
+/**
+ * @brief 源文件对应的输出文件名：去掉输入格式的后缀，加上 suffix，再加上输出
+ *        格式的后缀；如 a.txt.gz -> a.txt.ts.gz（out 为 C_GZIP）、a.txt.ts
+ *        （out 为 C_NONE）
+ */
+std::string output_path(const std::string& src, Codec in, Codec out, const std::string& suffix);
+
+/**
+ * @brief 从 fd 读出解压后的数据；
+ *        head 是调用方为判断格式已经从 fd 读走的字节，作为流的开头
+ */
+class Decoder
+{
+public:
+    Decoder(int fd, Codec codec, const std::string& head = std::string());
+    ~Decoder();
+
+public:
+    Decoder(const Decoder& ) = delete;
+    Decoder& operator = (const Decoder& ) = delete;
+
+public:
+    /**
+     * @brief 尽量填满 buf；返回 0 表示结束；数据损坏或被截断时抛异常
+     */
+    size_t read(char * buf, size_t cap);
+
+    Codec codec() const
+    {
+        return this->m_codec;
+    }
+
+    /**
+     * @brief 从 fd 读入的（压缩的）字节数，含 head
+     */
+    uint64_t raw_bytes() const
+    {
+        return this->m_raw_bytes;
+    }
+
+public:
+    enum { input_size = 128 * 1024 };
+
+private:
+    // NOTE 先取 head，之后从 fd 读入一批到 m_input；返回 false 表示已到结尾
+    bool fill();
+    size_t read_fd(char * buf, size_t cap);
+
+    size_t read_gzip(char * buf, size_t cap);
+    size_t read_zstd(char * buf, size_t cap);
+
+private:
+    struct State;
+
+    int                         m_fd;
+    Codec                       m_codec;
+    std::string                 m_head;
+    bool                        m_head_taken;
+    std::unique_ptr<char[]>     m_input;
+    const char *                m_in_data;      // 尚未交给解码器的输入
+    size_t                      m_in_len;
+    bool                        m_eof;
+    bool                        m_done;
+    uint64_t                    m_raw_bytes;
+    std::unique_ptr<State>      m_state;
+};
+
+/**
+ * @brief 压缩后写到 fd；最后须调用 finish()，写出流的结尾
+ */
+class Encoder
+{
+public:
+    Encoder(int fd, Codec codec);
+    ~Encoder();
+
+public:
+    Encoder(const Encoder& ) = delete;
+    Encoder& operator = (const Encoder& ) = delete;
+
+public:
+    void write(const char * data, size_t len);
+    void finish();
+
+    Codec codec() const
+    {
+        return this->m_codec;
+    }
+
+    /**
+     * @brief 写到 fd 的（压缩后的）字节数
+     */
+    uint64_t raw_bytes() const
+    {
+        return this->m_raw_bytes;
+    }
+
+public:
+    enum { output_size = 128 * 1024 };
+
+private:
+    void write_fd(const char * data, size_t len);
+
+private:
+    struct State;
+
+    int                         m_fd;
+    Codec                       m_codec;
+    std::unique_ptr<char[]>     m_output;
+    uint64_t                    m_raw_bytes;
+    std::unique_ptr<State>      m_state;
+};
+
+} // namespace compression
+
+
+#endif /* __COMPRESSION_HPP_1468547702__ */
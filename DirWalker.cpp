@@ -0,0 +1,75 @@
+#include "DirWalker.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace  {
+    bool has_suffix(const std::string& name, const std::string& suffix)
+    {
+        return !suffix.empty() && name.size() >= suffix.size() &&
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    bool has_any_suffix(const std::string& name, const std::vector<std::string>& suffixes)
+    {
+        for (const auto& suffix : suffixes) {
+            if (::has_suffix(name, suffix)) {
+                return true;
+            }
+        }
+        return false;
+    }
+} // namespace 
+
+bool file_size(const std::string& path, uint64_t& size)
+{
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    size = st.st_size;
+    return true;
+}
+
+size_t walk_dir(const std::string& dir, const std::vector<std::string>& skip_suffixes,
+                std::vector<FileJob>& jobs, std::vector<std::string>& errors)
+{
+    size_t failed = 0;
+    std::vector<std::string> pending{dir};
+    while (!pending.empty()) {
+        std::string current = std::move(pending.back());
+        pending.pop_back();
+        DIR * d = ::opendir(current.c_str());
+        if (!d) {
+            errors.push_back("unable to open dir `" + current + "`: " + std::strerror(errno));
+            failed++;
+            continue;
+        }
+        while (struct dirent * entry = ::readdir(d)) {
+            if (std::strcmp(entry->d_name, ".") == 0 || std::strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+            std::string path = current;
+            if (path.empty() || path[path.size() - 1] != '/') {
+                path += '/';
+            }
+            path += entry->d_name;
+            struct stat st;
+            if (::lstat(path.c_str(), &st) != 0) {
+                errors.push_back("unable to stat `" + path + "`: " + std::strerror(errno));
+                continue;
+            }
+            if (S_ISDIR(st.st_mode)) {
+                pending.push_back(path);
+            }
+            else if (S_ISREG(st.st_mode) && !::has_any_suffix(path, skip_suffixes)) {
+                jobs.emplace_back(path, st.st_size);
+            }
+        }
+        ::closedir(d);
+    }
+    return failed;
+}
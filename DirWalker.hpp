@@ -0,0 +1,41 @@
+#ifndef __DIRWALKER_HPP_1467990027__
+#define __DIRWALKER_HPP_1467990027__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief 待处理的文件，以及其大小（用于调度：大文件先做）
+ */
+struct FileJob
+{
+    std::string m_path;
+    uint64_t    m_size;
+
+    FileJob()
+        : m_size(0u)
+    {}
+
+    FileJob(const std::string& path, uint64_t size)
+        : m_path(path), m_size(size)
+    {}
+};
+
+/**
+ * @brief 递归遍历目录，收集其中的普通文件；
+ *        不跟随符号链接，以免成环；以 skip_suffixes 中任一后缀结尾的文件（如上
+ *        一次运行生成的 .ts、.ts.gz 文件）跳过；
+ *
+ * @return 无法打开的子目录个数；出错信息追加到 errors
+ */
+size_t walk_dir(const std::string& dir, const std::vector<std::string>& skip_suffixes,
+                std::vector<FileJob>& jobs, std::vector<std::string>& errors);
+
+/**
+ * @brief 取文件大小；失败返回 false
+ */
+bool file_size(const std::string& path, uint64_t& size);
+
+
+#endif /* __DIRWALKER_HPP_1467990027__ */
@@ -0,0 +1,228 @@
+#include "DoubleArray.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <numeric>
+
+namespace  {
+    /**
+     * @brief build() 生成的各数组，实际存放于此
+     */
+    struct Storage
+    {
+        std::vector<uint8_t>    m_classes;
+        std::vector<uint32_t>   m_base;
+        std::vector<uint32_t>   m_check;
+        std::vector<uint32_t>   m_fail;
+        std::vector<uint32_t>   m_depth;
+        std::vector<uint8_t>    m_flags;
+        std::vector<uint32_t>   m_value;
+        std::string             m_pool;
+    };
+
+    // NOTE 待放置子节点的状态；[m_lo, m_hi) 是排序后以它为前缀的键
+    struct Node
+    {
+        uint32_t    m_slot;
+        uint32_t    m_lo;
+        uint32_t    m_hi;
+    };
+
+    // NOTE 成倍增长，摊还为线性
+    void ensure_size(Storage& s, std::vector<uint32_t>& dict, size_t size)
+    {
+        if (s.m_check.size() >= size) {
+            return;
+        }
+        size = std::max(size, s.m_check.size() * 2u);
+        s.m_base.resize(size, 0u);
+        s.m_check.resize(size, 0u);
+        s.m_fail.resize(size, 0u);
+        s.m_depth.resize(size, 0u);
+        s.m_flags.resize(size, 0u);
+        s.m_value.resize(size * 2u, 0u);
+        dict.resize(size, 0u);
+    }
+
+    bool has_child(const Storage& s, uint32_t st, uint8_t ch, uint32_t& child)
+    {
+        size_t t = size_t(s.m_base[st]) + ch;
+        if (t < s.m_check.size() && s.m_check[t] == st + 1u) {
+            child = t;
+            return true;
+        }
+        return false;
+    }
+} // namespace
+
+std::shared_ptr<const void> DoubleArray::build(std::vector<SequenceSM::RuleKey>& keys,
+                                               const std::string& pool,
+                                               SequenceSM::Table& table)
+{
+    keys.erase(std::remove_if(keys.begin(), keys.end(),
+                              [](const SequenceSM::RuleKey& key) { return key.m_key.empty(); }),
+               keys.end());
+    // NOTE 稳定排序：相同的键，先加入的排在前面
+    std::vector<uint32_t> order(keys.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(),
+                     [&keys](uint32_t lhs, uint32_t rhs) {
+                         return keys[lhs].m_key < keys[rhs].m_key;
+                     });
+    auto key_at = [&keys, &order](uint32_t i) -> const SequenceSM::RuleKey& {
+        return keys[order[i]];
+    };
+
+    std::shared_ptr<Storage> storage = std::make_shared<Storage>();
+    Storage& s = *storage;
+    std::vector<uint32_t> dict;     // fail 链上，最近的带动作状态
+    ::ensure_size(s, dict, 512u);
+
+    uint32_t max_jump = 0u;
+    uint32_t max_base = 0u;
+    size_t max_slot = 0u;
+    size_t next_check_pos = 1u;
+    std::vector<uint8_t> bytes;
+    std::vector<uint32_t> bounds;
+    std::deque<Node> queue;
+    queue.push_back(Node{0u, 0u, uint32_t(order.size())});
+    while (!queue.empty()) {
+        const Node node = queue.front();
+        queue.pop_front();
+        const uint32_t st = node.m_slot;
+        const uint32_t depth = s.m_depth[st];
+        uint32_t lo = node.m_lo;
+        // NOTE 恰好以本节点结尾的键排在区间最前面（终态已在放置时标记）
+        while (lo < node.m_hi && key_at(lo).m_key.size() == depth) {
+            ++lo;
+        }
+        if (lo == node.m_hi) {
+            continue;
+        }
+
+        bytes.clear();
+        bounds.clear();
+        for (uint32_t i = lo; i < node.m_hi; ++i) {
+            uint8_t ch = key_at(i).m_key[depth];
+            if (bytes.empty() || bytes.back() != ch) {
+                bytes.push_back(ch);
+                bounds.push_back(i);
+            }
+        }
+        bounds.push_back(node.m_hi);
+
+        // NOTE 找 base：第一个子节点落在空闲位置 pos 上，其余子节点也都空闲
+        size_t pos = std::max<size_t>(next_check_pos, size_t(bytes.front()) + 1u);
+        size_t nonzero = 0u;
+        bool first = true;
+        size_t base = 0u;
+        while (true) {
+            ::ensure_size(s, dict, pos + 257u);
+            if (s.m_check[pos]) {
+                ++nonzero;
+                ++pos;
+                continue;
+            }
+            if (first) {
+                next_check_pos = pos;
+                first = false;
+            }
+            base = pos - bytes.front();
+            bool is_free = true;
+            for (size_t k = 1; k < bytes.size() && is_free; ++k) {
+                is_free = !s.m_check[base + bytes[k]];
+            }
+            if (is_free) {
+                break;
+            }
+            ++pos;
+        }
+        if (nonzero * 20u >= (pos - next_check_pos + 1u) * 19u) {
+            next_check_pos = pos;
+        }
+        s.m_base[st] = base;
+        max_base = std::max<uint32_t>(max_base, base);
+
+        for (size_t k = 0; k < bytes.size(); ++k) {
+            const uint32_t child = base + bytes[k];
+            const uint32_t c_lo = bounds[k];
+            const uint32_t c_hi = bounds[k + 1];
+            s.m_check[child] = st + 1u;
+            s.m_depth[child] = depth + 1u;
+            max_slot = std::max<size_t>(max_slot, child);
+            max_jump = std::max(max_jump, depth + 1u);
+
+            const SequenceSM::RuleKey& head = key_at(c_lo);
+            if (head.m_key.size() == depth + 1u) {
+                s.m_flags[child] |= SequenceSM::F_TERMINAL;
+                if (head.m_kind == SequenceSM::State::k_callback) {
+                    s.m_flags[child] |= SequenceSM::F_CALLBACK;
+                }
+                // NOTE 区间内还有更长的键，即有子节点
+                if (key_at(c_hi - 1u).m_key.size() > depth + 1u) {
+                    s.m_flags[child] |= SequenceSM::F_PREFIX;
+                }
+                s.m_value[child * 2u] = head.m_value_off;
+                s.m_value[child * 2u + 1u] = head.m_value_len;
+            }
+
+            // NOTE fail(st) 链上的节点都比 child 浅，其子节点都已放好
+            uint32_t f = 0u;
+            if (st) {
+                uint32_t cur = s.m_fail[st];
+                while (true) {
+                    uint32_t next = 0u;
+                    if (::has_child(s, cur, bytes[k], next)) {
+                        f = next;
+                        break;
+                    }
+                    if (!cur) {
+                        break;
+                    }
+                    cur = s.m_fail[cur];
+                }
+            }
+            s.m_fail[child] = f;
+            dict[child] = (s.m_flags[f] & SequenceSM::F_TERMINAL) ? f : dict[f];
+            if (dict[child] || (s.m_flags[st] & SequenceSM::F_RESCAN)) {
+                s.m_flags[child] |= SequenceSM::F_RESCAN;
+            }
+            queue.push_back(Node{child, c_lo, c_hi});
+        }
+    }
+
+    // NOTE 留出 base + 255 的余量，查表时不必检查越界
+    const size_t size = std::max(max_slot + 1u, size_t(max_base) + 256u);
+    s.m_base.resize(size);
+    s.m_check.resize(size);
+    s.m_fail.resize(size);
+    s.m_depth.resize(size);
+    s.m_flags.resize(size);
+    s.m_value.resize(size * 2u);
+    s.m_base.shrink_to_fit();
+    s.m_check.shrink_to_fit();
+    s.m_fail.shrink_to_fit();
+    s.m_depth.shrink_to_fit();
+    s.m_flags.shrink_to_fit();
+    s.m_value.shrink_to_fit();
+    s.m_pool = pool;
+    s.m_classes.resize(256u);
+    std::iota(s.m_classes.begin(), s.m_classes.end(), 0u);
+
+    table = SequenceSM::Table();
+    table.m_state_cnt = size;
+    table.m_max_jump_cnt = max_jump;
+    table.m_class_cnt = 256u;
+    table.m_classes = s.m_classes.data();
+    table.m_next = nullptr;
+    table.m_depth = s.m_depth.data();
+    table.m_flags = s.m_flags.data();
+    table.m_value = s.m_value.data();
+    table.m_pool = s.m_pool.data();
+    table.m_pool_size = s.m_pool.size();
+    table.m_backend = SequenceSM::B_DOUBLE_ARRAY;
+    table.m_base = s.m_base.data();
+    table.m_check = s.m_check.data();
+    table.m_fail = s.m_fail.data();
+    return storage;
+}
@@ -0,0 +1,38 @@
+#ifndef __DOUBLEARRAY_HPP_1468440652__
+#define __DOUBLEARRAY_HPP_1468440652__
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "SequenceSM.hpp"
+
+/**
+ * @brief 双数组 (base/check) trie 的整批构建；SequenceSM 的 B_DOUBLE_ARRAY 后端；
+ *
+ *  键先（稳定地）排序，再按广度优先逐层放置：同一父节点的子节点，按排序后的区
+ *  间一次找齐，为它们找一个 base，使 base + 字节 处全都空闲；找空位时，从第一个
+ *  空闲位置往后扫，扫过的区间几乎全满时，整体前移起点（darts 的做法）；
+ *
+ *  失败链接在放置子节点的同时求出：广度优先，深度更小的节点及其子节点都已经放
+ *  好；F_RESCAN、F_PREFIX 的含义与稠密表相同；
+ *
+ *  每个状态：base、check、fail、depth 各 4 字节，flags 1 字节，替换串的偏移与
+ *  长度 8 字节；不再需要规则树（m_statuss/m_sm）与稠密表。
+ */
+class DoubleArray
+{
+public:
+    /**
+     * @brief 由 keys 建表，填写 table（m_state_cnt 为双数组的长度）；
+     *        键完全相同的，以 keys 中靠前的为准；空键忽略；
+     *
+     * @return 持有 table 所指向内存的对象
+     */
+    static std::shared_ptr<const void> build(std::vector<SequenceSM::RuleKey>& keys,
+                                             const std::string& pool,
+                                             SequenceSM::Table& table);
+};
+
+
+#endif /* __DOUBLEARRAY_HPP_1468440652__ */
@@ -0,0 +1,39 @@
+#include "EmbeddedRules.hpp"
+
+#include <cstring>
+
+namespace  {
+    // NOTE 函数内的静态对象：不受各编译单元静态初始化顺序的影响
+    std::vector<const EmbeddedRuleSet *>& registry()
+    {
+        static std::vector<const EmbeddedRuleSet *> rule_sets;
+        return rule_sets;
+    }
+} // namespace
+
+const char * EmbeddedRules::path_prefix = "builtin:";
+
+const EmbeddedRuleSet * EmbeddedRules::find(const std::string& name)
+{
+    std::string bare = name;
+    const size_t suffix_len = std::strlen(".rule");
+    if (bare.size() > suffix_len && bare.compare(bare.size() - suffix_len, suffix_len, ".rule") == 0) {
+        bare.resize(bare.size() - suffix_len);
+    }
+    for (const EmbeddedRuleSet * rule_set : ::registry()) {
+        if (bare == rule_set->m_name) {
+            return rule_set;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<const EmbeddedRuleSet *> EmbeddedRules::list()
+{
+    return ::registry();
+}
+
+void EmbeddedRules::add(const EmbeddedRuleSet * rule_set)
+{
+    ::registry().push_back(rule_set);
+}
@@ -0,0 +1,52 @@
+#ifndef __EMBEDDEDRULES_HPP_1468415730__
+#define __EMBEDDEDRULES_HPP_1468415730__
+
+#include <string>
+#include <vector>
+
+#include "SequenceSM.hpp"
+
+/**
+ * @brief 编译期嵌入的规则集；由 bse-embed 从规则文件生成（见 CMake 函数
+ *        bse_embed_rules()），跳转表与替换串都是常量数组，随程序映像一起载入：
+ *        启动时没有解析，也没有建表；
+ */
+struct EmbeddedRuleSet
+{
+    const char *        m_name;     // 内置名，即规则文件名去掉 .rule 后缀
+    SequenceSM::Table   m_table;
+};
+
+/**
+ * @brief 内置规则集的注册表；生成的源文件在静态初始化时登记自己
+ */
+class EmbeddedRules
+{
+public:
+    /**
+     * @brief 按名字查找；name 可以带 .rule 后缀；没有则返回 nullptr
+     */
+    static const EmbeddedRuleSet * find(const std::string& name);
+
+    static std::vector<const EmbeddedRuleSet *> list();
+
+    static void add(const EmbeddedRuleSet * rule_set);
+
+    /**
+     * @brief 生成的源文件中，以静态对象的方式登记
+     */
+    struct Registrar
+    {
+        explicit Registrar(const EmbeddedRuleSet * rule_set)
+        {
+            EmbeddedRules::add(rule_set);
+        }
+    };
+
+public:
+    // NOTE 命令行、--client 中，内置规则集的"路径"写作 builtin:<name>
+    static const char * path_prefix;
+};
+
+
+#endif /* __EMBEDDEDRULES_HPP_1468415730__ */
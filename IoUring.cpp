@@ -0,0 +1,342 @@
+#include "IoUring.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sss/util/PostionThrow.hpp>
+
+#ifdef BSE_HAVE_IO_URING
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#ifdef BSE_HAVE_IO_URING
+
+namespace  {
+    int sys_io_uring_setup(unsigned entries, struct io_uring_params * params)
+    {
+        return int(::syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        return int(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+    int sys_io_uring_register(int fd, unsigned opcode, void * arg, unsigned nr_args)
+    {
+        return int(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+    }
+
+    // NOTE 与内核共享的下标：读对方写的用 acquire，写给对方看的用 release
+    inline unsigned load_acquire(const unsigned * p)
+    {
+        return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+    }
+
+    inline void store_release(unsigned * p, unsigned value)
+    {
+        __atomic_store_n(p, value, __ATOMIC_RELEASE);
+    }
+
+    void unmap(void * ptr, size_t size)
+    {
+        if (ptr && ptr != MAP_FAILED) {
+            ::munmap(ptr, size);
+        }
+    }
+} // namespace
+
+/**
+ * @brief 三块映射：SQ 环（head、tail、下标数组）、CQ 环（head、tail、CQE 数
+ *        组）、SQE 数组；内核支持 IORING_FEAT_SINGLE_MMAP 时，前两块是同一块
+ */
+struct IoUring::Ring
+{
+    void *                  m_sq_ptr = nullptr;
+    size_t                  m_sq_size = 0u;
+    void *                  m_cq_ptr = nullptr;
+    size_t                  m_cq_size = 0u;
+    struct io_uring_sqe *   m_sqes = nullptr;
+    size_t                  m_sqes_size = 0u;
+
+    unsigned *              m_sq_head = nullptr;
+    unsigned *              m_sq_tail = nullptr;
+    unsigned *              m_sq_array = nullptr;
+    unsigned                m_sq_mask = 0u;
+    unsigned                m_sq_entries = 0u;
+
+    unsigned *              m_cq_head = nullptr;
+    unsigned *              m_cq_tail = nullptr;
+    struct io_uring_cqe *   m_cqes = nullptr;
+    unsigned                m_cq_mask = 0u;
+
+    unsigned                m_to_submit = 0u;   // 已放入 SQ、尚未 io_uring_enter 的个数
+
+    ~Ring()
+    {
+        if (this->m_cq_ptr != this->m_sq_ptr) {
+            ::unmap(this->m_cq_ptr, this->m_cq_size);
+        }
+        ::unmap(this->m_sq_ptr, this->m_sq_size);
+        ::unmap(this->m_sqes, this->m_sqes_size);
+    }
+};
+
+IoUring::IoUring(unsigned entries)
+    : m_fd(-1), m_ring(new Ring)
+{
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    this->m_fd = ::sys_io_uring_setup(entries, &params);
+    if (this->m_fd < 0) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "io_uring_setup failed: " << std::strerror(errno));
+    }
+    Ring& r = *this->m_ring;
+    r.m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    r.m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        r.m_sq_size = r.m_cq_size = std::max(r.m_sq_size, r.m_cq_size);
+    }
+    r.m_sq_ptr = ::mmap(nullptr, r.m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        this->m_fd, IORING_OFF_SQ_RING);
+    r.m_cq_ptr = single_mmap ? r.m_sq_ptr
+        : ::mmap(nullptr, r.m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 this->m_fd, IORING_OFF_CQ_RING);
+    r.m_sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void * sqes = ::mmap(nullptr, r.m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         this->m_fd, IORING_OFF_SQES);
+    r.m_sqes = static_cast<struct io_uring_sqe *>(sqes);
+    if (r.m_sq_ptr == MAP_FAILED || r.m_cq_ptr == MAP_FAILED || sqes == MAP_FAILED) {
+        int err = errno;
+        this->m_ring.reset();
+        ::close(this->m_fd);
+        SSS_POSTION_THROW(std::runtime_error,
+                          "mmap io_uring failed: " << std::strerror(err));
+    }
+
+    char * sq = static_cast<char *>(r.m_sq_ptr);
+    r.m_sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    r.m_sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    r.m_sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    r.m_sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    r.m_sq_entries = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_entries);
+
+    char * cq = static_cast<char *>(r.m_cq_ptr);
+    r.m_cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    r.m_cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    r.m_cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+    r.m_cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+}
+
+IoUring::~IoUring()
+{
+    this->m_ring.reset();
+    if (this->m_fd >= 0) {
+        ::close(this->m_fd);
+    }
+}
+
+bool IoUring::available()
+{
+    static const bool is_available = []() {
+        try {
+            IoUring ring(4u);
+            // NOTE struct io_uring_probe 之后紧跟 ops 数组
+            const size_t op_cnt = 256u;
+            std::unique_ptr<char[]> buf(new char[sizeof(struct io_uring_probe) +
+                                                 op_cnt * sizeof(struct io_uring_probe_op)]());
+            struct io_uring_probe * probe = reinterpret_cast<struct io_uring_probe *>(buf.get());
+            if (::sys_io_uring_register(ring.m_fd, IORING_REGISTER_PROBE, probe, op_cnt) < 0) {
+                return false;
+            }
+            for (int op : {IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE}) {
+                if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        catch (std::exception& ) {
+            return false;
+        }
+    }();
+    return is_available;
+}
+
+unsigned IoUring::sq_space() const
+{
+    const Ring& r = *this->m_ring;
+    return r.m_sq_entries - (*r.m_sq_tail - ::load_acquire(r.m_sq_head));
+}
+
+void * IoUring::next_sqe()
+{
+    Ring& r = *this->m_ring;
+    if (!this->sq_space()) {
+        SSS_POSTION_THROW(std::runtime_error, "io_uring submission queue is full");
+    }
+    struct io_uring_sqe * sqe = &r.m_sqes[*r.m_sq_tail & r.m_sq_mask];
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+// NOTE 只有本线程写 sq_tail，直接读即可；SQE 填好之后才发布新的 tail
+void IoUring::commit()
+{
+    Ring& r = *this->m_ring;
+    const unsigned tail = *r.m_sq_tail;
+    r.m_sq_array[tail & r.m_sq_mask] = tail & r.m_sq_mask;
+    ::store_release(r.m_sq_tail, tail + 1u);
+    ++r.m_to_submit;
+}
+
+void IoUring::prep_openat(const char * path, int flags, unsigned mode, uint64_t user_data)
+{
+    struct io_uring_sqe * sqe = static_cast<struct io_uring_sqe *>(this->next_sqe());
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<uintptr_t>(path);
+    sqe->len = mode;
+    sqe->open_flags = flags;
+    sqe->user_data = user_data;
+    this->commit();
+}
+
+void IoUring::prep_read(int fd, void * buf, unsigned len, uint64_t offset, uint64_t user_data)
+{
+    struct io_uring_sqe * sqe = static_cast<struct io_uring_sqe *>(this->next_sqe());
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uintptr_t>(buf);
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    this->commit();
+}
+
+void IoUring::prep_write(int fd, const void * buf, unsigned len, uint64_t offset, uint64_t user_data)
+{
+    struct io_uring_sqe * sqe = static_cast<struct io_uring_sqe *>(this->next_sqe());
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uintptr_t>(buf);
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    this->commit();
+}
+
+void IoUring::prep_close(int fd, uint64_t user_data)
+{
+    struct io_uring_sqe * sqe = static_cast<struct io_uring_sqe *>(this->next_sqe());
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = user_data;
+    this->commit();
+}
+
+void IoUring::submit(unsigned wait_nr)
+{
+    Ring& r = *this->m_ring;
+    while (true) {
+        int ret = ::sys_io_uring_enter(this->m_fd, r.m_to_submit, wait_nr,
+                                       wait_nr ? IORING_ENTER_GETEVENTS : 0u);
+        if (ret >= 0) {
+            r.m_to_submit -= std::min<unsigned>(r.m_to_submit, ret);
+            return;
+        }
+        // NOTE EBUSY：CQ 满了，须先 reap()；由调用方在下一轮处理
+        if (errno == EBUSY) {
+            return;
+        }
+        if (errno != EINTR && errno != EAGAIN) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              "io_uring_enter failed: " << std::strerror(errno));
+        }
+    }
+}
+
+size_t IoUring::reap(const std::function<void(uint64_t user_data, int res)>& fn)
+{
+    Ring& r = *this->m_ring;
+    size_t cnt = 0u;
+    unsigned head = *r.m_cq_head;
+    while (head != ::load_acquire(r.m_cq_tail)) {
+        const struct io_uring_cqe& cqe = r.m_cqes[head & r.m_cq_mask];
+        const uint64_t user_data = cqe.user_data;
+        const int res = cqe.res;
+        // NOTE 先归还 CQE 再回调：回调中可能继续提交
+        ::store_release(r.m_cq_head, ++head);
+        fn(user_data, res);
+        ++cnt;
+    }
+    return cnt;
+}
+
+#else
+
+struct IoUring::Ring
+{
+};
+
+IoUring::IoUring(unsigned )
+    : m_fd(-1)
+{
+    SSS_POSTION_THROW(std::runtime_error, "io_uring support is not built in");
+}
+
+IoUring::~IoUring() = default;
+
+bool IoUring::available()
+{
+    return false;
+}
+
+unsigned IoUring::sq_space() const
+{
+    return 0u;
+}
+
+void * IoUring::next_sqe()
+{
+    return nullptr;
+}
+
+void IoUring::commit()
+{
+}
+
+void IoUring::prep_openat(const char * , int , unsigned , uint64_t )
+{
+}
+
+void IoUring::prep_read(int , void * , unsigned , uint64_t , uint64_t )
+{
+}
+
+void IoUring::prep_write(int , const void * , unsigned , uint64_t , uint64_t )
+{
+}
+
+void IoUring::prep_close(int , uint64_t )
+{
+}
+
+void IoUring::submit(unsigned )
+{
+}
+
+size_t IoUring::reap(const std::function<void(uint64_t user_data, int res)>& )
+{
+    return 0u;
+}
+
+#endif
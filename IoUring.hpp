@@ -0,0 +1,73 @@
+#ifndef __IOURING_HPP_1468631405__
+#define __IOURING_HPP_1468631405__
+
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+
+/**
+ * @brief io_uring(7) 的最小封装：直接用 io_uring_setup(2)/io_uring_enter(2)
+ *        两个系统调用与共享内存中的环，不依赖 liburing；
+ *
+ *  只提供 BatchTranslator 用到的几种操作：openat、read、write、close；每个操作
+ *  带一个 user_data，完成时原样交回；prep_*() 只是填写 SQE，submit() 时才一并
+ *  交给内核——一次系统调用提交一批、取回一批；
+ *
+ *  编译时没有 <linux/io_uring.h>（BSE_HAVE_IO_URING 未定义），或者内核、容器
+ *  不允许（老内核、seccomp 禁用）时，available() 返回 false，构造函数抛异常；
+ *
+ *  NOTE 不是线程安全的：同一时间只能有一个线程使用；
+ */
+class IoUring
+{
+public:
+    explicit IoUring(unsigned entries);
+    ~IoUring();
+
+public:
+    IoUring(const IoUring& ) = delete;
+    IoUring& operator = (const IoUring& ) = delete;
+
+public:
+    /**
+     * @brief 能否建立环，且内核支持所需的全部操作；结果只探测一次
+     */
+    static bool available();
+
+    /**
+     * @brief SQ 中还能填写的 SQE 个数
+     */
+    unsigned sq_space() const;
+
+    // NOTE SQ 已满时抛异常；调用方应按 sq_space() 控制在途的操作数
+    void prep_openat(const char * path, int flags, unsigned mode, uint64_t user_data);
+    void prep_read(int fd, void * buf, unsigned len, uint64_t offset, uint64_t user_data);
+    void prep_write(int fd, const void * buf, unsigned len, uint64_t offset, uint64_t user_data);
+    void prep_close(int fd, uint64_t user_data);
+
+    /**
+     * @brief 提交已填写的 SQE，并等到至少 wait_nr 个操作完成
+     */
+    void submit(unsigned wait_nr);
+
+    /**
+     * @brief 取出已完成的操作，逐个调用 fn(user_data, res)；res 与对应的系统调
+     *        用返回值相同，出错时为 -errno；返回取出的个数
+     */
+    size_t reap(const std::function<void(uint64_t user_data, int res)>& fn);
+
+private:
+    struct Ring;
+
+    // NOTE 取一个清零的 SQE，填好后由 commit() 放入 SQ
+    void * next_sqe();
+    void commit();
+
+private:
+    int                     m_fd;
+    std::unique_ptr<Ring>   m_ring;
+};
+
+
+#endif /* __IOURING_HPP_1468631405__ */
@@ -0,0 +1,245 @@
+#include "JsonWriter.hpp"
+
+#include <cmath>
+#include <cstdio>
+
+namespace  {
+    // NOTE it 处一个合法 UTF-8 序列的长度；不合法时返回 0
+    size_t utf8_len(const unsigned char * it, const unsigned char * end)
+    {
+        const unsigned char lead = *it;
+        size_t len;
+        uint32_t cp;
+        if (lead < 0x80u) {
+            return 1u;
+        }
+        else if (lead >= 0xC2u && lead <= 0xDFu) {
+            len = 2u;
+            cp = lead & 0x1Fu;
+        }
+        else if (lead >= 0xE0u && lead <= 0xEFu) {
+            len = 3u;
+            cp = lead & 0x0Fu;
+        }
+        else if (lead >= 0xF0u && lead <= 0xF4u) {
+            len = 4u;
+            cp = lead & 0x07u;
+        }
+        else {
+            return 0u;
+        }
+        if (size_t(end - it) < len) {
+            return 0u;
+        }
+        for (size_t i = 1; i < len; ++i) {
+            if ((it[i] & 0xC0u) != 0x80u) {
+                return 0u;
+            }
+            cp = (cp << 6) | (it[i] & 0x3Fu);
+        }
+        const uint32_t min_cp = len == 2u ? 0x80u : len == 3u ? 0x800u : 0x10000u;
+        if (cp < min_cp || cp > 0x10FFFFu || (cp >= 0xD800u && cp <= 0xDFFFu)) {
+            return 0u;
+        }
+        return len;
+    }
+} // namespace
+
+JsonWriter::JsonWriter(std::ostream& out, bool compact)
+    : m_out(out), m_after_key(false), m_compact(compact)
+{
+}
+
+void JsonWriter::newline()
+{
+    if (this->m_compact) {
+        return;
+    }
+    this->m_out << '\n' << std::string(this->m_first.size() * 2u, ' ');
+}
+
+void JsonWriter::separate()
+{
+    if (this->m_after_key) {
+        this->m_after_key = false;
+        return;
+    }
+    if (this->m_first.empty()) {
+        return;
+    }
+    if (!this->m_first.back()) {
+        this->m_out << ',';
+    }
+    this->m_first.back() = false;
+    this->newline();
+}
+
+JsonWriter& JsonWriter::begin_object()
+{
+    this->separate();
+    this->m_out << '{';
+    this->m_first.push_back(true);
+    return *this;
+}
+
+JsonWriter& JsonWriter::end_object()
+{
+    bool empty = this->m_first.back();
+    this->m_first.pop_back();
+    if (!empty) {
+        this->newline();
+    }
+    this->m_out << '}';
+    if (this->m_first.empty()) {
+        this->m_out << '\n';
+    }
+    return *this;
+}
+
+JsonWriter& JsonWriter::begin_array()
+{
+    this->separate();
+    this->m_out << '[';
+    this->m_first.push_back(true);
+    return *this;
+}
+
+JsonWriter& JsonWriter::end_array()
+{
+    bool empty = this->m_first.back();
+    this->m_first.pop_back();
+    if (!empty) {
+        this->newline();
+    }
+    this->m_out << ']';
+    return *this;
+}
+
+JsonWriter& JsonWriter::key(const std::string& name)
+{
+    this->value(name);
+    this->m_out << (this->m_compact ? ":" : ": ");
+    this->m_after_key = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(const std::string& str)
+{
+    this->separate();
+    this->m_out << '"';
+    const unsigned char * it = reinterpret_cast<const unsigned char *>(str.data());
+    const unsigned char * end = it + str.size();
+    while (it != end) {
+        const unsigned char ch = *it;
+        if (ch >= 0x80u) {
+            size_t len = ::utf8_len(it, end);
+            if (len) {
+                this->m_out.write(reinterpret_cast<const char *>(it), len);
+                it += len;
+            }
+            else {
+                this->m_out << "\\ufffd";
+                ++it;
+            }
+            continue;
+        }
+        ++it;
+        switch (ch) {
+        case '"':  this->m_out << "\\\""; break;
+        case '\\': this->m_out << "\\\\"; break;
+        case '\n': this->m_out << "\\n";  break;
+        case '\t': this->m_out << "\\t";  break;
+        default:
+            if (ch < 0x20u) {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", ch);
+                this->m_out << buf;
+            }
+            else {
+                this->m_out << char(ch);
+            }
+        }
+    }
+    this->m_out << '"';
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(const char * str)
+{
+    return this->value(std::string(str));
+}
+
+JsonWriter& JsonWriter::value(double num)
+{
+    if (!std::isfinite(num)) {
+        return this->null();
+    }
+    this->separate();
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.6g", num);
+    this->m_out << buf;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(uint64_t num)
+{
+    this->separate();
+    this->m_out << num;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(int64_t num)
+{
+    this->separate();
+    this->m_out << num;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(bool flag)
+{
+    this->separate();
+    this->m_out << (flag ? "true" : "false");
+    return *this;
+}
+
+JsonWriter& JsonWriter::null()
+{
+    this->separate();
+    this->m_out << "null";
+    return *this;
+}
+
+JsonWriter& JsonWriter::hex(const std::string& bytes)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string text;
+    text.reserve(bytes.size() * 2u);
+    for (unsigned char ch : bytes) {
+        text += digits[ch >> 4];
+        text += digits[ch & 0x0Fu];
+    }
+    return this->value(text);
+}
+
+JsonWriter& JsonWriter::path(const std::string& name, const std::string& path)
+{
+    this->key(name).value(path);
+    if (!JsonWriter::is_utf8(path)) {
+        this->key(name + "_hex").hex(path);
+    }
+    return *this;
+}
+
+bool JsonWriter::is_utf8(const std::string& str)
+{
+    const unsigned char * it = reinterpret_cast<const unsigned char *>(str.data());
+    const unsigned char * end = it + str.size();
+    while (it != end) {
+        size_t len = ::utf8_len(it, end);
+        if (!len) {
+            return false;
+        }
+        it += len;
+    }
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef __JSONWRITER_HPP_1468210387__
+#define __JSONWRITER_HPP_1468210387__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+
+/**
+ * @brief 只够用的 JSON 输出：自动处理逗号与缩进，字符串按 JSON 转义；
+ *        compact 时不换行、不缩进，每个顶层对象占一行（JSON lines）；
+ *        输出总是合法的 JSON：字符串中不合法的 UTF-8 字节，逐个写作 U+FFFD；
+ *        NaN、无穷大写作 null
+ */
+class JsonWriter
+{
+public:
+    explicit JsonWriter(std::ostream& out, bool compact = false);
+
+public:
+    JsonWriter& begin_object();
+    JsonWriter& end_object();
+    JsonWriter& begin_array();
+    JsonWriter& end_array();
+    JsonWriter& key(const std::string& name);
+    JsonWriter& value(const std::string& str);
+    JsonWriter& value(const char * str);
+    JsonWriter& value(double num);
+    JsonWriter& value(uint64_t num);
+    JsonWriter& value(int64_t num);
+    JsonWriter& value(bool flag);
+    JsonWriter& null();
+    /**
+     * @brief 任意字节串，以十六进制字符串给出（不必是合法的 UTF-8）
+     */
+    JsonWriter& hex(const std::string& bytes);
+    /**
+     * @brief 文件路径：写出 name 与 path；path 不是合法的 UTF-8 时（比如 GBK
+     *        的文件名），另外写出 <name>_hex，给出原样的字节
+     */
+    JsonWriter& path(const std::string& name, const std::string& path);
+
+    /**
+     * @brief 是否为合法的 UTF-8（拒绝过长编码、代理区码位与超出 U+10FFFF 的）
+     */
+    static bool is_utf8(const std::string& str);
+
+private:
+    void separate();
+    void newline();
+
+private:
+    std::ostream&       m_out;
+    std::vector<bool>   m_first;    // 每层嵌套，是否还没有元素
+    bool                m_after_key;
+    bool                m_compact;
+};
+
+
+#endif /* __JSONWRITER_HPP_1468210387__ */
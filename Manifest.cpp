@@ -0,0 +1,221 @@
+#include "Manifest.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <sss/util/PostionThrow.hpp>
+
+#include "RuleCache.hpp"
+
+namespace  {
+    const char * manifest_magic = "bse-manifest";
+
+    int64_t mtime_ns(const struct stat& st)
+    {
+        return int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    }
+
+    // NOTE 同一文件的不同写法，记作同一项；解析失败返回空串
+    std::string real_path(const std::string& path)
+    {
+        std::unique_ptr<char, decltype(&std::free)> real(::realpath(path.c_str(), nullptr), &std::free);
+        return real ? std::string(real.get()) : std::string();
+    }
+
+    bool is_recordable(const std::string& path)
+    {
+        return path.find_first_of("\t\n") == std::string::npos;
+    }
+} // namespace
+
+Manifest::Manifest(const std::string& path, uint64_t fingerprint)
+    : m_path(path), m_fingerprint(fingerprint)
+{
+    std::ifstream ifs(path, std::ios_base::in | std::ios_base::binary);
+    std::string line;
+    if (!ifs.good() || !std::getline(ifs, line)) {
+        return;
+    }
+    std::istringstream header(line);
+    std::string magic;
+    int file_version = 0;
+    if (!(header >> magic >> file_version) || magic != manifest_magic || file_version != version) {
+        return;
+    }
+    // NOTE 清单只是加速手段：格式不对的行丢弃，相当于该文件须重新处理
+    while (std::getline(ifs, line)) {
+        std::string::size_type tab1 = line.find('\t');
+        std::string::size_type tab2 = tab1 == std::string::npos ? tab1 : line.find('\t', tab1 + 1);
+        if (tab2 == std::string::npos) {
+            continue;
+        }
+        std::istringstream fields(line.substr(0, tab1));
+        Entry entry;
+        if (!(fields >> std::hex >> entry.m_fingerprint >> std::dec >> entry.m_mode
+              >> entry.m_size >> entry.m_mtime_ns >> entry.m_ino
+              >> entry.m_out_size >> entry.m_out_mtime_ns))
+        {
+            continue;
+        }
+        entry.m_out = line.substr(tab2 + 1);
+        this->m_entries[line.substr(tab1 + 1, tab2 - tab1 - 1)] = entry;
+    }
+}
+
+bool Manifest::check(const std::string& src, const std::string& out, bool replace, bool allow_noop) const
+{
+    const std::string key = ::real_path(src);
+    struct stat st;
+    if (key.empty() || ::stat(key.c_str(), &st) != 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    auto it = this->m_entries.find(key);
+    if (it == this->m_entries.end()) {
+        return false;
+    }
+    const Entry& entry = it->second;
+    if (entry.m_fingerprint != this->m_fingerprint ||
+        entry.m_size != uint64_t(st.st_size) || entry.m_mtime_ns != ::mtime_ns(st) ||
+        entry.m_ino != uint64_t(st.st_ino))
+    {
+        return false;
+    }
+    switch (entry.m_mode) {
+    case M_REPLACE:
+        return replace;
+
+    case M_NOOP:
+        return !replace && allow_noop && entry.m_out == out;
+
+    case M_OUTPUT:
+        {
+            struct stat out_st;
+            return !replace && entry.m_out == out && ::stat(out.c_str(), &out_st) == 0 &&
+                entry.m_out_size == uint64_t(out_st.st_size) && entry.m_out_mtime_ns == ::mtime_ns(out_st);
+        }
+
+    default:
+        return false;
+    }
+}
+
+void Manifest::record(const std::string& src, const std::string& out, Mode mode)
+{
+    const std::string key = ::real_path(src);
+    if (key.empty() || !::is_recordable(key) || !::is_recordable(out)) {
+        return;
+    }
+    Entry entry;
+    entry.m_fingerprint = this->m_fingerprint;
+    entry.m_mode = mode;
+    entry.m_out = mode == M_REPLACE ? std::string() : out;
+    entry.m_out_size = 0u;
+    entry.m_out_mtime_ns = 0;
+    struct stat st;
+    struct stat out_st;
+    bool is_ok = ::stat(key.c_str(), &st) == 0 &&
+        (mode != M_OUTPUT || ::stat(out.c_str(), &out_st) == 0);
+    if (is_ok) {
+        entry.m_size = st.st_size;
+        entry.m_mtime_ns = ::mtime_ns(st);
+        entry.m_ino = st.st_ino;
+        if (mode == M_OUTPUT) {
+            entry.m_out_size = out_st.st_size;
+            entry.m_out_mtime_ns = ::mtime_ns(out_st);
+        }
+    }
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    if (is_ok) {
+        this->m_entries[key] = entry;
+    }
+    else {
+        this->m_entries.erase(key);
+    }
+}
+
+void Manifest::save() const
+{
+    std::string tmp_path = this->m_path + ".tmp." + std::to_string(::getpid());
+    {
+        std::ofstream ofs(tmp_path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+        if (!ofs.good()) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              "unable to open file `" << tmp_path << "` to write");
+        }
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        ofs << manifest_magic << " " << int(version) << "\n";
+        char buf[160];
+        for (const auto& item : this->m_entries) {
+            const Entry& entry = item.second;
+            std::snprintf(buf, sizeof(buf), "%016llx %c %llu %lld %llu %llu %lld\t",
+                          static_cast<unsigned long long>(entry.m_fingerprint), entry.m_mode,
+                          static_cast<unsigned long long>(entry.m_size),
+                          static_cast<long long>(entry.m_mtime_ns),
+                          static_cast<unsigned long long>(entry.m_ino),
+                          static_cast<unsigned long long>(entry.m_out_size),
+                          static_cast<long long>(entry.m_out_mtime_ns));
+            ofs << buf << item.first << "\t" << entry.m_out << "\n";
+        }
+        ofs.close();
+        if (!ofs.good()) {
+            ::unlink(tmp_path.c_str());
+            SSS_POSTION_THROW(std::runtime_error,
+                              "write `" << tmp_path << "` failed");
+        }
+    }
+    if (::rename(tmp_path.c_str(), this->m_path.c_str()) != 0) {
+        int err = errno;
+        ::unlink(tmp_path.c_str());
+        SSS_POSTION_THROW(std::runtime_error,
+                          "rename `" << tmp_path << "` to `" << this->m_path << "` failed: " << std::strerror(err));
+    }
+}
+
+// NOTE 只 hash 规则本身：各终态的键、动作（替换串，或回调的下标）逐条 hash，
+// 按键排序后再 hash 这些 hash；与状态的编号、后端都无关，--train 重排状态之后
+// 清单依然有效
+uint64_t Manifest::fingerprint(const SequenceSM& sm)
+{
+    const SequenceSM::Table& table = sm.table();
+    const std::vector<std::string> keys = sm.terminal_keys();
+    std::vector<uint32_t> terminals;
+    for (uint32_t st = 1; st < keys.size(); ++st) {
+        if (table.m_flags[st] & SequenceSM::F_TERMINAL) {
+            terminals.push_back(st);
+        }
+    }
+    std::sort(terminals.begin(), terminals.end(), [&keys](uint32_t lhs, uint32_t rhs) {
+        return keys[lhs] < keys[rhs];
+    });
+    std::vector<uint64_t> parts;
+    parts.reserve(terminals.size());
+    std::string rule;
+    for (uint32_t st : terminals) {
+        const uint32_t off = table.m_value[st * 2u];
+        const uint32_t len = table.m_value[st * 2u + 1u];
+        const bool callback = table.m_flags[st] & SequenceSM::F_CALLBACK;
+        const uint32_t key_len = keys[st].size();
+        rule.assign(reinterpret_cast<const char *>(&key_len), sizeof(key_len));
+        rule += keys[st];
+        rule += char(callback);
+        if (callback) {
+            rule.append(reinterpret_cast<const char *>(&off), sizeof(off));
+        }
+        else {
+            rule.append(table.m_pool + off, len);
+        }
+        parts.push_back(RuleCache::hash(rule.data(), rule.size()));
+    }
+    return RuleCache::hash(reinterpret_cast<const char *>(parts.data()), parts.size() * sizeof(uint64_t));
+}
@@ -0,0 +1,82 @@
+#ifndef __MANIFEST_HPP_1468429108__
+#define __MANIFEST_HPP_1468429108__
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "SequenceSM.hpp"
+
+/**
+ * @brief 增量处理的清单：记录每个文件上次处理完时的状态（大小、mtime、
+ *        inode），以及所用规则集的指纹；再次运行时，状态与规则集都没变的文件
+ *        直接跳过；
+ *
+ *  文本格式，一行一个文件：
+ *      bse-manifest 1
+ *      <指纹> <方式> <size> <mtime_ns> <ino> <out_size> <out_mtime_ns>\t<源文件>\t<输出文件>
+ *  方式：r 原地替换（记录的是替换后的状态），t 写出到输出文件，n 因为没有匹配
+ *  而没有写输出文件；源文件为绝对路径；路径中含有制表符或换行的文件不记录；
+ *
+ *  判断"没变"只看元数据：mtime 粒度粗的文件系统上，同一时刻内、大小不变的修
+ *  改看不出来——与 make 的假设相同；
+ *
+ *  check()/record() 可以在多个线程中调用；save() 先写临时文件再 rename。
+ */
+class Manifest
+{
+public:
+    /**
+     * @brief 读入 path 处的清单；不存在或格式不符时，从空清单开始
+     */
+    Manifest(const std::string& path, uint64_t fingerprint);
+
+public:
+    enum Mode { M_REPLACE = 'r', M_OUTPUT = 't', M_NOOP = 'n' };
+
+    /**
+     * @brief src 自上次记录以来没有变化，且上次是以同一规则集、同一方式处理的；
+     *        M_OUTPUT 还要求输出文件也还是当时的样子；
+     *        allow_noop 为假时，M_NOOP 的记录不算数（须补写输出文件）
+     */
+    bool check(const std::string& src, const std::string& out, bool replace, bool allow_noop) const;
+
+    /**
+     * @brief 记录 src（以及 out）当前的状态；stat 失败则删去该项
+     */
+    void record(const std::string& src, const std::string& out, Mode mode);
+
+    void save() const;
+
+    /**
+     * @brief 已编译规则集的指纹：各条规则的键与动作按键排序后一起 hash，与状态
+     *        编号、后端无关（--train 之后不变）；内置规则集与映射自缓存的规则集
+     *        同样适用
+     */
+    static uint64_t fingerprint(const SequenceSM& sm);
+
+public:
+    enum { version = 1 };
+
+private:
+    struct Entry
+    {
+        uint64_t    m_fingerprint;
+        char        m_mode;
+        uint64_t    m_size;
+        int64_t     m_mtime_ns;
+        uint64_t    m_ino;
+        uint64_t    m_out_size;
+        int64_t     m_out_mtime_ns;
+        std::string m_out;
+    };
+
+    std::string                     m_path;
+    uint64_t                        m_fingerprint;
+    std::map<std::string, Entry>    m_entries;
+    mutable std::mutex              m_mutex;
+};
+
+
+#endif /* __MANIFEST_HPP_1468429108__ */
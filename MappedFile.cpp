@@ -0,0 +1,84 @@
+#include "MappedFile.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <sss/util/PostionThrow.hpp>
+
+MappedFile::MappedFile()
+    : m_data(nullptr), m_size(0u)
+{
+}
+
+MappedFile::MappedFile(const std::string& path)
+    : m_data(nullptr), m_size(0u)
+{
+    this->open(path);
+}
+
+MappedFile::~MappedFile()
+{
+    this->close();
+}
+
+MappedFile::MappedFile(MappedFile&& ref)
+    : m_data(ref.m_data), m_size(ref.m_size)
+{
+    ref.m_data = nullptr;
+    ref.m_size = 0u;
+}
+
+MappedFile& MappedFile::operator = (MappedFile&& ref)
+{
+    if (this != &ref) {
+        this->close();
+        std::swap(this->m_data, ref.m_data);
+        std::swap(this->m_size, ref.m_size);
+    }
+    return *this;
+}
+
+void MappedFile::open(const std::string& path, bool sequential)
+{
+    this->close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "unable to open file `" << path << "` to read");
+    }
+    struct stat st;
+    if (::fstat(fd, &st) == -1) {
+        ::close(fd);
+        SSS_POSTION_THROW(std::runtime_error,
+                          "unable to stat file `" << path << "`");
+    }
+    if (st.st_size > 0) {
+        void * addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            SSS_POSTION_THROW(std::runtime_error,
+                              "unable to mmap file `" << path << "`");
+        }
+        if (sequential) {
+            ::madvise(addr, st.st_size, MADV_SEQUENTIAL);
+        }
+        this->m_data = static_cast<const char *>(addr);
+        this->m_size = st.st_size;
+    }
+    // NOTE 映射建立之后，fd 就不再需要了
+    ::close(fd);
+}
+
+void MappedFile::close()
+{
+    if (this->m_data) {
+        ::munmap(const_cast<char *>(this->m_data), this->m_size);
+        this->m_data = nullptr;
+        this->m_size = 0u;
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef __MAPPEDFILE_HPP_1467900312__
+#define __MAPPEDFILE_HPP_1467900312__
+
+#include <cstdlib>
+#include <string>
+
+/**
+ * @brief 只读方式，把整个文件映射进内存；
+ *        空文件不映射，data() 返回 nullptr，size() 为 0；
+ */
+class MappedFile
+{
+public:
+    MappedFile();
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+public:
+    MappedFile(MappedFile&& ref);
+    MappedFile& operator = (MappedFile&& ref);
+
+public:
+    MappedFile(const MappedFile& ) = delete;
+    MappedFile& operator = (const MappedFile& ) = delete;
+
+public:
+    /**
+     * @param sequential 是否提示内核顺序读取（预读）；随机访问的数据（如跳转
+     *                   表）应传 false
+     */
+    void open(const std::string& path, bool sequential = true);
+    void close();
+
+    const char * data() const
+    {
+        return this->m_data;
+    }
+    size_t size() const
+    {
+        return this->m_size;
+    }
+
+private:
+    const char *    m_data;
+    size_t          m_size;
+};
+
+
+#endif /* __MAPPEDFILE_HPP_1467900312__ */
@@ -0,0 +1,233 @@
+#include "PipelineTranslator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "SpscQueue.hpp"
+
+namespace  {
+    struct Block
+    {
+        std::unique_ptr<char[]> m_data;
+        size_t                  m_len = 0u;
+        bool                    m_last = false;     // 流的最后一块（可以为空）
+    };
+
+    typedef SpscQueue<Block *> BlockQueue;
+
+    // NOTE 别的线程已经出错，本线程只需退出；真正的异常在 Pipeline::m_error
+    struct Cancelled
+    {
+    };
+
+    /**
+     * @brief 三个线程共享的状态：四个队列，以及第一个出错线程的异常
+     */
+    struct Pipeline
+    {
+        explicit Pipeline(size_t block_cnt, size_t block_size)
+            : m_in_blocks(block_cnt), m_out_blocks(block_cnt),
+              m_in_full(block_cnt), m_in_free(block_cnt),
+              m_out_full(block_cnt), m_out_free(block_cnt),
+              m_cancel(false)
+        {
+            for (size_t i = 0; i < block_cnt; ++i) {
+                this->m_in_blocks[i].m_data.reset(new char[block_size]);
+                this->m_out_blocks[i].m_data.reset(new char[block_size]);
+                this->m_in_free.push(&this->m_in_blocks[i]);
+                this->m_out_free.push(&this->m_out_blocks[i]);
+            }
+        }
+
+        void fail(std::exception_ptr error)
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            if (!this->m_error) {
+                this->m_error = error;
+            }
+            this->m_cancel = true;
+        }
+
+        std::vector<Block>  m_in_blocks;
+        std::vector<Block>  m_out_blocks;
+        BlockQueue          m_in_full;      // 解压 -> 翻译
+        BlockQueue          m_in_free;      // 翻译 -> 解压，还回的空块
+        BlockQueue          m_out_full;     // 翻译 -> 压缩
+        BlockQueue          m_out_free;     // 压缩 -> 翻译，还回的空块
+        std::atomic<bool>   m_cancel;
+        std::mutex          m_mutex;
+        std::exception_ptr  m_error;
+    };
+
+    /**
+     * @brief 翻译线程的输出端：复制到输出块中，写满一块就交给压缩线程；
+     *        输入块在 feed() 之后就还回去了，所以 write_ref() 也须复制
+     */
+    class BlockSink : public SequenceSM::Sink
+    {
+    public:
+        BlockSink(Pipeline& pipeline, size_t block_size)
+            : m_pipeline(pipeline), m_block_size(block_size), m_block(nullptr),
+              m_size(0u), m_wait_s(0.0)
+        {}
+
+        void write(const char * data, size_t len) override
+        {
+            while (len) {
+                if (!this->m_block) {
+                    this->acquire();
+                }
+                size_t n = std::min(len, this->m_block_size - this->m_block->m_len);
+                std::memcpy(this->m_block->m_data.get() + this->m_block->m_len, data, n);
+                this->m_block->m_len += n;
+                this->m_size += n;
+                data += n;
+                len -= n;
+                if (this->m_block->m_len == this->m_block_size) {
+                    this->release(false);
+                }
+            }
+        }
+
+        // NOTE 最后一块即使为空也要送出：压缩线程见到它才写流的结尾
+        void finish()
+        {
+            if (!this->m_block) {
+                this->acquire();
+            }
+            this->release(true);
+        }
+
+        uint64_t size() const
+        {
+            return this->m_size;
+        }
+
+        double wait_seconds() const
+        {
+            return this->m_wait_s;
+        }
+
+    private:
+        void acquire()
+        {
+            StopWatch watch;
+            if (!this->m_pipeline.m_out_free.wait_pop(this->m_block, this->m_pipeline.m_cancel)) {
+                throw ::Cancelled();
+            }
+            this->m_wait_s += watch.seconds();
+            this->m_block->m_len = 0u;
+            this->m_block->m_last = false;
+        }
+
+        void release(bool last)
+        {
+            this->m_block->m_last = last;
+            if (!this->m_pipeline.m_out_full.wait_push(this->m_block, this->m_pipeline.m_cancel)) {
+                throw ::Cancelled();
+            }
+            this->m_block = nullptr;
+        }
+
+    private:
+        Pipeline &  m_pipeline;
+        size_t      m_block_size;
+        Block *     m_block;
+        uint64_t    m_size;
+        double      m_wait_s;
+    };
+
+    // NOTE Decoder::read() 总是尽量读满；不满一块，就是到了结尾
+    void read_loop(Pipeline& pipeline, compression::Decoder& in, size_t block_size)
+    {
+        Block * block = nullptr;
+        while (pipeline.m_in_free.wait_pop(block, pipeline.m_cancel)) {
+            block->m_len = in.read(block->m_data.get(), block_size);
+            block->m_last = block->m_len < block_size;
+            if (!pipeline.m_in_full.wait_push(block, pipeline.m_cancel) || block->m_last) {
+                break;
+            }
+        }
+    }
+
+    void write_loop(Pipeline& pipeline, compression::Encoder& out)
+    {
+        Block * block = nullptr;
+        while (pipeline.m_out_full.wait_pop(block, pipeline.m_cancel)) {
+            out.write(block->m_data.get(), block->m_len);
+            const bool last = block->m_last;
+            if (last) {
+                out.finish();
+                break;
+            }
+            if (!pipeline.m_out_free.wait_push(block, pipeline.m_cancel)) {
+                break;
+            }
+        }
+    }
+} // namespace
+
+void PipelineTranslator::translate(compression::Decoder& in, compression::Encoder& out, FileStats * stats) const
+{
+    StopWatch watch;
+    ::Pipeline pipeline(buffer_cnt, buffer_size);
+    auto guard = [&pipeline](const std::function<void()>& work) {
+        try {
+            work();
+        }
+        catch (...) {
+            pipeline.fail(std::current_exception());
+        }
+    };
+    std::thread reader(guard, [&pipeline, &in]() { ::read_loop(pipeline, in, buffer_size); });
+    std::thread writer(guard, [&pipeline, &out]() { ::write_loop(pipeline, out); });
+
+    SequenceSM::Matcher matcher(this->m_sm);
+    if (stats) {
+        stats->m_match = SequenceSM::MatchStats(this->m_sm.table().m_state_cnt);
+        matcher.set_stats(&stats->m_match);
+    }
+    ::BlockSink sink(pipeline, buffer_size);
+    uint64_t bytes_in = 0u;
+    try {
+        ::Block * block = nullptr;
+        while (true) {
+            if (!pipeline.m_in_full.wait_pop(block, pipeline.m_cancel)) {
+                throw ::Cancelled();
+            }
+            matcher.feed(block->m_data.get(), block->m_len, sink);
+            bytes_in += block->m_len;
+            const bool last = block->m_last;
+            // NOTE 空块数与队列容量相同，不会满
+            pipeline.m_in_free.push(block);
+            if (last) {
+                break;
+            }
+        }
+        matcher.finish(sink);
+        sink.finish();
+    }
+    catch (const ::Cancelled& ) {
+    }
+    catch (...) {
+        pipeline.fail(std::current_exception());
+    }
+    reader.join();
+    writer.join();
+    if (pipeline.m_error) {
+        std::rethrow_exception(pipeline.m_error);
+    }
+    if (stats) {
+        stats->m_bytes_in = bytes_in;
+        stats->m_bytes_out = sink.size();
+        stats->m_write_s = sink.wait_seconds();
+        stats->m_translate_s = watch.seconds();
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef __PIPELINETRANSLATOR_HPP_1468547790__
+#define __PIPELINETRANSLATOR_HPP_1468547790__
+
+#include <cstdlib>
+
+#include "SequenceSM.hpp"
+#include "Compression.hpp"
+#include "RunStats.hpp"
+
+/**
+ * @brief 压缩输入/输出时的流水线翻译；
+ *
+ *  解压、翻译、压缩各占一个线程（翻译在调用者的线程中），之间用两个
+ *  SpscQueue 传递数据块；用完的块经由反向的队列还回去重复使用，所以内存占用
+ *  固定为 2 * buffer_cnt 块，与文件大小无关；
+ *
+ *  解码器/编码器的格式可以是 compression::C_NONE——只有一端压缩时，另一端就是
+ *  普通的 read/write；任何一个线程出错，其余线程随即停下，异常在 translate()
+ *  中重新抛出；
+ */
+class PipelineTranslator
+{
+public:
+    explicit PipelineTranslator(const SequenceSM& sm)
+        : m_sm(sm)
+    {}
+
+public:
+    /**
+     * @brief 从 in 读到结束，翻译后写入 out，并调用 out.finish()；
+     *        stats 非空时，m_bytes_in/m_bytes_out 为解压后、压缩前的字节数，
+     *        m_write_s 为翻译线程等待空闲输出块（即等压缩与写出）的时间；
+     */
+    void translate(compression::Decoder& in, compression::Encoder& out, FileStats * stats = nullptr) const;
+
+public:
+    enum { buffer_size = 256 * 1024 };
+    enum { buffer_cnt = 4 };
+
+private:
+    const SequenceSM & m_sm;
+};
+
+
+#endif /* __PIPELINETRANSLATOR_HPP_1468547790__ */
@@ -0,0 +1,203 @@
+#include "RuleCache.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include <sss/path.hpp>
+#include <sss/util/PostionThrow.hpp>
+
+#include "MappedFile.hpp"
+
+namespace  {
+    const char cache_magic[8] = {'B', 'S', 'E', 'R', 'U', 'L', 'E', '\0'};
+    const uint32_t endian_mark = 0x01020304u;
+
+    struct Header
+    {
+        char        m_magic[8];
+        uint32_t    m_version;
+        uint32_t    m_endian;
+        uint64_t    m_source_hash;
+        uint64_t    m_file_size;
+        uint32_t    m_state_cnt;
+        uint32_t    m_max_jump_cnt;
+        uint32_t    m_class_cnt;
+        uint32_t    m_trained;      // 旧版本此处恒为 0
+        uint64_t    m_classes_off;
+        uint64_t    m_next_off;
+        uint64_t    m_depth_off;
+        uint64_t    m_flags_off;
+        uint64_t    m_value_off;
+        uint64_t    m_pool_off;
+        uint64_t    m_pool_size;
+    };
+
+    uint64_t align_up(uint64_t off)
+    {
+        return (off + 63u) & ~uint64_t(63u);
+    }
+
+    // NOTE 顺序写入；off 之前的空隙补零
+    void write_at(std::ostream& o, uint64_t off, const void * data, uint64_t len)
+    {
+        static const char zeros[64] = {0};
+        uint64_t pos = o.tellp();
+        if (off > pos) {
+            o.write(zeros, off - pos);
+        }
+        o.write(static_cast<const char *>(data), len);
+    }
+
+    bool in_range(const Header& h, uint64_t off, uint64_t len)
+    {
+        return off % 4u == 0 && off <= h.m_file_size && len <= h.m_file_size - off;
+    }
+} // namespace 
+
+std::string RuleCache::cache_path(const std::string& rule_path)
+{
+    const char * dir = std::getenv("BSE_CACHE_DIR");
+    if (dir && *dir) {
+        // NOTE 不同目录下的同名规则文件，以绝对路径的 hash 区分
+        char tag[32];
+        std::snprintf(tag, sizeof(tag), ".%016llx",
+                      static_cast<unsigned long long>(hash(rule_path.data(), rule_path.size())));
+        return sss::path::append_copy(dir, sss::path::basename(rule_path) + tag + ".bin");
+    }
+    return rule_path + ".bin";
+}
+
+uint64_t RuleCache::hash(const char * data, size_t len)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= uint8_t(data[i]);
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+bool RuleCache::load(const std::string& cache_path, uint64_t source_hash, SequenceSM& sm)
+{
+    if (!sss::path::filereadable(cache_path)) {
+        return false;
+    }
+    std::shared_ptr<MappedFile> image = std::make_shared<MappedFile>();
+    image->open(cache_path, false);
+    if (image->size() < sizeof(Header)) {
+        return false;
+    }
+    Header h;
+    std::memcpy(&h, image->data(), sizeof(h));
+    const uint64_t cnt = h.m_state_cnt;
+    if (std::memcmp(h.m_magic, cache_magic, sizeof(cache_magic)) != 0 ||
+        h.m_version != version || h.m_endian != endian_mark ||
+        h.m_source_hash != source_hash || h.m_file_size != image->size() ||
+        !cnt || !h.m_class_cnt || h.m_class_cnt > 256u ||
+        !in_range(h, h.m_classes_off, 256u) ||
+        !in_range(h, h.m_next_off, cnt * h.m_class_cnt * sizeof(uint32_t)) ||
+        !in_range(h, h.m_depth_off, cnt * sizeof(uint32_t)) ||
+        !in_range(h, h.m_flags_off, cnt) ||
+        !in_range(h, h.m_value_off, cnt * 2u * sizeof(uint32_t)) ||
+        !in_range(h, h.m_pool_off, h.m_pool_size))
+    {
+        return false;
+    }
+    // NOTE 只校验结构；表项内容，由源文件 hash 与原子写入保证——类号除外：
+    // 它决定了跳转表的下标，越界就是越界访问
+    const char * base = image->data();
+    const uint8_t * classes = reinterpret_cast<const uint8_t *>(base + h.m_classes_off);
+    for (size_t c = 0; c < 256u; ++c) {
+        if (classes[c] >= h.m_class_cnt || (h.m_class_cnt == 256u && classes[c] != c)) {
+            return false;
+        }
+    }
+    SequenceSM::Table table;
+    table.m_state_cnt = h.m_state_cnt;
+    table.m_max_jump_cnt = h.m_max_jump_cnt;
+    table.m_class_cnt = h.m_class_cnt;
+    table.m_classes = classes;
+    table.m_next = reinterpret_cast<const uint32_t *>(base + h.m_next_off);
+    table.m_depth = reinterpret_cast<const uint32_t *>(base + h.m_depth_off);
+    table.m_flags = reinterpret_cast<const uint8_t *>(base + h.m_flags_off);
+    table.m_value = reinterpret_cast<const uint32_t *>(base + h.m_value_off);
+    table.m_pool = base + h.m_pool_off;
+    table.m_pool_size = h.m_pool_size;
+    table.m_backend = SequenceSM::B_DENSE;
+    table.m_base = nullptr;
+    table.m_check = nullptr;
+    table.m_fail = nullptr;
+    table.m_trained = h.m_trained;
+    sm.adopt(table, image);
+    return true;
+}
+
+void RuleCache::save(const std::string& cache_path, uint64_t source_hash, const SequenceSM& sm)
+{
+    const SequenceSM::Table& table = sm.table();
+    const uint64_t cnt = table.m_state_cnt;
+    if (table.m_backend != SequenceSM::B_DENSE) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "only dense tables can be cached");
+    }
+    for (uint64_t i = 0; i < cnt; ++i) {
+        if (table.m_flags[i] & SequenceSM::F_CALLBACK) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              "rule set with callback actions cannot be cached");
+        }
+    }
+
+    Header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.m_magic, cache_magic, sizeof(cache_magic));
+    h.m_version = version;
+    h.m_endian = endian_mark;
+    h.m_source_hash = source_hash;
+    h.m_state_cnt = table.m_state_cnt;
+    h.m_max_jump_cnt = table.m_max_jump_cnt;
+    h.m_class_cnt = table.m_class_cnt;
+    h.m_trained = table.m_trained;
+    h.m_classes_off = align_up(sizeof(Header));
+    h.m_next_off = align_up(h.m_classes_off + 256u);
+    h.m_depth_off = align_up(h.m_next_off + cnt * table.m_class_cnt * sizeof(uint32_t));
+    h.m_flags_off = align_up(h.m_depth_off + cnt * sizeof(uint32_t));
+    h.m_value_off = align_up(h.m_flags_off + cnt);
+    h.m_pool_off = align_up(h.m_value_off + cnt * 2u * sizeof(uint32_t));
+    h.m_pool_size = table.m_pool_size;
+    h.m_file_size = h.m_pool_off + h.m_pool_size;
+
+    std::string tmp_path = cache_path + ".tmp." + std::to_string(::getpid());
+    {
+        std::ofstream ofs(tmp_path, std::ios_base::out | std::ios_base::binary);
+        if (!ofs.good()) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              "unable to open file `" << tmp_path << "` to write");
+        }
+        ::write_at(ofs, 0u, &h, sizeof(h));
+        ::write_at(ofs, h.m_classes_off, table.m_classes, 256u);
+        ::write_at(ofs, h.m_next_off, table.m_next, cnt * table.m_class_cnt * sizeof(uint32_t));
+        ::write_at(ofs, h.m_depth_off, table.m_depth, cnt * sizeof(uint32_t));
+        ::write_at(ofs, h.m_flags_off, table.m_flags, cnt);
+        ::write_at(ofs, h.m_value_off, table.m_value, cnt * 2u * sizeof(uint32_t));
+        ::write_at(ofs, h.m_pool_off, table.m_pool, h.m_pool_size);
+        if (!ofs.good()) {
+            ofs.close();
+            std::remove(tmp_path.c_str());
+            SSS_POSTION_THROW(std::runtime_error,
+                              "unable to write file `" << tmp_path << "`");
+        }
+    }
+    if (std::rename(tmp_path.c_str(), cache_path.c_str()) != 0) {
+        int err = errno;
+        std::remove(tmp_path.c_str());
+        SSS_POSTION_THROW(std::runtime_error,
+                          "unable to rename `" << tmp_path << "` to `" << cache_path << "`: "
+                          << std::strerror(err));
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef __RULECACHE_HPP_1468203377__
+#define __RULECACHE_HPP_1468203377__
+
+#include <cstdint>
+#include <string>
+
+#include "SequenceSM.hpp"
+
+/**
+ * @brief 已编译规则的二进制缓存(.rule.bin)；
+ *
+ *  文件内容与地址无关：版本化的文件头，规则源文件的 hash，之后是跳转表等各数
+ *  组，以及替换串池；各部分以相对文件头的偏移定位，按 64 字节对齐；
+ *
+ *  读取时整个文件只读映射，SequenceSM 直接使用映射区，无需解析与建表——多个
+ *  进程同时使用同一缓存时，共享同一份 page cache；
+ *
+ *  写入时先写临时文件，再 rename，所以并发的进程，只会看到完整的缓存文件。
+ */
+class RuleCache
+{
+public:
+    // NOTE 2: 增加 F_PREFIX（最长匹配）
+    //      3: 字节等价类；跳转表按 m_class_cnt 列存放
+    //      （训练过的状态编号，记在原来的保留字段里；旧文件该字段为 0）
+    //      4: 键的语法增加字节类与选择（[...]、(...|...)）；同一规则文件，旧
+    //         版本编译时跳过了这些行，缓存不能沿用
+    enum { version = 4 };
+
+public:
+    /**
+     * @brief 缓存文件路径：设置了环境变量 BSE_CACHE_DIR 时，放在该目录下；否
+     *        则与规则文件放在一起；均为 <rule_path>.bin 的形式
+     */
+    static std::string cache_path(const std::string& rule_path);
+
+    /**
+     * @brief 读取缓存；文件不存在、版本不符、或 source_hash 不符（规则文件已
+     *        修改）时，返回 false；
+     */
+    static bool load(const std::string& cache_path, uint64_t source_hash, SequenceSM& sm);
+
+    /**
+     * @brief 写入缓存；出错时抛出异常
+     */
+    static void save(const std::string& cache_path, uint64_t source_hash, const SequenceSM& sm);
+
+    /**
+     * @brief 64 位 FNV-1a
+     */
+    static uint64_t hash(const char * data, size_t len);
+};
+
+
+#endif /* __RULECACHE_HPP_1468203377__ */
@@ -0,0 +1,599 @@
+#include "RuleLoader.hpp"
+
+#include <algorithm>
+#include <bitset>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <sss/util/PostionThrow.hpp>
+
+#include "TaskScheduler.hpp"
+
+namespace  {
+    // NOTE 键或替换串的位置：不含转义的直接在输入中，否则在 arena 中；arena
+    // 还会增长，所以先记偏移，该段解析完再换成指针
+    struct Span
+    {
+        uint64_t    m_off;
+        uint32_t    m_len;
+        bool        m_in_arena;
+    };
+
+    struct Item
+    {
+        const char *    m_key;
+        const char *    m_value;
+        uint32_t        m_key_len;
+        uint32_t        m_value_len;
+        uint32_t        m_line;
+    };
+
+    /**
+     * @brief 一个线程负责的若干整行
+     */
+    struct Part
+    {
+        const char *        m_begin = nullptr;
+        const char *        m_end = nullptr;
+        std::vector<Item>   m_items;
+        uint32_t            m_newline_cnt = 0u;
+        // NOTE 转义写错的行（段内行号，从 1 开始）；0 表示没有
+        uint32_t            m_error_line = 0u;
+        int                 m_error = 0;        // ParseResult
+        std::string         m_error_text;
+        std::exception_ptr  m_exception;
+    };
+
+    enum ParseResult {
+        P_OK,
+        P_SKIP,         // 不是规则行
+        P_BAD_ESCAPE,
+        P_BAD_PATTERN,  // [...]、(...|...) 写错
+        P_TOO_MANY      // 展开后的键多于 RuleLoader::max_expansions
+    };
+
+    // NOTE 字节类与选择展开后的键
+    typedef std::vector<std::string> KeySet;
+
+    // NOTE 与 C locale 下的 std::isspace 相同
+    inline bool is_space(char ch)
+    {
+        return ch == ' ' || (ch >= '\t' && ch <= '\r');
+    }
+
+    inline bool is_oct(char ch)
+    {
+        return ch >= '0' && ch <= '7';
+    }
+
+    inline int hex_value(char ch)
+    {
+        if (ch >= '0' && ch <= '9') {
+            return ch - '0';
+        }
+        if (ch >= 'a' && ch <= 'f') {
+            return ch - 'a' + 10;
+        }
+        if (ch >= 'A' && ch <= 'F') {
+            return ch - 'A' + 10;
+        }
+        return -1;
+    }
+
+    // NOTE it 指向 '\\' 之后；依次尝试 \xHH、八进制、单字符转义；失败时 it 不动
+    bool parse_escape(const char *& it, const char * end, char& content)
+    {
+        if (it == end) {
+            return false;
+        }
+        if (*it == 'x' && end - it >= 3 && ::hex_value(it[1]) >= 0 && ::hex_value(it[2]) >= 0) {
+            content = char(::hex_value(it[1]) << 4 | ::hex_value(it[2]));
+            it += 3;
+            return true;
+        }
+        if (end - it >= 2 && ::is_oct(it[0]) && ::is_oct(it[1])) {
+            int value = (it[0] - '0') << 3 | (it[1] - '0');
+            if (it[0] <= '3' && end - it >= 3 && ::is_oct(it[2])) {
+                value = value * 8 + (it[2] - '0');
+                ++it;
+            }
+            it += 2;
+            content = char(value);
+            return true;
+        }
+        switch (*it) {
+        case '\\':
+        case '"':
+        case '\'':
+            content = *it;
+            break;
+
+        case '0':
+            content = '\0';
+            break;
+
+        case 'a':
+            content = '\a';
+            break;
+
+        case 'b':
+            content = '\b';
+            break;
+
+        case 'f':
+            content = '\f';
+            break;
+
+        case 'n':
+            content = '\n';
+            break;
+
+        case 'r':
+            content = '\r';
+            break;
+
+        case 't':
+            content = '\t';
+            break;
+
+        case 'v':
+            content = '\v';
+            break;
+
+        default:
+            return false;
+        }
+        ++it;
+        return true;
+    }
+
+    ParseResult parse_dq_str(const char *& it, const char * end, const char * base,
+                             std::vector<char>& arena, Span& span)
+    {
+        if (it == end || *it != '"') {
+            return P_SKIP;
+        }
+        const char * str_beg = ++it;
+        while (it != end && *it != '"' && *it != '\\') {
+            ++it;
+        }
+        if (it == end) {
+            return P_SKIP;
+        }
+        if (*it == '"') {
+            span = Span{uint64_t(str_beg - base), uint32_t(it - str_beg), false};
+            ++it;
+            return P_OK;
+        }
+        const size_t off = arena.size();
+        arena.insert(arena.end(), str_beg, it);
+        while (it != end && *it != '"') {
+            if (*it == '\\') {
+                char ch = '\0';
+                ++it;
+                if (!::parse_escape(it, end, ch)) {
+                    --it;
+                    return P_BAD_ESCAPE;
+                }
+                arena.push_back(ch);
+            }
+            else {
+                arena.push_back(*it++);
+            }
+        }
+        if (it == end) {
+            arena.resize(off);
+            return P_SKIP;
+        }
+        ++it;
+        span = Span{off, uint32_t(arena.size() - off), true};
+        return P_OK;
+    }
+
+    void skip_space(const char *& it, const char * end)
+    {
+        while (it != end && ::is_space(*it)) {
+            ++it;
+        }
+    }
+
+    // NOTE [...] 中的一个字节：原样的字节，或与 "..." 相同的转义，另加 \] \[ \- \^；
+    // 转义写错时，it 停在 '\\' 上
+    bool parse_class_byte(const char *& it, const char * end, unsigned char& byte)
+    {
+        if (*it != '\\') {
+            byte = *it++;
+            return true;
+        }
+        ++it;
+        if (it != end && (*it == ']' || *it == '[' || *it == '-' || *it == '^')) {
+            byte = *it++;
+            return true;
+        }
+        char ch = '\0';
+        if (!::parse_escape(it, end, ch)) {
+            --it;
+            return false;
+        }
+        byte = ch;
+        return true;
+    }
+
+    // NOTE [a-z\x80-\xbf]：逐个字节或范围；开头的 ^ 表示取反；每个字节各是一个
+    // 单字节的键
+    ParseResult parse_class(const char *& it, const char * end, KeySet& keys)
+    {
+        ++it;
+        bool negate = false;
+        if (it != end && *it == '^') {
+            negate = true;
+            ++it;
+        }
+        std::bitset<256> bytes;
+        bool empty = true;
+        while (it != end && *it != ']') {
+            unsigned char lo = 0u;
+            if (!::parse_class_byte(it, end, lo)) {
+                return P_BAD_ESCAPE;
+            }
+            unsigned char hi = lo;
+            if (end - it >= 2 && *it == '-' && it[1] != ']') {
+                ++it;
+                if (!::parse_class_byte(it, end, hi)) {
+                    return P_BAD_ESCAPE;
+                }
+                if (hi < lo) {
+                    return P_BAD_PATTERN;
+                }
+            }
+            for (unsigned byte = lo; byte <= hi; ++byte) {
+                bytes.set(byte);
+            }
+            empty = false;
+        }
+        if (it == end || empty) {
+            return P_BAD_PATTERN;
+        }
+        ++it;
+        if (negate) {
+            bytes.flip();
+        }
+        keys.clear();
+        for (unsigned byte = 0u; byte < 256u; ++byte) {
+            if (bytes.test(byte)) {
+                keys.push_back(std::string(1u, char(byte)));
+            }
+        }
+        return keys.empty() ? P_BAD_PATTERN : P_OK;
+    }
+
+    ParseResult parse_alts(const char *& it, const char * end, KeySet& keys, int depth);
+
+    // NOTE 一项："..."、[...] 或 (...|...)
+    ParseResult parse_term(const char *& it, const char * end, KeySet& keys, int depth)
+    {
+        if (*it == '"') {
+            std::vector<char> arena;
+            Span span;
+            const char * str_beg = it + 1;
+            ParseResult ret = ::parse_dq_str(it, end, str_beg, arena, span);
+            if (ret != P_OK) {
+                return ret == P_SKIP ? P_BAD_PATTERN : ret;
+            }
+            const char * bytes = (span.m_in_arena ? arena.data() : str_beg) + span.m_off;
+            keys.assign(1u, std::string(bytes, span.m_len));
+            return P_OK;
+        }
+        if (*it == '[') {
+            return ::parse_class(it, end, keys);
+        }
+        if (*it == '(') {
+            // NOTE 嵌套有限，免得恶意的规则文件耗尽栈
+            if (depth >= 16) {
+                return P_BAD_PATTERN;
+            }
+            ++it;
+            ParseResult ret = ::parse_alts(it, end, keys, depth + 1);
+            if (ret != P_OK) {
+                return ret;
+            }
+            if (it == end || *it != ')') {
+                return P_BAD_PATTERN;
+            }
+            ++it;
+            return P_OK;
+        }
+        return P_SKIP;
+    }
+
+    // NOTE 若干项首尾相接：各项展开后的键，按所有组合拼接
+    ParseResult parse_seq(const char *& it, const char * end, KeySet& keys, int depth)
+    {
+        keys.assign(1u, std::string());
+        KeySet term;
+        KeySet product;
+        ::skip_space(it, end);
+        while (it != end && *it != ',' && *it != '|' && *it != ')') {
+            ParseResult ret = ::parse_term(it, end, term, depth);
+            if (ret != P_OK) {
+                return ret;
+            }
+            if (keys.size() * term.size() > RuleLoader::max_expansions) {
+                return P_TOO_MANY;
+            }
+            product.clear();
+            product.reserve(keys.size() * term.size());
+            for (const std::string& head : keys) {
+                for (const std::string& tail : term) {
+                    product.push_back(head + tail);
+                }
+            }
+            keys.swap(product);
+            ::skip_space(it, end);
+        }
+        return P_OK;
+    }
+
+    // NOTE 以 | 分隔的若干选择；停在 ',' 或 ')' 上
+    ParseResult parse_alts(const char *& it, const char * end, KeySet& keys, int depth)
+    {
+        keys.clear();
+        KeySet alt;
+        while (true) {
+            ParseResult ret = ::parse_seq(it, end, alt, depth);
+            if (ret != P_OK) {
+                return ret;
+            }
+            if (keys.size() + alt.size() > RuleLoader::max_expansions) {
+                return P_TOO_MANY;
+            }
+            keys.insert(keys.end(), alt.begin(), alt.end());
+            if (it == end || *it != '|') {
+                return P_OK;
+            }
+            ++it;
+        }
+    }
+
+    // NOTE 键只是一个 "..." 时（绝大多数规则），与原来一样，不含转义就直接指向
+    // 输入；否则按字节类与选择展开为若干字面键，去重后写入 arena；展开后为空
+    // 的键不构成规则
+    ParseResult parse_key(const char *& it, const char * end, const char * base,
+                          std::vector<char>& arena, std::vector<Span>& keys)
+    {
+        keys.clear();
+        if (it == end) {
+            return P_SKIP;
+        }
+        if (*it == '"') {
+            const char * key_beg = it;
+            const size_t arena_size = arena.size();
+            Span span;
+            ParseResult ret = ::parse_dq_str(it, end, base, arena, span);
+            if (ret != P_OK) {
+                return ret;
+            }
+            const char * next = it;
+            ::skip_space(next, end);
+            if (next == end || *next == ',') {
+                keys.push_back(span);
+                return P_OK;
+            }
+            it = key_beg;
+            arena.resize(arena_size);
+        }
+        else if (*it != '[' && *it != '(') {
+            return P_SKIP;
+        }
+        KeySet expanded;
+        ParseResult ret = ::parse_alts(it, end, expanded, 0);
+        if (ret != P_OK) {
+            return ret;
+        }
+        if (it != end && *it == ')') {
+            return P_BAD_PATTERN;
+        }
+        std::sort(expanded.begin(), expanded.end());
+        expanded.erase(std::unique(expanded.begin(), expanded.end()), expanded.end());
+        for (const std::string& key : expanded) {
+            if (!key.empty()) {
+                keys.push_back(Span{arena.size(), uint32_t(key.size()), true});
+                arena.insert(arena.end(), key.begin(), key.end());
+            }
+        }
+        return P_OK;
+    }
+
+    // NOTE 出错时，it 停在出错的地方（转义即 '\\' 上）
+    ParseResult parse_rule(const char *& it, const char * end, const char * base,
+                           std::vector<char>& arena, std::vector<Span>& keys, Span& value)
+    {
+        ::skip_space(it, end);
+        ParseResult ret = ::parse_key(it, end, base, arena, keys);
+        if (ret != P_OK) {
+            return ret;
+        }
+        ::skip_space(it, end);
+        if (it == end || *it != ',') {
+            return P_SKIP;
+        }
+        ++it;
+        ::skip_space(it, end);
+        return ::parse_dq_str(it, end, base, arena, value);
+    }
+
+    bool key_less(const Item& lhs, const Item& rhs)
+    {
+        int cmp = std::memcmp(lhs.m_key, rhs.m_key, std::min(lhs.m_key_len, rhs.m_key_len));
+        if (cmp) {
+            return cmp < 0;
+        }
+        if (lhs.m_key_len != rhs.m_key_len) {
+            return lhs.m_key_len < rhs.m_key_len;
+        }
+        return lhs.m_line < rhs.m_line;
+    }
+
+    bool same_bytes(const char * lhs, uint32_t lhs_len, const char * rhs, uint32_t rhs_len)
+    {
+        return lhs_len == rhs_len && std::memcmp(lhs, rhs, lhs_len) == 0;
+    }
+
+    // NOTE 按行解析本段，换成指针后按键排序；行号为段内行号
+    void parse_part(Part& part, const char * base, std::vector<char>& arena)
+    {
+        struct Parsed
+        {
+            Span        m_key;
+            Span        m_value;
+            uint32_t    m_line;
+        };
+        std::vector<Parsed> parsed;
+        std::vector<Span> keys;
+        const char * it = part.m_begin;
+        uint32_t line_no = 0u;
+        while (it != part.m_end) {
+            const char * eol = static_cast<const char *>(std::memchr(it, '\n', part.m_end - it));
+            const char * line_end = eol ? eol : part.m_end;
+            ++line_no;
+            Span value;
+            const char * cur = it;
+            ParseResult ret = ::parse_rule(cur, line_end, base, arena, keys, value);
+            if (ret != P_OK && ret != P_SKIP) {
+                part.m_error_line = line_no;
+                part.m_error = ret;
+                part.m_error_text.assign(cur, line_end);
+                return;
+            }
+            // NOTE 空键不构成规则
+            if (ret == P_OK) {
+                for (const Span& key : keys) {
+                    if (key.m_len) {
+                        parsed.push_back(Parsed{key, value, line_no});
+                    }
+                }
+            }
+            it = eol ? eol + 1 : part.m_end;
+        }
+        part.m_newline_cnt = line_no - (part.m_begin != part.m_end && part.m_end[-1] != '\n' ? 1u : 0u);
+
+        auto resolve = [base, &arena](const Span& span) -> const char * {
+            if (!span.m_len) {
+                return "";
+            }
+            return (span.m_in_arena ? arena.data() : base) + span.m_off;
+        };
+        part.m_items.reserve(parsed.size());
+        for (const Parsed& rule : parsed) {
+            part.m_items.push_back(Item{resolve(rule.m_key), resolve(rule.m_value),
+                                        rule.m_key.m_len, rule.m_value.m_len, rule.m_line});
+        }
+        std::sort(part.m_items.begin(), part.m_items.end(), ::key_less);
+    }
+} // namespace
+
+RuleLoader::RuleLoader(const char * data, size_t size, size_t worker_cnt)
+{
+    if (!worker_cnt) {
+        worker_cnt = TaskScheduler::hardware_concurrency();
+    }
+    // NOTE 每段至少 parallel_threshold / 4，免得线程比活还多
+    size_t part_cnt = 1u;
+    if (size >= parallel_threshold) {
+        part_cnt = std::max<size_t>(1u, std::min(worker_cnt, size / (parallel_threshold / 4)));
+    }
+
+    // NOTE 切分点挪到下一个换行之后，各段都是整行
+    std::vector<Part> parts(part_cnt);
+    const char * end = data + size;
+    const char * cur = data;
+    for (size_t i = 0; i < part_cnt; ++i) {
+        parts[i].m_begin = cur;
+        const char * cut = end;
+        if (i + 1 < part_cnt) {
+            cut = std::max(cur, data + size / part_cnt * (i + 1));
+            const void * eol = cut == end ? nullptr : std::memchr(cut, '\n', end - cut);
+            cut = eol ? static_cast<const char *>(eol) + 1 : end;
+        }
+        parts[i].m_end = cut;
+        cur = cut;
+    }
+
+    this->m_arenas.resize(part_cnt);
+    auto work = [&parts, data, this](size_t i) {
+        try {
+            ::parse_part(parts[i], data, this->m_arenas[i]);
+        }
+        catch (...) {
+            parts[i].m_exception = std::current_exception();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < part_cnt; ++i) {
+        workers.emplace_back(work, i);
+    }
+    work(0u);
+    for (auto& w : workers) {
+        w.join();
+    }
+
+    // NOTE 各段行号加上之前各段的行数；段按行号先后排列，依次归并即可保持
+    // (键, 行号) 的顺序
+    std::vector<Item> items;
+    std::vector<size_t> bounds(1u, 0u);
+    uint32_t line_base = 0u;
+    for (Part& part : parts) {
+        if (part.m_exception) {
+            std::rethrow_exception(part.m_exception);
+        }
+        if (part.m_error_line) {
+            const char * what = part.m_error == P_BAD_ESCAPE ? "parse_escape error"
+                : part.m_error == P_TOO_MANY ? "pattern expands to too many keys"
+                : "bad pattern";
+            SSS_POSTION_THROW(std::runtime_error,
+                              "line " << line_base + part.m_error_line
+                              << ": " << what << " `" << part.m_error_text << "`");
+        }
+        for (Item& item : part.m_items) {
+            item.m_line += line_base;
+        }
+        line_base += part.m_newline_cnt;
+        items.insert(items.end(), part.m_items.begin(), part.m_items.end());
+        bounds.push_back(items.size());
+        std::vector<Item>().swap(part.m_items);
+    }
+    while (bounds.size() > 2u) {
+        std::vector<size_t> merged(1u, 0u);
+        size_t k = 0;
+        for (; k + 2u < bounds.size(); k += 2u) {
+            std::inplace_merge(items.begin() + bounds[k], items.begin() + bounds[k + 1],
+                               items.begin() + bounds[k + 2], ::key_less);
+            merged.push_back(bounds[k + 2]);
+        }
+        if (k + 1u < bounds.size()) {
+            merged.push_back(bounds[k + 1]);
+        }
+        bounds.swap(merged);
+    }
+
+    this->m_rules.reserve(items.size());
+    const Item * kept = nullptr;
+    for (const Item& item : items) {
+        if (kept && ::same_bytes(kept->m_key, kept->m_key_len, item.m_key, item.m_key_len)) {
+            Issue issue;
+            issue.m_kind = ::same_bytes(kept->m_value, kept->m_value_len, item.m_value, item.m_value_len)
+                ? Issue::I_DUPLICATE : Issue::I_CONFLICT;
+            issue.m_line = item.m_line;
+            issue.m_first_line = kept->m_line;
+            this->m_issues.push_back(issue);
+            continue;
+        }
+        kept = &item;
+        this->m_rules.push_back(SequenceSM::RuleRef{item.m_key, item.m_value, item.m_key_len, item.m_value_len});
+    }
+    std::sort(this->m_issues.begin(), this->m_issues.end(),
+              [](const Issue& lhs, const Issue& rhs) { return lhs.m_line < rhs.m_line; });
+}
@@ -0,0 +1,89 @@
+#ifndef __RULELOADER_HPP_1468455377__
+#define __RULELOADER_HPP_1468455377__
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "SequenceSM.hpp"
+
+/**
+ * @brief 规则文件的整批解析：输入为整个文件的内容（通常是 MappedFile）；
+ *
+ *  按行切成若干段，各段由一个线程解析；键与替换串不含转义时，直接指向输入，
+ *  含转义的，解码到该线程的 arena 中——不再为每行分配字符串；各段先各自按键
+ *  排序，再依次归并；最后顺序扫一遍，去掉重复的键，得到按字节序递增、互不相同
+ *  的规则，交给 SequenceSM::add_sorted_rules() 一遍建树；
+ *
+ *  行的语法与原来相同：
+ *      <空白> "键" <空白> , <空白> "替换串" <其余忽略>
+ *  不符合的行跳过；转义为 \xHH、八进制（两到三位）与 \0 \\ \a \b \f \n \r \t \v
+ *  \' \"；转义写错时，整个文件加载失败，报告行号；
+ *
+ *  键还可以由若干项首尾相接而成："..."、字节类 [...]（单个字节或范围 a-b，开头
+ *  的 ^ 取反）、选择 (... | ...)（可嵌套），顶层也可以直接用 | 分隔；加载时按所
+ *  有组合展开为字面键，与其余规则一同建树——处理时仍是一遍、每字节一次查表；
+ *  单条规则展开后多于 max_expansions 个键，或者写错时，同样加载失败；
+ *
+ *  键完全相同的规则，仍以靠前的一行为准；其余的记入 issues()：替换串也相同的是
+ *  I_DUPLICATE，不同的是 I_CONFLICT。
+ */
+class RuleLoader
+{
+public:
+    struct Issue
+    {
+        enum Kind {
+            I_DUPLICATE,
+            I_CONFLICT
+        };
+
+        Kind        m_kind;
+        uint32_t    m_line;         // 被忽略的行
+        uint32_t    m_first_line;   // 生效的行
+    };
+
+public:
+    /**
+     * @param data       须在本对象及 rules() 使用期间一直有效
+     * @param worker_cnt 解析所用的线程数；0 表示按 CPU 核数；小于
+     *                   parallel_threshold 的输入，总是只用调用者的线程
+     */
+    RuleLoader(const char * data, size_t size, size_t worker_cnt = 0u);
+
+public:
+    RuleLoader(const RuleLoader& ) = delete;
+    RuleLoader& operator = (const RuleLoader& ) = delete;
+
+public:
+    /**
+     * @brief 按键的字节序递增，键互不相同（空键已去掉）
+     */
+    const std::vector<SequenceSM::RuleRef>& rules() const
+    {
+        return this->m_rules;
+    }
+
+    /**
+     * @brief 按被忽略的行号排序
+     */
+    const std::vector<Issue>& issues() const
+    {
+        return this->m_issues;
+    }
+
+public:
+    // NOTE 30 万条规则约 5 MiB；更小的文件，起线程不划算
+    enum { parallel_threshold = 1024 * 1024 };
+
+    // NOTE 单条规则展开后的键数上限；[a-z] 连写四次即 45 万个，多半是写错了
+    enum { max_expansions = 65536 };
+
+private:
+    std::vector<std::vector<char>>      m_arenas;
+    std::vector<SequenceSM::RuleRef>    m_rules;
+    std::vector<Issue>                  m_issues;
+};
+
+
+#endif /* __RULELOADER_HPP_1468455377__ */
@@ -0,0 +1,120 @@
+#include "RunStats.hpp"
+
+#include <algorithm>
+
+#include "JsonWriter.hpp"
+
+namespace  {
+    // NOTE 只列出命中过的规则，按命中次数从多到少
+    void write_rules(JsonWriter& json, std::vector<std::pair<uint32_t, uint64_t>> hits,
+                     const std::vector<std::string>& keys)
+    {
+        std::stable_sort(hits.begin(), hits.end(),
+                         [](const std::pair<uint32_t, uint64_t>& lhs, const std::pair<uint32_t, uint64_t>& rhs) {
+                             return lhs.second > rhs.second;
+                         });
+        json.key("per_rule").begin_array();
+        for (const auto& item : hits) {
+            const uint32_t st = item.first;
+            json.begin_object();
+            json.key("state").value(uint64_t(st));
+            json.key("key_hex").hex(st < keys.size() ? keys[st] : std::string());
+            json.key("hits").value(item.second);
+            json.end_object();
+        }
+        json.end_array();
+    }
+
+    const char * skipped_name(FileStats::Skipped skipped)
+    {
+        switch (skipped) {
+        case FileStats::S_UNCHANGED:
+            return "unchanged";
+
+        case FileStats::S_NOOP:
+            return "noop";
+
+        default:
+            return "";
+        }
+    }
+
+    void write_counts(JsonWriter& json, const FileStats& file)
+    {
+        json.key("bytes_in").value(file.m_bytes_in);
+        json.key("bytes_out").value(file.m_bytes_out);
+        json.key("matches").value(file.m_match.m_matches);
+        json.key("translate_s").value(file.m_translate_s);
+        json.key("write_s").value(file.m_write_s);
+    }
+} // namespace
+
+void RunStats::add(FileStats&& file)
+{
+    file.m_rule_hits = file.m_match.rule_hits();
+    file.m_match.drop_hits();
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    for (const auto& item : file.m_rule_hits) {
+        this->m_total_hits[item.first] += item.second;
+    }
+    this->m_files.push_back(std::move(file));
+}
+
+void RunStats::write_json(std::ostream& out, const SequenceSM& sm) const
+{
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    const std::vector<std::string> keys = sm.terminal_keys();
+
+    JsonWriter json(out);
+    json.begin_object();
+    json.path("rule", this->m_rule_path);
+    json.key("load").begin_object();
+    json.key("from_cache").value(this->m_load_times.m_from_cache);
+    json.key("embedded").value(this->m_load_times.m_embedded);
+    json.key("trained").value(this->m_load_times.m_trained);
+    json.key("backend").value(SequenceSM::backend_name(sm.backend()));
+    json.key("read_s").value(this->m_load_times.m_read_s);
+    json.key("cache_s").value(this->m_load_times.m_cache_s);
+    json.key("parse_s").value(this->m_load_times.m_parse_s);
+    json.key("compile_s").value(this->m_load_times.m_compile_s);
+    json.key("duplicate_keys").value(this->m_load_times.m_duplicates);
+    json.key("conflicting_keys").value(this->m_load_times.m_conflicts);
+    json.end_object();
+
+    FileStats total;
+    uint64_t failed_cnt = 0u;
+    uint64_t unchanged_cnt = 0u;
+    uint64_t noop_cnt = 0u;
+    json.key("files").begin_array();
+    for (const auto& file : this->m_files) {
+        json.begin_object();
+        json.path("path", file.m_path);
+        json.key("ok").value(file.m_ok);
+        json.key("skipped").value(::skipped_name(file.m_skipped));
+        ::write_counts(json, file);
+        ::write_rules(json, file.m_rule_hits, keys);
+        json.end_object();
+
+        failed_cnt += file.m_ok ? 0u : 1u;
+        unchanged_cnt += file.m_skipped == FileStats::S_UNCHANGED ? 1u : 0u;
+        noop_cnt += file.m_skipped == FileStats::S_NOOP ? 1u : 0u;
+        total.m_bytes_in += file.m_bytes_in;
+        total.m_bytes_out += file.m_bytes_out;
+        total.m_translate_s += file.m_translate_s;
+        total.m_write_s += file.m_write_s;
+        total.m_match.m_matches += file.m_match.m_matches;
+    }
+    json.end_array();
+
+    json.key("total").begin_object();
+    json.key("files").value(uint64_t(this->m_files.size()));
+    json.key("failed").value(failed_cnt);
+    json.key("skipped_unchanged").value(unchanged_cnt);
+    json.key("skipped_noop").value(noop_cnt);
+    ::write_counts(json, total);
+    std::vector<std::pair<uint32_t, uint64_t>> total_hits(this->m_total_hits.begin(), this->m_total_hits.end());
+    std::sort(total_hits.begin(), total_hits.end());
+    ::write_rules(json, std::move(total_hits), keys);
+    json.end_object();
+    json.end_object();
+}
@@ -0,0 +1,119 @@
+#ifndef __RUNSTATS_HPP_1468213577__
+#define __RUNSTATS_HPP_1468213577__
+
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "SequenceSM.hpp"
+
+/**
+ * @brief 计时用；构造时开始
+ */
+class StopWatch
+{
+public:
+    StopWatch()
+        : m_start(std::chrono::steady_clock::now())
+    {}
+
+    double seconds() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - this->m_start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_start;
+};
+
+/**
+ * @brief ByteStreamEditor::load() 各阶段的耗时，单位秒；
+ *        命中缓存时，没有 parse 与 compile 两个阶段
+ */
+struct LoadTimes
+{
+    bool    m_from_cache = false;
+    bool    m_embedded = false;     // 内置规则集（EmbeddedRules），各阶段都没有
+    double  m_read_s = 0.0;     // 读入规则文件并计算 hash
+    double  m_cache_s = 0.0;    // 映射或写出 RuleCache
+    double  m_parse_s = 0.0;
+    double  m_compile_s = 0.0;
+    uint64_t m_duplicates = 0u;     // 键与替换串都重复的行（被忽略）
+    uint64_t m_conflicts = 0u;      // 键重复、替换串不同的行（被忽略）
+    bool    m_trained = false;  // 状态已按样本重新编号（缓存中的，或 train() 的）
+};
+
+/**
+ * @brief ByteStreamEditor::train() 的结果
+ *
+ *  m_bytes     样本的字节数（压缩的样本按解压后计）
+ *  m_visited   样本上到达过的状态数，不含 S0
+ *  m_saved     新的编号已写入 RuleCache；否则只在本进程内有效
+ */
+struct TrainStats
+{
+    uint64_t    m_bytes = 0u;
+    uint32_t    m_visited = 0u;
+    uint32_t    m_state_cnt = 0u;
+    bool        m_saved = false;
+};
+
+/**
+ * @brief 单个文件（或管道）的统计；由处理它的线程独占填写
+ *
+ *  m_translate_s   整个文件的处理时间，含写出
+ *  m_write_s       其中，阻塞在写出（Sink::flush()）上的时间
+ *  m_skipped       没有处理的原因：清单表明未变（Manifest），或者没有匹配
+ *                  （--skip-noop，此时只有读入与扫描）
+ */
+struct FileStats
+{
+    enum Skipped { S_NONE, S_UNCHANGED, S_NOOP };
+
+    std::string             m_path;
+    bool                    m_ok = false;
+    Skipped                 m_skipped = S_NONE;
+    uint64_t                m_bytes_in = 0u;
+    uint64_t                m_bytes_out = 0u;
+    double                  m_translate_s = 0.0;
+    double                  m_write_s = 0.0;
+    SequenceSM::MatchStats  m_match;
+    // NOTE RunStats::add() 时由 m_match 转来：只留命中过的 (状态, 次数)，
+    // m_match 的按状态计数随即释放——文件多、规则集大时，逐个保留稠密数组，
+    // 内存是文件数乘以状态数
+    std::vector<std::pair<uint32_t, uint64_t>> m_rule_hits;
+};
+
+/**
+ * @brief 一次运行的全部统计：规则加载耗时、逐个文件的统计，以及汇总；
+ *        add() 可以在多个线程中调用；
+ */
+class RunStats
+{
+public:
+    RunStats(const std::string& rule_path, const LoadTimes& load_times)
+        : m_rule_path(rule_path), m_load_times(load_times)
+    {}
+
+public:
+    void add(FileStats&& file);
+
+    /**
+     * @brief 输出 JSON；per_rule 中，键以十六进制给出——规则文件常常不是
+     *        UTF-8 编码
+     */
+    void write_json(std::ostream& out, const SequenceSM& sm) const;
+
+private:
+    std::string             m_rule_path;
+    LoadTimes               m_load_times;
+    std::vector<FileStats>  m_files;
+    // NOTE 各文件命中过的规则，add() 时累加；只有命中过的状态占内存
+    std::unordered_map<uint32_t, uint64_t> m_total_hits;
+    mutable std::mutex      m_mutex;
+};
+
+#endif /* __RUNSTATS_HPP_1468213577__ */
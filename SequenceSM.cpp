@@ -1,13 +1,33 @@
 #include "SequenceSM.hpp"
 
-#include "TCircleBuffer.hpp"
 #include <deque>
+#include <algorithm>
+#include <cstring>
+
+#include "CodepointTable.hpp"
+#include "DoubleArray.hpp"
 
 #include <sss/util/PostionThrow.hpp>
 #include <sss/bit_operation/bit_operation.h>
 
+namespace  {
+    /**
+     * @brief compile() 生成的跳转表，实际存放于此
+     */
+    struct TableStorage
+    {
+        std::vector<uint8_t>    m_classes;
+        std::vector<uint32_t>   m_next;
+        std::vector<uint32_t>   m_depth;
+        std::vector<uint8_t>    m_flags;
+        std::vector<uint32_t>   m_value;
+        std::string             m_pool;
+    };
+} // namespace 
+
 SequenceSM::SequenceSM()
-    : m_max_jump_cnt(0u)
+    : m_max_jump_cnt(0u), m_table(), m_compiled(false), m_has_callbacks(false), m_use_codepoints(true),
+      m_use_classes(true), m_backend(B_DENSE)
 {
     this->m_statuss.push_back(State{});
 }
@@ -26,7 +46,23 @@ size_t SequenceSM::find_jump(size_t from, char input) const
     return 0;
 }
 
-size_t SequenceSM::ensure_jump(size_t from, char input, const std::function<std::string()>& action)
+size_t SequenceSM::add_jump(size_t from, char input)
+{
+    if (this->m_compiled && this->m_statuss.size() != this->m_table.m_state_cnt) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "rule set adopted from a compiled image is read-only");
+    }
+    size_t current_jump_cnt = m_statuss[from].m_jump_cnt + 1; 
+    if (this->m_max_jump_cnt < current_jump_cnt) {
+        this->m_max_jump_cnt = current_jump_cnt;
+    }
+    this->m_statuss.push_back(State{from, input, current_jump_cnt});
+    this->m_sm[sm_key_t{from, input}] = this->m_statuss.size() - 1;
+    this->m_compiled = false;
+    return this->m_statuss.size() - 1;
+}
+
+size_t SequenceSM::ensure_jump(size_t from, char input)
 {
     size_t next_st = this->find_jump(from, input);
 #ifdef _DEBUG
@@ -43,84 +79,894 @@ size_t SequenceSM::ensure_jump(size_t from, char input, const std::function<std:
         // }
         return next_st;
     }
-    size_t current_jump_cnt = m_statuss[from].m_jump_cnt + 1; 
-    if (this->m_max_jump_cnt < current_jump_cnt) {
-        this->m_max_jump_cnt = current_jump_cnt;
+    return this->add_jump(from, input);
+}
+
+// NOTE 较短的规则后加入时，它的终态已经作为较长规则的中间状态存在了；此时
+// 只需补上动作
+size_t SequenceSM::ensure_jump(size_t from, char input, const std::string& value)
+{
+    size_t next_st = this->find_jump(from, input);
+    if (next_st && this->m_statuss[next_st].m_kind != State::k_none) {
+        return next_st;
     }
-    this->m_statuss.push_back(State{from, input, current_jump_cnt, action});
-    this->m_sm[sm_key_t{from, input}] = this->m_statuss.size() - 1;
-    return this->m_statuss.size() - 1;
+    if (this->m_value_pool.size() + value.size() > UINT32_MAX) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "replacement pool exceeds 4 GiB");
+    }
+    if (next_st) {
+        this->m_compiled = false;
+    }
+    else {
+        next_st = this->add_jump(from, input);
+    }
+    State& st = this->m_statuss[next_st];
+    st.m_kind = State::k_literal;
+    st.m_value_off = this->m_value_pool.size();
+    st.m_value_len = value.size();
+    this->m_value_pool += value;
+    return next_st;
 }
 
-namespace  {
-    template<typename C>
-    void dump2stream(std::ostream& o, const C& c) {
-        for (const auto& item : c) {
-            o << item;
+size_t SequenceSM::ensure_jump_callback(size_t from, char input, const Callback& action)
+{
+    size_t next_st = this->find_jump(from, input);
+    if (next_st && this->m_statuss[next_st].m_kind != State::k_none) {
+        return next_st;
+    }
+    if (next_st) {
+        this->m_compiled = false;
+    }
+    else {
+        next_st = this->add_jump(from, input);
+    }
+    State& st = this->m_statuss[next_st];
+    st.m_kind = State::k_callback;
+    st.m_value_off = this->m_callbacks.size();
+    this->m_callbacks.push_back(action);
+    return next_st;
+}
+
+void SequenceSM::add_rule(const std::string& key, const std::string& value)
+{
+    if (this->m_backend == B_DOUBLE_ARRAY) {
+        if (key.empty()) {
+            return;
         }
+        if (this->m_value_pool.size() + value.size() > UINT32_MAX) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              "replacement pool exceeds 4 GiB");
+        }
+        RuleKey rule;
+        rule.m_key = key;
+        rule.m_value_off = this->m_value_pool.size();
+        rule.m_value_len = value.size();
+        rule.m_kind = State::k_literal;
+        this->m_rule_keys.push_back(std::move(rule));
+        this->m_value_pool += value;
+        this->m_compiled = false;
+        return;
     }
-} // namespace 
+    size_t st_id = 0;
+    for (size_t i = 0; i < key.length(); ++i) {
+        if (i == key.length() - 1) {
+            st_id = this->ensure_jump(st_id, key[i], value);
+        }
+        else {
+            st_id = this->ensure_jump(st_id, key[i]);
+        }
+    }
+}
 
-// #define _DEBUG
+void SequenceSM::add_sorted_rules(const std::vector<RuleRef>& rules)
+{
+    for (size_t i = 0; i < rules.size(); ++i) {
+        const RuleRef& cur = rules[i];
+        const RuleRef& prev = rules[i ? i - 1 : 0];
+        int cmp = i ? std::memcmp(prev.m_key, cur.m_key, std::min(prev.m_key_len, cur.m_key_len)) : -1;
+        if (!cur.m_key_len || cmp > 0 || (!cmp && prev.m_key_len >= cur.m_key_len)) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              "rules not sorted by key, or with duplicate keys, at " << i);
+        }
+    }
+    if (this->m_backend == B_DOUBLE_ARRAY || this->m_statuss.size() != 1u) {
+        for (const RuleRef& rule : rules) {
+            this->add_rule(std::string(rule.m_key, rule.m_key_len),
+                           std::string(rule.m_value, rule.m_value_len));
+        }
+        return;
+    }
 
-// #define _USE_CB_
+    size_t edge_cnt = 0u;
+    size_t value_size = this->m_value_pool.size();
+    for (const RuleRef& rule : rules) {
+        edge_cnt += rule.m_key_len;
+        value_size += rule.m_value_len;
+    }
+    if (value_size > UINT32_MAX) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "replacement pool exceeds 4 GiB");
+    }
+    // NOTE 键长之和是状态数的上界
+    this->m_statuss.reserve(edge_cnt + 1u);
+    this->m_sm.reserve(edge_cnt);
+    this->m_value_pool.reserve(value_size);
 
-// TODO
-// 使用定长循环buffer，而不是用std::deque，因为，需要的buffer长度，可以通过最长
-// 匹配序列，而提前知道！
-void SequenceSM::translate(std::istream& in, std::ostream& out)
+    // NOTE path[i] 为上一个键前 i 个字节所到达的状态
+    std::vector<uint32_t> path(1u, 0u);
+    const RuleRef * prev = nullptr;
+    for (const RuleRef& rule : rules) {
+        size_t common = 0u;
+        if (prev) {
+            const size_t len = std::min(prev->m_key_len, rule.m_key_len);
+            while (common < len && prev->m_key[common] == rule.m_key[common]) {
+                ++common;
+            }
+        }
+        path.resize(common + 1u);
+        for (size_t i = common; i < rule.m_key_len; ++i) {
+            path.push_back(this->add_jump(path.back(), rule.m_key[i]));
+        }
+        State& st = this->m_statuss[path.back()];
+        st.m_kind = State::k_literal;
+        st.m_value_off = this->m_value_pool.size();
+        st.m_value_len = rule.m_value_len;
+        this->m_value_pool.append(rule.m_value, rule.m_value_len);
+        prev = &rule;
+    }
+}
+
+const char * SequenceSM::backend_name(Backend backend)
 {
-    char ch;
-    size_t st = 0;
+    switch (backend) {
+    case B_DENSE:
+        return "dense";
 
-#ifdef _USE_CB_
-    std::cout << __func__ << " m_max_jump_cnt = " << this->m_max_jump_cnt << std::endl;
-    TCircleBuffer<char> buffer(this->m_max_jump_cnt);
-#else
-    std::deque<char> buffer;
-#endif
+    case B_DOUBLE_ARRAY:
+        return "double-array";
 
-#ifdef _DEBUG
-    int cnt = 0;
-#endif
-    while (in.get(ch)) {
-#ifdef _DEBUG
-        size_t st_old = st;
-#endif
-        st = this->find_jump(st, ch);
-#ifdef _DEBUG
-        std::cout
-            << __func__ << ":" << __LINE__<<":" << cnt++ << "(" << st_old << ", " << ext::binary << ch << ", " << st << ")"
-            << std::endl;
-#endif
+    default:
+        return "unknown";
+    }
+}
+
+uint32_t SequenceSM::next_state(uint32_t st, uint8_t input) const
+{
+    const Table& table = this->m_table;
+    if (table.m_backend != B_DOUBLE_ARRAY) {
+        return table.m_next[st * table.m_class_cnt + table.m_classes[input]];
+    }
+    while (true) {
+        uint32_t t = table.m_base[st] + input;
+        if (table.m_check[t] == st + 1u) {
+            return t;
+        }
         if (!st) {
-            dump2stream(out, buffer);
-            buffer.clear();
-            out << ch;
+            return 0u;
+        }
+        st = table.m_fail[st];
+    }
+}
+
+// NOTE 按广度优先顺序，为每个状态计算失败链接 fail(s)——即 s 所代表序列的、最
+// 长的、同时又是某规则前缀的真后缀；然后把 fail 直接折叠进跳转表：
+//   next(s, c) = goto(s, c) 存在 ? goto(s, c) : next(fail(s), c)
+// 由于 fail(s) 的深度小于 s，BFS 处理到 s 时，fail(s) 那一行已经是完整的；
+//
+// 字节等价类：没有出现在任何键中的字节，在所有状态下都跳回 S0，归为 0 号类；
+// 出现过的字节各自一类——每个子节点只有一个入边字节，所以两个出现过的字节，
+// 至少在某个状态下跳转不同，不能再合并；
+void SequenceSM::compile()
+{
+    if (this->m_backend == B_DOUBLE_ARRAY) {
+        this->compile_double_array();
+        return;
+    }
+    const size_t count = this->m_statuss.size();
+    std::shared_ptr<TableStorage> storage = std::make_shared<TableStorage>();
+    std::vector<uint8_t>&  classes = storage->m_classes;
+    std::vector<uint32_t>& next  = storage->m_next;
+    std::vector<uint32_t>& depth = storage->m_depth;
+    std::vector<uint8_t>&  flags = storage->m_flags;
+
+    bool used[256] = {false};
+    size_t class_cnt = 1u;
+    for (const auto& item : this->m_sm) {
+        if (!used[uint8_t(item.first.second)]) {
+            used[uint8_t(item.first.second)] = true;
+            ++class_cnt;
+        }
+    }
+    classes.assign(256u, 0u);
+    if (this->m_use_classes && class_cnt <= max_byte_classes) {
+        uint8_t id = 0u;
+        for (size_t c = 0; c < 256u; ++c) {
+            if (used[c]) {
+                classes[c] = ++id;
+            }
+        }
+    }
+    else {
+        class_cnt = 256u;
+        for (size_t c = 0; c < 256u; ++c) {
+            classes[c] = uint8_t(c);
+        }
+    }
+
+    next.assign(count * class_cnt, 0u);
+    depth.resize(count);
+    flags.assign(count, 0u);
+    storage->m_value.assign(count * 2u, 0u);
+
+    for (const auto& item : this->m_sm) {
+        next[item.first.first * class_cnt + classes[uint8_t(item.first.second)]] = item.second;
+        // NOTE 有子节点的终态，即某条规则是另一条更长规则的前缀
+        flags[item.first.first] |= F_PREFIX;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        const State& state = this->m_statuss[i];
+        depth[i] = state.m_jump_cnt;
+        if (state.m_kind == State::k_none) {
+            flags[i] &= ~uint8_t(F_PREFIX);
         }
         else {
-            if (this->m_statuss[st].m_action) {
-                out << this->m_statuss[st].m_action();
-#ifdef _DEBUG
-                dump2stream(std::cout, buffer);
-                std::cout << " -> " << this->m_statuss[st].m_action();
-#endif
-                buffer.clear();
-                st = 0; // NOTE jump to init state
+            flags[i] |= F_TERMINAL;
+            if (state.m_kind == State::k_callback) {
+                flags[i] |= F_CALLBACK;
+            }
+            storage->m_value[i * 2] = state.m_value_off;
+            storage->m_value[i * 2 + 1] = state.m_value_len;
+        }
+    }
+    storage->m_pool = this->m_value_pool;
+
+    std::vector<uint32_t> fail(count, 0u);
+    std::vector<uint32_t> dict(count, 0u); // fail 链上，最近的带动作状态
+    std::deque<uint32_t> queue;
+    queue.push_back(0u);
+    while (!queue.empty()) {
+        uint32_t st = queue.front();
+        queue.pop_front();
+        uint32_t * row = &next[st * class_cnt];
+        const uint32_t * fail_row = &next[fail[st] * class_cnt];
+        for (size_t c = 0; c < class_cnt; ++c) {
+            uint32_t child = row[c];
+            if (child && depth[child] == depth[st] + 1) {
+                uint32_t f = st ? fail_row[c] : 0u;
+                fail[child] = f;
+                dict[child] = (flags[f] & F_TERMINAL) ? f : dict[f];
+                if (dict[child] || (flags[st] & F_RESCAN)) {
+                    flags[child] |= F_RESCAN;
+                }
+                queue.push_back(child);
             }
             else {
-#ifdef _DEBUG
-                std::cout << __func__ << ":" << __LINE__ << ":" << cnt << ":push_back(" << ext::binary << ch << ")" << std::endl;
-#endif
+                row[c] = st ? fail_row[c] : 0u;
+            }
+        }
+    }
 
-#ifdef _USE_CB_
-                buffer.push(ch);
-#else
-                buffer.push_back(ch);
-#endif
+    this->m_table.m_state_cnt = count;
+    this->m_table.m_max_jump_cnt = this->m_max_jump_cnt;
+    this->m_table.m_class_cnt = class_cnt;
+    this->m_table.m_classes = classes.data();
+    this->m_table.m_next = next.data();
+    this->m_table.m_depth = depth.data();
+    this->m_table.m_flags = flags.data();
+    this->m_table.m_value = storage->m_value.data();
+    this->m_table.m_pool = storage->m_pool.data();
+    this->m_table.m_pool_size = storage->m_pool.size();
+    this->m_table.m_backend = B_DENSE;
+    this->m_table.m_base = nullptr;
+    this->m_table.m_check = nullptr;
+    this->m_table.m_fail = nullptr;
+    this->m_table.m_trained = 0u;
+    this->m_table_storage = storage;
+    this->m_compiled = true;
+    this->init_scanner();
+    this->init_codepoints();
+}
+
+// NOTE 经 ensure_jump() 加入规则树的规则（如回调），排在 add_rule() 记下的规则
+// 之前，一并建表
+void SequenceSM::compile_double_array()
+{
+    std::vector<RuleKey> keys;
+    for (size_t i = 1; i < this->m_statuss.size(); ++i) {
+        const State& state = this->m_statuss[i];
+        if (state.m_kind == State::k_none) {
+            continue;
+        }
+        RuleKey rule;
+        rule.m_key.resize(state.m_jump_cnt);
+        for (size_t cur = i, j = rule.m_key.size(); j; cur = this->m_statuss[cur].m_prev_index) {
+            rule.m_key[--j] = this->m_statuss[cur].m_prev_path;
+        }
+        rule.m_value_off = state.m_value_off;
+        rule.m_value_len = state.m_value_len;
+        rule.m_kind = state.m_kind;
+        keys.push_back(std::move(rule));
+    }
+    keys.insert(keys.end(), this->m_rule_keys.begin(), this->m_rule_keys.end());
+
+    Table table;
+    this->m_table_storage = DoubleArray::build(keys, this->m_value_pool, table);
+    this->m_table = table;
+    this->m_max_jump_cnt = table.m_max_jump_cnt;
+    this->m_compiled = true;
+    this->init_scanner();
+    this->init_codepoints();
+}
+
+void SequenceSM::init_scanner()
+{
+    bool member[256];
+    for (size_t c = 0; c < 256u; ++c) {
+        member[c] = this->next_state(0u, c) != 0u;
+    }
+    this->m_scanner.assign(member);
+    this->m_has_callbacks = false;
+    for (uint32_t st = 0; st < this->m_table.m_state_cnt && !this->m_has_callbacks; ++st) {
+        this->m_has_callbacks = (this->m_table.m_flags[st] & F_CALLBACK) != 0u;
+    }
+}
+
+void SequenceSM::init_codepoints()
+{
+    this->m_codepoints = CodepointTable::build(*this);
+}
+
+void SequenceSM::adopt(const Table& table, std::shared_ptr<const void> storage)
+{
+    this->m_statuss.assign(1u, State{});
+    this->m_sm.clear();
+    this->m_value_pool.clear();
+    this->m_callbacks.clear();
+    this->m_max_jump_cnt = table.m_max_jump_cnt;
+    this->m_backend = Backend(table.m_backend);
+    this->m_rule_keys.clear();
+    this->m_table = table;
+    this->m_table_storage = storage;
+    this->m_compiled = true;
+    this->init_scanner();
+    this->init_codepoints();
+}
+
+uint32_t SequenceSM::count_visits(const char * data, size_t len, std::vector<uint64_t>& visits,
+                                  uint32_t st) const
+{
+    if (!this->m_compiled || visits.size() != this->m_table.m_state_cnt) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "visits must have one counter per compiled state");
+    }
+    const uint8_t * flags = this->m_table.m_flags;
+    const char * it = data;
+    const char * end = data + len;
+    while (it != end) {
+        if (!st) {
+            it = this->m_scanner.find(it, end);
+            if (it == end) {
+                break;
+            }
+        }
+        st = this->next_state(st, uint8_t(*it++));
+        ++visits[st];
+        if ((flags[st] & F_TERMINAL) && !(flags[st] & F_PREFIX)) {
+            st = 0u;
+        }
+    }
+    return st;
+}
+
+// NOTE 子节点即 depth 恰好加一的跳转（同 terminal_keys()）；先放最热的状态，
+// 紧接着放它到达过的子节点——匹配时从一个状态走到的，多半是这几行之一
+void SequenceSM::renumber(const std::vector<uint64_t>& visits)
+{
+    const Table& table = this->m_table;
+    if (!this->m_compiled || table.m_backend != B_DENSE) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "only compiled dense tables can be renumbered");
+    }
+    const size_t count = table.m_state_cnt;
+    const size_t class_cnt = table.m_class_cnt;
+    if (visits.size() != count) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "visits must have one counter per compiled state");
+    }
+    auto hotter = [&visits](uint32_t lhs, uint32_t rhs) {
+        return visits[lhs] > visits[rhs];
+    };
+
+    std::vector<uint32_t> hot;
+    for (uint32_t st = 1; st < count; ++st) {
+        if (visits[st]) {
+            hot.push_back(st);
+        }
+    }
+    std::stable_sort(hot.begin(), hot.end(), hotter);
+
+    const uint32_t none = uint32_t(-1);
+    std::vector<uint32_t> rank(count, none);
+    std::vector<uint32_t> order;
+    order.reserve(count);
+    auto place = [&rank, &order](uint32_t st) {
+        rank[st] = order.size();
+        order.push_back(st);
+    };
+    place(0u);
+    std::vector<uint32_t> children;
+    for (uint32_t st : hot) {
+        if (rank[st] == none) {
+            place(st);
+        }
+        children.clear();
+        const uint32_t * row = table.m_next + st * class_cnt;
+        for (size_t c = 0; c < class_cnt; ++c) {
+            uint32_t child = row[c];
+            if (table.m_depth[child] == table.m_depth[st] + 1 && visits[child] && rank[child] == none) {
+                children.push_back(child);
+            }
+        }
+        std::stable_sort(children.begin(), children.end(), hotter);
+        for (uint32_t child : children) {
+            place(child);
+        }
+    }
+    for (uint32_t st = 1; st < count; ++st) {
+        if (rank[st] == none) {
+            place(st);
+        }
+    }
+
+    std::shared_ptr<TableStorage> storage = std::make_shared<TableStorage>();
+    storage->m_classes.assign(table.m_classes, table.m_classes + 256u);
+    storage->m_next.resize(count * class_cnt);
+    storage->m_depth.resize(count);
+    storage->m_flags.resize(count);
+    storage->m_value.resize(count * 2u);
+    storage->m_pool.assign(table.m_pool, table.m_pool_size);
+    for (size_t i = 0; i < count; ++i) {
+        const uint32_t st = order[i];
+        const uint32_t * row = table.m_next + st * class_cnt;
+        uint32_t * new_row = &storage->m_next[i * class_cnt];
+        for (size_t c = 0; c < class_cnt; ++c) {
+            new_row[c] = rank[row[c]];
+        }
+        storage->m_depth[i] = table.m_depth[st];
+        storage->m_flags[i] = table.m_flags[st];
+        storage->m_value[i * 2] = table.m_value[st * 2];
+        storage->m_value[i * 2 + 1] = table.m_value[st * 2 + 1];
+    }
+
+    Table renumbered = table;
+    renumbered.m_classes = storage->m_classes.data();
+    renumbered.m_next = storage->m_next.data();
+    renumbered.m_depth = storage->m_depth.data();
+    renumbered.m_flags = storage->m_flags.data();
+    renumbered.m_value = storage->m_value.data();
+    renumbered.m_pool = storage->m_pool.data();
+    renumbered.m_trained = 1u;
+
+    // NOTE 回调的下标不变，m_callbacks 保留；规则树的编号已对不上，清空
+    this->m_statuss.assign(1u, State{});
+    this->m_sm.clear();
+    this->m_rule_keys.clear();
+    this->m_table = renumbered;
+    this->m_table_storage = storage;
+    this->init_scanner();
+    this->init_codepoints();
+}
+
+void SequenceSM::MatchStats::merge(const MatchStats& ref)
+{
+    this->m_matches += ref.m_matches;
+    this->m_delta += ref.m_delta;
+    if (this->m_hits.size() < ref.m_hits.size()) {
+        this->m_hits.resize(ref.m_hits.size(), 0u);
+    }
+    for (size_t i = 0; i < ref.m_hits.size(); ++i) {
+        this->m_hits[i] += ref.m_hits[i];
+    }
+    if (!ref.m_sparse_hits.empty()) {
+        this->m_sparse = true;
+        for (const auto& item : ref.m_sparse_hits) {
+            this->m_sparse_hits[item.first] += item.second;
+        }
+    }
+}
+
+std::vector<std::pair<uint32_t, uint64_t>> SequenceSM::MatchStats::rule_hits() const
+{
+    std::vector<std::pair<uint32_t, uint64_t>> ret(this->m_sparse_hits.begin(), this->m_sparse_hits.end());
+    for (size_t st = 0; st < this->m_hits.size(); ++st) {
+        if (this->m_hits[st]) {
+            ret.emplace_back(st, this->m_hits[st]);
+        }
+    }
+    std::sort(ret.begin(), ret.end());
+    // NOTE 两种计数都有同一状态时（merge() 混合而来），合并为一项
+    size_t cnt = 0u;
+    for (size_t i = 0; i < ret.size(); ++i) {
+        if (cnt && ret[cnt - 1].first == ret[i].first) {
+            ret[cnt - 1].second += ret[i].second;
+        }
+        else {
+            ret[cnt++] = ret[i];
+        }
+    }
+    ret.resize(cnt);
+    return ret;
+}
+
+void SequenceSM::MatchStats::drop_hits()
+{
+    std::vector<uint64_t>().swap(this->m_hits);
+    std::unordered_map<uint32_t, uint64_t>().swap(this->m_sparse_hits);
+    this->m_sparse = false;
+}
+
+std::vector<std::string> SequenceSM::terminal_keys() const
+{
+    const Table& table = this->m_table;
+    const size_t count = this->m_compiled ? table.m_state_cnt : 0u;
+    std::vector<uint32_t> parent(count, 0u);
+    std::string in_byte(count, '\0');
+    // NOTE 出现在键中的字节各自一类，类号反查字节是唯一的
+    std::string class_byte(count ? table.m_class_cnt : 0u, '\0');
+    for (size_t ch = 256u; count && ch--; ) {
+        class_byte[table.m_classes[ch]] = char(ch);
+    }
+    if (table.m_backend == B_DOUBLE_ARRAY) {
+        // NOTE check 即父节点 + 1，下标减去父节点的 base 即入边字节
+        for (size_t st = 1; st < count; ++st) {
+            if (table.m_check[st]) {
+                parent[st] = table.m_check[st] - 1u;
+                in_byte[st] = char(st - table.m_base[parent[st]]);
+            }
+        }
+    }
+    for (size_t st = 0; table.m_backend != B_DOUBLE_ARRAY && st < count; ++st) {
+        const uint32_t * row = table.m_next + st * table.m_class_cnt;
+        for (size_t cls = 0; cls < table.m_class_cnt; ++cls) {
+            uint32_t next_st = row[cls];
+            if (table.m_depth[next_st] == table.m_depth[st] + 1) {
+                parent[next_st] = st;
+                in_byte[next_st] = class_byte[cls];
+            }
+        }
+    }
+    std::vector<std::string> keys(count);
+    for (size_t st = 1; st < count; ++st) {
+        if (!(table.m_flags[st] & F_TERMINAL)) {
+            continue;
+        }
+        std::string& key = keys[st];
+        key.resize(table.m_depth[st]);
+        for (size_t cur = st, i = key.size(); i; cur = parent[cur]) {
+            key[--i] = in_byte[cur];
+        }
+    }
+    return keys;
+}
+
+// #define _DEBUG
+
+SequenceSM::Matcher::Matcher(const SequenceSM& sm)
+    : m_sm(&sm), m_st(0u), m_last(0u), m_buffer(sm.m_max_jump_cnt), m_stats(nullptr),
+      m_match_only(false), m_fed(0u), m_origin(nullptr), m_origin_offset(0u)
+{
+    if (!sm.is_compiled()) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "SequenceSM not compiled");
+    }
+    // NOTE 遗留字节 + 下一块开头，各不超过 m_max_jump_cnt 个
+    this->m_scratch.reserve(sm.m_max_jump_cnt * 2u);
+}
+
+inline void SequenceSM::Matcher::fire(size_t st, const char * match_end,
+                                      const char *& span, bool is_ref, Sink& out)
+{
+    const Table& table = this->m_sm->m_table;
+    const char * match_beg = match_end - table.m_depth[st];
+    if (this->m_stats && this->m_stats->m_locate) {
+        this->m_stats->m_spots.emplace_back(this->m_origin_offset + (match_beg - this->m_origin), uint32_t(st));
+    }
+    if (this->m_match_only) {
+        if (this->m_stats) {
+            this->m_stats->hit(st, (table.m_flags[st] & F_CALLBACK)
+                                   ? 0 : int64_t(table.m_value[st * 2 + 1]) - table.m_depth[st]);
+        }
+        span = match_end;
+        return;
+    }
+    if (span != match_beg) {
+        if (is_ref) {
+            out.write_ref(span, match_beg - span);
+        }
+        else {
+            out.write(span, match_beg - span);
+        }
+    }
+    if (!(table.m_flags[st] & F_CALLBACK)) {
+        // NOTE m_pool 与 SequenceSM 同寿命，可以按引用输出
+        out.write_ref(table.m_pool + table.m_value[st * 2], table.m_value[st * 2 + 1]);
+        if (this->m_stats) {
+            this->m_stats->hit(st, int64_t(table.m_value[st * 2 + 1]) - table.m_depth[st]);
+        }
+    }
+    else {
+        std::string value = this->m_sm->m_callbacks[table.m_value[st * 2]]();
+        out.write(value.data(), value.size());
+        if (this->m_stats) {
+            this->m_stats->hit(st, int64_t(value.size()) - table.m_depth[st]);
+        }
+    }
+    span = match_end;
+}
+
+// NOTE 匹配规则为"最左、最长"：从悬而未决部分的起点出发，尽量走得更远；
+// 途经的终态若还有更长的规则（F_PREFIX），先记在 last 中，不急于输出；
+//
+// 失配（即 next 不是 st 的直接子节点）时：
+// 1. 记有 last，则输出 last 对应的替换串，把 it 倒回该匹配的末尾，从 S0 继续；
+// 2. 否则，悬而未决部分头部的若干字节，已经不可能再作为匹配的起点——它们就是
+//    原样输出的字节，留在 span 中即可；这就相当于"从下一个字节重新开始匹配"；
+//    只有 F_RESCAN 状态例外：被丢弃的字节中间，可能藏有一条已经完整的规则，
+//    此时把 it 倒回悬而未决部分的第二个字节，从 S0 重新走一遍。
+const char * SequenceSM::Matcher::run_trie(const char * begin, const char * it, const char * end,
+                                           const char *& span, size_t stop, bool is_ref, Sink& out)
+{
+    const Table& table = this->m_sm->m_table;
+    if (table.m_backend == B_DOUBLE_ARRAY) {
+        return this->run_trie_impl<L_DOUBLE_ARRAY>(begin, it, end, span, stop, is_ref, out);
+    }
+    if (table.m_class_cnt == 256u) {
+        return this->run_trie_impl<L_DENSE>(begin, it, end, span, stop, is_ref, out);
+    }
+    return this->run_trie_impl<L_CLASSES>(begin, it, end, span, stop, is_ref, out);
+}
+
+template<SequenceSM::Matcher::Layout layout>
+const char * SequenceSM::Matcher::run_trie_impl(const char * begin, const char * it, const char * end,
+                                                const char *& span, size_t stop, bool is_ref, Sink& out)
+{
+    const Table& table = this->m_sm->m_table;
+    const uint8_t  * classes = table.m_classes;
+    const size_t     class_cnt = table.m_class_cnt;
+    const uint32_t * next  = table.m_next;
+    const uint32_t * depth = table.m_depth;
+    const uint8_t  * flags = table.m_flags;
+    const uint32_t * base  = table.m_base;
+    const uint32_t * check = table.m_check;
+    const uint32_t * fail  = table.m_fail;
+    const ByteScanner& scanner = this->m_sm->m_scanner;
+    size_t st = this->m_st;
+    size_t last = this->m_last;
+
+    while (it != end) {
+        if (stop && size_t(it - begin) >= stop + depth[st]) {
+            break;
+        }
+        if (!st) {
+            // NOTE 不能开始任何匹配的字节，原样留在 span 中，整段跳过
+            it = scanner.find(it, end);
+            if (it == end) {
+                break;
+            }
+        }
+        size_t next_st;
+        if (layout == L_DENSE) {
+            next_st = next[(st << 8) | uint8_t(*it)];
+        }
+        else if (layout == L_CLASSES) {
+            next_st = next[st * class_cnt + classes[uint8_t(*it)]];
+        }
+        else {
+            // NOTE 失败链接没有折叠进表：沿 fail 找到有该子节点的状态为止
+            for (size_t cur = st; ; cur = fail[cur]) {
+                next_st = base[cur] + uint8_t(*it);
+                if (check[next_st] == cur + 1u) {
+                    break;
+                }
+                if (!cur) {
+                    next_st = 0u;
+                    break;
+                }
+            }
+        }
+        if (depth[next_st] != depth[st] + 1) {
+            if (last) {
+                it -= depth[st] - depth[last];
+                this->fire(last, it, span, is_ref, out);
+                st = 0;
+                last = 0;
+                continue;
+            }
+            if (flags[st] & F_RESCAN) {
+                it -= depth[st] - 1;
+                st = 0;
+                continue;
+            }
+        }
+        ++it;
+        if (flags[next_st] & F_TERMINAL) {
+            if (flags[next_st] & F_PREFIX) {
+                last = next_st;
+                st = next_st;
+                continue;
+            }
+            this->fire(next_st, it, span, is_ref, out);
+            st = 0; // NOTE jump to init state
+            last = 0;
+        }
+        else {
+            st = next_st;
+        }
+    }
+    this->m_st = st;
+    this->m_last = last;
+    return it;
+}
+
+// NOTE 单码位规则集：合法码位的编码互不为前缀，也不以后续字节开头，所以
+// 处于 S0 的位置，要么是码位的首字节，要么是不合法的字节（不可能开始任何匹配，
+// 原样输出，从下一个字节继续）；首字节处解码、查表：
+//   - 终态：以该码位开头的规则只有这一条，直接输出；
+//   - 没有规则：整个码位原样输出——它的后续字节也不可能开始匹配；
+//   - defer：有以它开头的多码位规则，在该位置返回，由跳转表接手；
+// 这与跳转表逐字节走的结果相同。
+const char * SequenceSM::Matcher::run_codepoints(const char * begin, const char * it, const char * end,
+                                                 const char *& span, size_t stop, bool is_ref, Sink& out)
+{
+    const CodepointTable& codepoints = *this->m_sm->m_codepoints;
+    const ByteScanner& scanner = this->m_sm->m_scanner;
+    while (end - it >= 4) {
+        if (stop && size_t(it - begin) >= stop) {
+            break;
+        }
+        // NOTE 不是任何键首字节的字节（如 ts.rule 下的 ASCII），整段跳过
+        it = scanner.find(it, end);
+        if (end - it < 4) {
+            break;
+        }
+        uint32_t cp;
+        size_t len = CodepointTable::decode(it, cp);
+        if (!len) {
+            ++it;
+            continue;
+        }
+        uint32_t st = codepoints.find(cp);
+        if (st == CodepointTable::defer) {
+            break;
+        }
+        it += len;
+        if (st) {
+            this->fire(st, it, span, is_ref, out);
+        }
+    }
+    return it;
+}
+
+// NOTE 按码位查表，只在 S0 下进行；其余情形逐字节交给跳转表，走回 S0（且没有
+// 记下的最长匹配）后，再切换回来：跨块边界的半个码位、多码位规则（defer），
+// 以及块尾不足 4 字节的部分
+const char * SequenceSM::Matcher::run(const char * begin, const char * it, const char * end,
+                                      const char *& span, size_t stop, bool is_ref, Sink& out)
+{
+    if (!this->m_sm->codepoint_engine()) {
+        return this->run_trie(begin, it, end, span, stop, is_ref, out);
+    }
+    const uint32_t * depth = this->m_sm->m_table.m_depth;
+    while (it != end) {
+        if (stop && size_t(it - begin) >= stop + depth[this->m_st]) {
+            break;
+        }
+        if (!this->m_st && !this->m_last && end - it >= 4) {
+            const char * cp_end = this->run_codepoints(begin, it, end, span, stop, is_ref, out);
+            if (cp_end != it) {
+                it = cp_end;
+                continue;
             }
+            // NOTE 正好停在 defer 上
+        }
+        it = this->run_trie(begin, it, it + 1, span, stop, is_ref, out);
+    }
+    return it;
+}
+
+void SequenceSM::Matcher::feed(const char * data, size_t len, Sink& out)
+{
+    const uint32_t * depth = this->m_sm->m_table.m_depth;
+    const char * it = data;
+    const char * end = data + len;
+    const char * span = data;
+
+    if (!this->m_buffer.empty()) {
+        // NOTE 上一块遗留的字节，与本块开头拼接后单独处理；最长匹配不超过
+        // m_max_jump_cnt，所以拼接这么多字节，足以让遗留字节全部确定去向；
+        size_t carry = this->m_buffer.size();
+        size_t head = std::min(len, this->m_sm->m_max_jump_cnt);
+        this->m_scratch.assign(this->m_buffer.begin(), this->m_buffer.end());
+        this->m_scratch.append(data, head);
+        this->m_buffer.clear();
+
+        const char * s_beg = this->m_scratch.data();
+        const char * s_end = s_beg + this->m_scratch.size();
+        const char * s_span = s_beg;
+        this->set_origin(s_beg, this->m_fed - carry);
+        const char * s_it = this->run(s_beg, s_beg + carry, s_end, s_span, carry, false, out);
+        const char * pending = s_it - depth[this->m_st];
+        if (pending < s_beg + carry) {
+            // NOTE 本块太短，遗留字节仍未确定去向
+            if (s_span < pending && !this->m_match_only) {
+                out.write(s_span, pending - s_span);
+            }
+            this->m_buffer.assign(pending, s_end);
+            this->m_fed += len;
+            return;
+        }
+        if (s_span < pending && !this->m_match_only) {
+            out.write(s_span, pending - s_span);
+        }
+        it = data + (s_it - s_beg - carry);
+        span = data + (pending - s_beg - carry);
+    }
+
+    this->set_origin(data, this->m_fed);
+    it = this->run(data, it, end, span, 0u, true, out);
+    const char * pending = it - depth[this->m_st];
+    if (span < pending && !this->m_match_only) {
+        out.write_ref(span, pending - span);
+    }
+    this->m_buffer.assign(pending, end);
+    this->m_fed += len;
+}
+
+void SequenceSM::Matcher::finish(Sink& out)
+{
+    // NOTE 输入结束，相当于悬而未决的候选失配了：记下的最长匹配照常输出，
+    // F_RESCAN 同样需要重扫；两者之后剩下的字节，都要从 S0 再走一遍
+    const Table& table = this->m_sm->m_table;
+    this->m_scratch.assign(this->m_buffer.begin(), this->m_buffer.end());
+    this->m_buffer.clear();
+    const char * s_beg = this->m_scratch.data();
+    const char * s_end = s_beg + this->m_scratch.size();
+    const char * span = s_beg;
+    const char * it = s_end;
+    this->set_origin(s_beg, this->m_fed - this->m_scratch.size());
+    while (this->m_st) {
+        if (this->m_last) {
+            it -= table.m_depth[this->m_st] - table.m_depth[this->m_last];
+            this->fire(this->m_last, it, span, false, out);
+        }
+        else if (table.m_flags[this->m_st] & F_RESCAN) {
+            it -= table.m_depth[this->m_st] - 1;
+        }
+        else {
+            break;
         }
+        this->m_st = 0;
+        this->m_last = 0;
+        it = this->run(s_beg, it, s_end, span, 0u, false, out);
+    }
+    if (span != s_end && !this->m_match_only) {
+        out.write(span, s_end - span);
+    }
+    this->m_st = 0;
+    this->m_last = 0;
+}
+
+void SequenceSM::translate(std::istream& in, std::ostream& out)
+{
+    if (!this->m_compiled) {
+        this->compile();
+    }
+
+    Matcher matcher(*this);
+    OstreamSink sink(out);
+    char buffer[64 * 1024];
+    while (in.read(buffer, sizeof(buffer)) || in.gcount()) {
+        matcher.feed(buffer, in.gcount(), sink);
     }
-    dump2stream(out, buffer);
-    buffer.clear();
+    matcher.finish(sink);
 }
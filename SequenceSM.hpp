@@ -2,13 +2,22 @@
 #define __SEQUENCESM_HPP_1467713051__
 
 #include <cstdlib>
+#include <cstdint>
 #include <functional>
+#include <memory>
 
 #include <vector>
+#include <deque>
 #include <unordered_map>
 
+#include <string>
 #include <iostream>
 
+#include "ByteScanner.hpp"
+#include "TCircleBuffer.hpp"
+
+class CodepointTable;
+
 /**
  * @brief 基于字符序列的状态机；
  *        如果实在不行的话，还有退路，是二叉查找树；然后叶子节点保存动作(替换序
@@ -20,8 +29,9 @@ public:
     /**
      * @brief 状态对象；
      * 内部用唯一的ID值，以示区别；
-     * 同时，可以绑定动作；
-     * std::function<std::string(void)>
+     * 同时，可以绑定动作——通常是一个固定的替换串，存放在 m_value_pool 中，这
+     * 里只记录偏移与长度；少数需要动态生成替换串的场合，可以改用回调
+     * (k_callback)，此时 m_value_off 为 m_callbacks 的下标；
      */
     struct State
     {
@@ -44,20 +54,69 @@ public:
         // 另外，与之对比，std::map<> 需要key_type::operator<() const 函数。为什么？
         // 这是因为std::map<>内部是基于 rb-tree 的"有序"结构，必须区分大小关系；
         // 而 unordered_map<>，是基于hash杂凑，是无序的的存放方式；
-        size_t                       m_prev_index;
-        char                         m_prev_path;
-        size_t                       m_jump_cnt; // 距S0，多少条边的路径？
-        std::function<std::string()> m_action;
+        enum Kind {
+            k_none,
+            k_literal,
+            k_callback
+        };
+
+        uint32_t    m_prev_index;
+        uint32_t    m_jump_cnt; // 距S0，多少条边的路径？
+        uint32_t    m_value_off;
+        uint32_t    m_value_len;
+        char        m_prev_path;
+        uint8_t     m_kind;
 
         State()
-            : m_prev_index(0u), m_prev_path('\0'), m_jump_cnt(0u), m_action(nullptr)
+            : m_prev_index(0u), m_jump_cnt(0u), m_value_off(0u), m_value_len(0u),
+              m_prev_path('\0'), m_kind(k_none)
         {}
 
-        State(size_t prev_index, char prev_path, size_t jump_cnt = 0u, std::function<std::string()> action = nullptr)
-            : m_prev_index(prev_index), m_prev_path(prev_path), m_jump_cnt(jump_cnt), m_action(action)
+        State(size_t prev_index, char prev_path, size_t jump_cnt = 0u)
+            : m_prev_index(prev_index), m_jump_cnt(jump_cnt), m_value_off(0u), m_value_len(0u),
+              m_prev_path(prev_path), m_kind(k_none)
         {}
     };
 
+    typedef std::function<std::string()> Callback;
+
+    /**
+     * @brief 一条规则的键与动作；双数组后端整批建表时使用，不经过规则树
+     */
+    struct RuleKey
+    {
+        std::string m_key;
+        uint32_t    m_value_off;
+        uint32_t    m_value_len;
+        uint8_t     m_kind;     // State::Kind
+    };
+
+    /**
+     * @brief 指向外部内存的一条规则；add_sorted_rules() 的输入
+     */
+    struct RuleRef
+    {
+        const char *    m_key;
+        const char *    m_value;
+        uint32_t        m_key_len;
+        uint32_t        m_value_len;
+    };
+
+    /**
+     * @brief compile() 生成的表的形式：
+     *  B_DENSE         稠密跳转表（按字节等价类压缩列），失败链接折叠在表中；
+     *                  每个字节一次查表
+     *  B_DOUBLE_ARRAY  双数组 (base/check) trie，另存失败链接；整批从排好序的
+     *                  键建成，不经过 m_statuss/m_sm；失配时沿失败链接多走几步，
+     *                  换来每条边只占几个字节——用于上百万条规则的词典
+     */
+    enum Backend {
+        B_DENSE,
+        B_DOUBLE_ARRAY
+    };
+
+    static const char * backend_name(Backend backend);
+
     typedef std::pair<uint32_t, char>   sm_key_t;
 
     struct State_hash
@@ -67,6 +126,157 @@ public:
         }
     };
 
+    /**
+     * @brief 输出端；按连续的"段"输出，而不是逐字节输出；
+     *
+     * write()      数据只在调用期间有效，须立即写出或复制；
+     * write_ref()  数据指向调用方提供的输入块，或者编译后的替换串池；只要调用
+     *              方保证它们一直有效，Sink 可以只保存指针，推迟到 flush 时再
+     *              写出；
+     * flush()      此后，之前 write_ref() 的数据，就可以释放了；
+     */
+    class Sink
+    {
+    public:
+        virtual ~Sink() = default;
+        virtual void write(const char * data, size_t len) = 0;
+        virtual void write_ref(const char * data, size_t len)
+        {
+            this->write(data, len);
+        }
+        virtual void flush()
+        {
+        }
+    };
+
+    /**
+     * @brief 把输出段写入 std::ostream
+     */
+    class OstreamSink : public Sink
+    {
+    public:
+        explicit OstreamSink(std::ostream& out)
+            : m_out(out)
+        {}
+        void write(const char * data, size_t len) override
+        {
+            this->m_out.write(data, len);
+        }
+
+    private:
+        std::ostream& m_out;
+    };
+
+    /**
+     * @brief Matcher 的命中统计；按状态编号（即规则的终态）计数；
+     *        每个线程各用一份，互不加锁，结束后再 merge()；
+     *        只在命中时累加——逐字节的循环里，没有额外的开销；
+     *        state_cnt 为 0 时不按状态计数（m_hits 为空），只累计总数与 delta；
+     *        只要总数时（--scan、--skip-noop），省去每个文件分配、清零整个数组；
+     *        状态数超过 dense_limit 时，改用 m_sparse_hits 只记命中过的状态——
+     *        几十万条规则、几百万个状态时，每个文件一个稠密数组就是几十 MiB
+     *
+     *  m_delta   输出比输入多出的字节数（替换串长度减去键长，可为负）
+     *  m_log     为真时，另外按命中顺序记下 (状态, delta)，供 ChunkTranslator
+     *            在缝合时，扣除推测翻译中作废的那部分命中
+     *  m_locate  为真时，另外按命中顺序记下 (键在输入流中的起始偏移, 状态)，
+     *            供 --scan 报告位置；偏移从 Matcher 构造以来输入的第一个字节算起
+     */
+    struct MatchStats
+    {
+        enum { dense_limit = 65536 };
+
+        uint64_t                m_matches;
+        int64_t                 m_delta;
+        std::vector<uint64_t>   m_hits;
+        bool                    m_sparse;
+        std::unordered_map<uint32_t, uint64_t> m_sparse_hits;
+        bool                    m_log;
+        std::vector<std::pair<uint32_t, int64_t>> m_events;
+        bool                    m_locate;
+        std::vector<std::pair<uint64_t, uint32_t>> m_spots;
+
+        explicit MatchStats(size_t state_cnt = 0u)
+            : m_matches(0u), m_delta(0), m_hits(state_cnt <= dense_limit ? state_cnt : 0u, 0u),
+              m_sparse(state_cnt > dense_limit), m_log(false), m_locate(false)
+        {}
+
+        void hit(uint32_t st, int64_t delta)
+        {
+            ++this->m_matches;
+            this->m_delta += delta;
+            if (!this->m_hits.empty()) {
+                ++this->m_hits[st];
+            }
+            else if (this->m_sparse) {
+                ++this->m_sparse_hits[st];
+            }
+            if (this->m_log) {
+                this->m_events.emplace_back(st, delta);
+            }
+        }
+
+        void merge(const MatchStats& ref);
+
+        /**
+         * @brief 命中过的状态及其次数，按状态编号排序（稠密、稀疏两种计数合在
+         *        一起）
+         */
+        std::vector<std::pair<uint32_t, uint64_t>> rule_hits() const;
+
+        /**
+         * @brief 丢掉按状态的计数，释放其内存；总数与 delta 保留
+         */
+        void drop_hits();
+    };
+
+    class Matcher;
+
+    /**
+     * @brief 编译后的只读形式；
+     *        各数组可能来自 compile()，也可能直接映射自缓存文件(RuleCache)，
+     *        所以这里只保存指针；内存由 SequenceSM::m_table_storage 持有；
+     *
+     *  m_classes  字节等价类：256 项，输入字节 -> 类号；在所有状态下跳转都相同
+     *             的字节，归为同一类；
+     *  m_next   跳转表，按 state * m_class_cnt + m_classes[input] 索引；失败链
+     *           接已经预先折叠进去了——即，任意 (state, input) 都只需一次数组访
+     *           问；m_class_cnt 为 256 时，m_classes 是恒等映射（不压缩的稠密
+     *           布局），直接按 state * 256 + input 索引；
+     *  m_depth  同 State::m_jump_cnt；连续存放
+     *  m_flags  F_TERMINAL | F_RESCAN | F_CALLBACK | F_PREFIX
+     *  m_value  每个状态两项：替换串在 m_pool 中的偏移与长度
+     *  m_pool   所有替换串，首尾相接
+     *
+     *  m_backend 为 B_DOUBLE_ARRAY 时，没有 m_next（m_classes 为恒等映射），
+     *  状态编号即双数组的下标（空闲的下标，depth 与 flags 都为 0）：
+     *  m_base   子节点 = m_base[state] + (uint8_t)input；数组在最大的 base 之
+     *           后留有 256 项，不必检查越界
+     *  m_check  父节点 + 1；0 表示空闲
+     *  m_fail   失败链接
+     *
+     *  m_trained 非零：状态已按样本上的访问次数重新编号（renumber()）；否则
+     *           按键的字节序编号
+     */
+    struct Table
+    {
+        uint32_t            m_state_cnt;
+        uint32_t            m_max_jump_cnt;
+        uint32_t            m_class_cnt;
+        const uint8_t  *    m_classes;
+        const uint32_t *    m_next;
+        const uint32_t *    m_depth;
+        const uint8_t  *    m_flags;
+        const uint32_t *    m_value;
+        const char *        m_pool;
+        uint32_t            m_pool_size;
+        uint32_t            m_backend;
+        const uint32_t *    m_base;
+        const uint32_t *    m_check;
+        const uint32_t *    m_fail;
+        uint32_t            m_trained;
+    };
+
 protected:
     // uint32_t            m_init_id;
     // State               m_init_st;
@@ -79,6 +289,40 @@ protected:
 
     size_t  m_max_jump_cnt;
 
+    // NOTE 所有替换串，首尾相接存放；compile() 时整体复制为 Table::m_pool
+    std::string             m_value_pool;
+    std::vector<Callback>   m_callbacks;
+
+    // NOTE compile() 之后的"冻结"形式；只读，拷贝 SequenceSM 时共享
+    Table                       m_table;
+    std::shared_ptr<const void> m_table_storage;
+    bool                        m_compiled;
+
+    // NOTE S0 下能引起跳转的字节集合；其余字节，在 S0 下整段跳过
+    ByteScanner                 m_scanner;
+    // NOTE 是否有回调规则；与 m_scanner 一起，在表建好或换掉时统计一次
+    bool                        m_has_callbacks;
+
+    // NOTE 键全部是单个 UTF-8 码位时，compile()/adopt() 顺带建立；为空表示不适用
+    std::shared_ptr<const CodepointTable>   m_codepoints;
+    bool                                    m_use_codepoints;
+
+    bool                        m_use_classes;
+
+    Backend                     m_backend;
+    // NOTE 双数组后端：add_rule() 只把键记在这里，compile() 时整批建表
+    std::vector<RuleKey>        m_rule_keys;
+
+public:
+    enum StateFlag {
+        F_TERMINAL = 1u << 0,   // 带动作；命中即输出替换串，并跳回 S0
+        F_RESCAN   = 1u << 1,   // 路径上某前缀的真后缀，恰好是一条规则；
+                                // 失配时，不能直接丢弃字节，须逐字节重扫
+        F_CALLBACK = 1u << 2,   // 动作为回调；m_value 的偏移项为 m_callbacks 下标
+        F_PREFIX   = 1u << 3    // 终态，但还是更长规则的前缀；先记下，待更长的
+                                // 尝试失败后再输出（最长匹配）
+    };
+
 public:
     SequenceSM();
     ~SequenceSM() = default;
@@ -98,13 +342,277 @@ public:
      * @return 分支编号；0u，表示不存在
      */
     size_t find_jump(size_t from, char input) const;
-    // size_t ensure_jump(size_t from, char input);
-    size_t ensure_jump(size_t from, char input, const std::function<std::string()>& action = nullptr);
+
+    /**
+     * @brief 确保存在 from --input--> 的分支；不存在则新建；
+     *        带 value 的版本，以 value 作为该状态的替换串——分支已存在、且已
+     *        有动作时（重复的规则），保留原来的动作；
+     *
+     * @return 分支编号
+     */
+    size_t ensure_jump(size_t from, char input);
+    size_t ensure_jump(size_t from, char input, const std::string& value);
+
+    /**
+     * @brief 同 ensure_jump()，但替换串在每次命中时，调用 action 动态生成；
+     *        比固定替换串慢，且不能写入 RuleCache；
+     */
+    size_t ensure_jump_callback(size_t from, char input, const Callback& action);
+
+    /**
+     * @brief 加入一条规则；B_DENSE 时即沿 key 逐字节 ensure_jump()；
+     *        B_DOUBLE_ARRAY 时只记下键，compile() 时排序、建表；
+     *        键完全相同的规则，以先加入的为准
+     */
+    void add_rule(const std::string& key, const std::string& value);
+
+    /**
+     * @brief 整批加入规则；rules 须按键的字节序递增、键互不相同且非空（如
+     *        RuleLoader 的输出），否则抛出异常；
+     *        规则树为空时，与上一个键的公共前缀直接沿用路径上的状态，其余字节
+     *        直接新建——一遍建成，不逐字节查 hash 表；否则退回逐条 add_rule()
+     */
+    void add_sorted_rules(const std::vector<RuleRef>& rules);
+
+    /**
+     * @brief compile() 所用的后端（默认 B_DENSE）；须在 add_rule() 之前设置
+     */
+    void set_backend(Backend backend)
+    {
+        this->m_backend = backend;
+    }
+
+    Backend backend() const
+    {
+        return this->m_backend;
+    }
+
+    /**
+     * @brief 已编译的状态 st，输入 input 后到达的状态（含失败链接）；
+     *        供建表、统计等非热点的地方使用
+     */
+    uint32_t next_state(uint32_t st, uint8_t input) const;
+
+    /**
+     * @brief 将 m_statuss/m_sm 构成的规则树，冻结为带失败链接的稠密跳转表
+     *        (Aho-Corasick DFA)；B_DOUBLE_ARRAY 时改为整批建双数组；
+     *        ensure_jump() 之后，须重新 compile()；
+     */
+    void compile();
+
+    /**
+     * @brief compile() 时，是否按字节等价类压缩跳转表的列（默认压缩）；
+     *        类数超过 max_byte_classes 时，压缩不划算，仍用 256 列；
+     *        须在 compile() 之前设置——用于对比测试
+     */
+    void set_byte_classes(bool enable)
+    {
+        this->m_use_classes = enable;
+    }
+
+    enum { max_byte_classes = 128 };
+
+    bool is_compiled() const
+    {
+        return this->m_compiled;
+    }
+
+    const Table& table() const
+    {
+        return this->m_table;
+    }
+
+    /**
+     * @brief 直接采用外部（如映射自缓存文件的）已编译的跳转表；
+     *        storage 负责持有 table 所指向的内存；
+     *        此后规则树为空，不能再 ensure_jump()；
+     */
+    void adopt(const Table& table, std::shared_ptr<const void> storage);
+
+    /**
+     * @brief 指定跳过 S0 下无关字节时，所用的内核（默认按 CPU 自动选择）
+     */
+    void set_scan_kernel(ByteScanner::Kernel kernel)
+    {
+        this->m_scanner.set_kernel(kernel);
+    }
+
+    const ByteScanner& scanner() const
+    {
+        return this->m_scanner;
+    }
+
+    /**
+     * @brief 规则集适用时（见 CodepointTable），是否改用按码位查表的引擎；
+     *        默认使用；关闭后走通用的跳转表——用于对比测试
+     */
+    void set_codepoint_engine(bool enable)
+    {
+        this->m_use_codepoints = enable;
+    }
+
+    /**
+     * @brief 已编译的规则集中，是否有回调规则（F_CALLBACK）
+     */
+    bool has_callbacks() const
+    {
+        return this->m_has_callbacks;
+    }
+
+    /**
+     * @brief 当前是否在使用按码位查表的引擎
+     */
+    bool codepoint_engine() const
+    {
+        return this->m_use_codepoints && this->m_codepoints;
+    }
+
+    const CodepointTable * codepoints() const
+    {
+        return this->m_codepoints.get();
+    }
+
+    /**
+     * @brief 最长规则的字节数
+     */
+    size_t max_jump_cnt() const
+    {
+        return this->m_max_jump_cnt;
+    }
 
     void translate(std::istream& in, std::ostream& out);
 
+    /**
+     * @brief 在样本 data 上走一遍自动机，各状态的到达次数累加到 visits（大小
+     *        须为状态数）；与 Matcher 一样，S0 下跳过不能开始匹配的字节，命中
+     *        不再延长的终态后回到 S0——只为统计冷热，不处理最长匹配的回退；
+     *        可以多次调用，累加多个样本；分块调用时，把上一块返回的状态作为
+     *        st 传入
+     *
+     * @return 走完 data 时所在的状态
+     */
+    uint32_t count_visits(const char * data, size_t len, std::vector<uint64_t>& visits,
+                          uint32_t st = 0u) const;
+
+    /**
+     * @brief 按 visits 重新编号（只适用于稠密表）：S0 仍为 0，其后按到达次数从
+     *        多到少，每个状态之后紧跟它到达过的子节点（同样从多到少），使一起被
+     *        访问的行在跳转表中相邻；没有到达过的状态保持原来的相对顺序，排在
+     *        最后；
+     *        匹配结果不变，只是状态编号（--stats 中的 state）变了；此后规则树为
+     *        空，与 adopt() 之后相同
+     */
+    void renumber(const std::vector<uint64_t>& visits);
+
+    /**
+     * @brief 各终态对应的键（即规则的 to-match 串），按状态编号索引；非终态为
+     *        空串；
+     *        直接从跳转表还原——depth 恰好加一的跳转，就是规则树的边——所以对
+     *        adopt() 来的规则集同样有效
+     */
+    std::vector<std::string> terminal_keys() const;
+
+private:
+    void init_scanner();
+    void init_codepoints();
+    void compile_double_array();
+    size_t add_jump(size_t from, char input);
+};
+
+/**
+ * @brief 单个输入流的匹配现场；
+ *        SequenceSM 编译后只读，可以被多个 Matcher 共享；Matcher 自身保存当前
+ *        状态，以及跨越数据块边界、尚未确定去向的字节；
+ *
+ *        未发生替换的字节，以原输入块中的连续段的形式，整段交给 Sink；
+ */
+class SequenceSM::Matcher
+{
+public:
+    explicit Matcher(const SequenceSM& sm);
+
+public:
+    /**
+     * @brief 输入任意长度的数据块；
+     *        data 只需在本次调用期间有效——不能确定去向的尾部字节，会被复制保存；
+     */
+    void feed(const char * data, size_t len, Sink& out);
+
+    /**
+     * @brief 输入结束；输出保存着的尾部字节，并回到 S0
+     */
+    void finish(Sink& out);
+
+    /**
+     * @brief 命中时，累加到 stats；nullptr 表示不统计；
+     *        stats 的状态数须与规则集一致
+     */
+    void set_stats(MatchStats * stats)
+    {
+        this->m_stats = stats;
+    }
+
+    /**
+     * @brief 只找匹配、不产生输出：命中时只累加 stats，原样段与替换串都不交给
+     *        Sink，回调规则也不调用（delta 记为 0）；供 --scan 使用
+     */
+    void set_match_only(bool enable)
+    {
+        this->m_match_only = enable;
+    }
+
+    /**
+     * @brief 处于 S0，且没有悬而未决的字节——此后的输出，与之前的输入无关
+     */
+    bool idle() const
+    {
+        return !this->m_st && this->m_buffer.empty();
+    }
+
+private:
+    // NOTE 在 [begin, end) 上运行状态机；it 之前、span 之后的字节，尚未输出；
+    // 其中 [it - depth(st), it) 是悬而未决的部分；
+    // 若 stop 非零，则一旦悬而未决部分的起点越过 begin + stop，即返回；
+    // is_ref 表示 [begin, end) 是调用方的输入块，原样段可以用 write_ref() 输出；
+    // 按规则集选择下面两种实现之一（或先后使用）
+    const char * run(const char * begin, const char * it, const char * end,
+                     const char *& span, size_t stop, bool is_ref, Sink& out);
+    const char * run_trie(const char * begin, const char * it, const char * end,
+                          const char *& span, size_t stop, bool is_ref, Sink& out);
+    // NOTE 三种布局：不压缩的稠密表（行号移位即得，省去查类号）、按字节等价
+    // 类压缩的稠密表、双数组
+    enum Layout { L_DENSE, L_CLASSES, L_DOUBLE_ARRAY };
+    template<Layout layout>
+    const char * run_trie_impl(const char * begin, const char * it, const char * end,
+                               const char *& span, size_t stop, bool is_ref, Sink& out);
+    // NOTE 只在 S0 下调用；逐个码位查表，剩下不足 4 字节或到达 stop 时返回，
+    // 返回时仍处于 S0
+    const char * run_codepoints(const char * begin, const char * it, const char * end,
+                                const char *& span, size_t stop, bool is_ref, Sink& out);
+
+    // NOTE 输出 span 到匹配起点之间的原样字节，以及状态 st 的替换串
+    void fire(size_t st, const char * match_end, const char *& span, bool is_ref, Sink& out);
+
+    // NOTE 此后 run() 所见的字节 p，在输入流中的偏移为 offset + (p - base)
+    void set_origin(const char * base, uint64_t offset)
+    {
+        this->m_origin = base;
+        this->m_origin_offset = offset;
+    }
+
 private:
-    
+    const SequenceSM *  m_sm;
+    size_t              m_st;
+    size_t              m_last;     // 已完成的最长匹配（终态）；0 表示没有
+    // NOTE 上一数据块末尾，悬而未决的字节；不会超过最长规则的长度，所以容量
+    // 在构造时一次分配，此后不再增长
+    TCircleBuffer<char> m_buffer;
+    std::string         m_scratch;
+    MatchStats *        m_stats;
+    bool                m_match_only;
+    uint64_t            m_fed;              // 已经 feed() 的字节数
+    const char *        m_origin;
+    uint64_t            m_origin_offset;
 };
 
 
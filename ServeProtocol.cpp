@@ -0,0 +1,266 @@
+#include "ServeProtocol.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <sss/util/PostionThrow.hpp>
+
+namespace  {
+    enum { header_size = 5, max_fds = 2 };
+
+    void send_all(int sock, const char * data, size_t len)
+    {
+        while (len) {
+            ssize_t ret = ::send(sock, data, len, MSG_NOSIGNAL);
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                SSS_POSTION_THROW(std::runtime_error,
+                                  "send failed: " << std::strerror(errno));
+            }
+            data += ret;
+            len -= ret;
+        }
+    }
+
+    void take_fds(struct msghdr& msg, std::vector<int> * fds)
+    {
+        for (struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+                continue;
+            }
+            size_t cnt = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int * data = reinterpret_cast<const int *>(CMSG_DATA(cmsg));
+            for (size_t i = 0; i < cnt; ++i) {
+                int fd;
+                std::memcpy(&fd, data + i, sizeof(int));
+                if (fds) {
+                    fds->push_back(fd);
+                }
+                else {
+                    ::close(fd);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief 读满 len 字节；一开始就遇到 EOF 返回 false，读到一半遇到 EOF 抛出
+     */
+    bool recv_all(int sock, char * data, size_t len, std::vector<int> * fds)
+    {
+        size_t got = 0u;
+        while (got < len) {
+            union {
+                char            m_buf[CMSG_SPACE(max_fds * sizeof(int))];
+                struct cmsghdr  m_align;
+            } control;
+            struct iovec iov;
+            iov.iov_base = data + got;
+            iov.iov_len = len - got;
+            struct msghdr msg;
+            std::memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control.m_buf;
+            msg.msg_controllen = sizeof(control.m_buf);
+            ssize_t ret = ::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                SSS_POSTION_THROW(std::runtime_error,
+                                  "recv failed: " << std::strerror(errno));
+            }
+            ::take_fds(msg, fds);
+            if (ret == 0) {
+                if (got == 0u) {
+                    return false;
+                }
+                SSS_POSTION_THROW(std::runtime_error,
+                                  "connection closed in the middle of a frame");
+            }
+            got += ret;
+        }
+        return true;
+    }
+
+    void close_all(std::vector<int>& fds)
+    {
+        for (int fd : fds) {
+            ::close(fd);
+        }
+        fds.clear();
+    }
+} // namespace
+
+namespace serve {
+
+void send_frame(int sock, char tag, const std::string& payload, const int * fds, size_t fd_cnt)
+{
+    if (payload.size() > max_frame || fd_cnt > max_fds) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "frame `" << tag << "` too large");
+    }
+    std::string frame(header_size, '\0');
+    frame[0] = tag;
+    uint32_t len = payload.size();
+    for (int i = 0; i < 4; ++i) {
+        frame[1 + i] = char((len >> (8 * i)) & 0xFFu);
+    }
+    frame += payload;
+    if (!fd_cnt) {
+        ::send_all(sock, frame.data(), frame.size());
+        return;
+    }
+
+    // NOTE 描述符随第一个字节到达；剩下的部分照常发送
+    union {
+        char            m_buf[CMSG_SPACE(max_fds * sizeof(int))];
+        struct cmsghdr  m_align;
+    } control;
+    std::memset(&control, 0, sizeof(control));
+    struct iovec iov;
+    iov.iov_base = &frame[0];
+    iov.iov_len = frame.size();
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.m_buf;
+    msg.msg_controllen = CMSG_SPACE(fd_cnt * sizeof(int));
+    struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(fd_cnt * sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), fds, fd_cnt * sizeof(int));
+    ssize_t ret;
+    do {
+        ret = ::sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "sendmsg failed: " << std::strerror(errno));
+    }
+    ::send_all(sock, frame.data() + ret, frame.size() - ret);
+}
+
+bool recv_frame(int sock, char& tag, std::string& payload, std::vector<int> * fds)
+{
+    char header[header_size];
+    if (!::recv_all(sock, header, header_size, fds)) {
+        return false;
+    }
+    tag = header[0];
+    uint32_t len = 0u;
+    for (int i = 0; i < 4; ++i) {
+        len |= uint32_t(uint8_t(header[1 + i])) << (8 * i);
+    }
+    if (len > max_frame) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "frame `" << tag << "` too large: " << len);
+    }
+    payload.resize(len);
+    if (len && !::recv_all(sock, &payload[0], len, fds)) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "connection closed in the middle of a frame");
+    }
+    return true;
+}
+
+void send_request(int sock, const Request& req)
+{
+    send_frame(sock, T_VERSION, std::to_string(int(version)));
+    send_frame(sock, T_RULE, req.m_rule_path);
+    std::string options;
+    if (req.m_replace) {
+        options += 'r';
+    }
+    if (req.m_fsync) {
+        options += 'f';
+    }
+    if (req.m_mmap) {
+        options += 'm';
+    }
+    if (req.m_stats) {
+        options += 's';
+    }
+    if (req.m_skip_noop) {
+        options += 'n';
+    }
+    send_frame(sock, T_OPTIONS, options);
+    if (req.is_pipe()) {
+        int fds[2] = {req.m_in_fd, req.m_out_fd};
+        send_frame(sock, T_PIPE, "", fds, 2u);
+    }
+    for (const auto& target : req.m_targets) {
+        send_frame(sock, T_TARGET, target);
+    }
+    send_frame(sock, T_END, "");
+}
+
+void recv_request(int sock, Request& req)
+{
+    char tag;
+    std::string payload;
+    std::vector<int> fds;
+    if (!recv_frame(sock, tag, payload) || tag != T_VERSION || payload != std::to_string(int(version))) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "protocol version mismatch");
+    }
+    while (true) {
+        try {
+            if (!recv_frame(sock, tag, payload, &fds)) {
+                SSS_POSTION_THROW(std::runtime_error,
+                                  "connection closed before the end of request");
+            }
+        }
+        catch (...) {
+            ::close_all(fds);
+            throw;
+        }
+        if (tag == T_END) {
+            break;
+        }
+        switch (tag) {
+        case T_RULE:
+            req.m_rule_path = payload;
+            break;
+
+        case T_OPTIONS:
+            req.m_replace = payload.find('r') != std::string::npos;
+            req.m_fsync = payload.find('f') != std::string::npos;
+            req.m_mmap = payload.find('m') != std::string::npos;
+            req.m_stats = payload.find('s') != std::string::npos;
+            req.m_skip_noop = payload.find('n') != std::string::npos;
+            break;
+
+        case T_TARGET:
+            req.m_targets.push_back(payload);
+            break;
+
+        case T_PIPE:
+            if (fds.size() == 2u && !req.is_pipe()) {
+                req.m_in_fd = fds[0];
+                req.m_out_fd = fds[1];
+                fds.clear();
+                break;
+            }
+            // fall through
+
+        default:
+            ::close_all(fds);
+            SSS_POSTION_THROW(std::runtime_error,
+                              "unexpected frame `" << tag << "`");
+        }
+        // NOTE 只有 'p' 帧可以附带描述符
+        ::close_all(fds);
+    }
+}
+
+} // namespace serve
@@ -0,0 +1,89 @@
+#ifndef __SERVEPROTOCOL_HPP_1468387201__
+#define __SERVEPROTOCOL_HPP_1468387201__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief --serve 守护进程与 --client 之间的协议；只走 Unix domain socket；
+ *
+ *  报文是一串帧：[tag:1][len:4，小端][payload:len]；
+ *
+ *  请求（client -> server）：
+ *      'v' 协议版本；必须是第一帧
+ *      'r' 规则文件路径；由客户端按命令行的规则解析为绝对路径
+ *      'o' 选项，每个字符一项：r 覆盖原文件；f fsync；m mmap；s 统计；
+ *          n 没有匹配的文件不写（--skip-noop）
+ *      't' 目标文件的绝对路径；可以有多个
+ *      'p' 管道模式：随帧以 SCM_RIGHTS 附带两个描述符（输入、输出），由服务端
+ *          直接读写——数据不经过 socket；与 't' 互斥
+ *      'e' 请求结束
+ *
+ *  应答（server -> client）：
+ *      'l' 日志文本（一个文件一帧，整段打印）
+ *      's' 统计（JSON）
+ *      'x' 结束，payload 为 "0"（全部成功）或 "1"
+ */
+namespace serve {
+    enum { version = 1 };
+
+    enum Tag {
+        T_VERSION   = 'v',
+        T_RULE      = 'r',
+        T_OPTIONS   = 'o',
+        T_TARGET    = 't',
+        T_PIPE      = 'p',
+        T_END       = 'e',
+
+        T_LOG       = 'l',
+        T_STATS     = 's',
+        T_EXIT      = 'x'
+    };
+
+    // NOTE 单帧上限；路径与日志都远小于它，防止对端发来离谱的长度
+    enum { max_frame = 16 * 1024 * 1024 };
+
+    /**
+     * @brief 一次请求；客户端填写后 send_request()，服务端 recv_request()
+     */
+    struct Request
+    {
+        std::string                 m_rule_path;
+        bool                        m_replace = false;
+        bool                        m_fsync = false;
+        bool                        m_mmap = false;
+        bool                        m_stats = false;
+        bool                        m_skip_noop = false;
+        std::vector<std::string>    m_targets;
+        // NOTE 管道模式的输入、输出描述符；不用时为 -1
+        int                         m_in_fd = -1;
+        int                         m_out_fd = -1;
+
+        bool is_pipe() const
+        {
+            return this->m_in_fd != -1;
+        }
+    };
+
+    /**
+     * @brief 发送一帧；fds 非空时，以 SCM_RIGHTS 随帧附带；失败抛出异常
+     */
+    void send_frame(int sock, char tag, const std::string& payload,
+                    const int * fds = nullptr, size_t fd_cnt = 0u);
+
+    /**
+     * @brief 接收一帧；对端正常关闭（帧边界处）返回 false；随帧附带的描述符追
+     *        加到 fds（为空时直接关闭）；其他失败抛出异常
+     */
+    bool recv_frame(int sock, char& tag, std::string& payload, std::vector<int> * fds = nullptr);
+
+    void send_request(int sock, const Request& req);
+    /**
+     * @brief 收到的描述符归 req 所有，由调用方关闭
+     */
+    void recv_request(int sock, Request& req);
+} // namespace serve
+
+
+#endif /* __SERVEPROTOCOL_HPP_1468387201__ */
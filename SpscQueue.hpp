@@ -0,0 +1,107 @@
+#ifndef __SPSCQUEUE_HPP_1468547613__
+#define __SPSCQUEUE_HPP_1468547613__
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief 单生产者、单消费者的有界无锁队列；
+ *
+ *  m_head 只由消费者写，m_tail 只由生产者写；各自用 release 发布，对方用
+ *  acquire 读取，不需要锁；容量固定，构造后不再分配；
+ *
+ *  NOTE 与 TCircleBuffer 一样，多留一个空位区分满与空；
+ *       push()/pop() 不阻塞；wait_push()/wait_pop() 先自旋，再让出 CPU，最后
+ *       短暂休眠——一端明显慢于另一端时，等待的一方不至于空转占满一个核；
+ *       cancel 变为 true 时，等待立即返回 false；
+ *
+ * @tparam T 须可廉价复制（通常是指针）
+ */
+template<typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(size_t capacity)
+        : m_slots(capacity + 1u), m_head(0u), m_tail(0u)
+    {}
+
+public:
+    SpscQueue(const SpscQueue& ) = delete;
+    SpscQueue& operator = (const SpscQueue& ) = delete;
+
+public:
+    bool push(const T& value)
+    {
+        const size_t tail = this->m_tail.load(std::memory_order_relaxed);
+        const size_t next = this->advance(tail);
+        if (next == this->m_head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        this->m_slots[tail] = value;
+        this->m_tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value)
+    {
+        const size_t head = this->m_head.load(std::memory_order_relaxed);
+        if (head == this->m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = this->m_slots[head];
+        this->m_head.store(this->advance(head), std::memory_order_release);
+        return true;
+    }
+
+    bool wait_push(const T& value, const std::atomic<bool>& cancel)
+    {
+        for (size_t round = 0; !this->push(value); ++round) {
+            if (cancel.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            SpscQueue::backoff(round);
+        }
+        return true;
+    }
+
+    bool wait_pop(T& value, const std::atomic<bool>& cancel)
+    {
+        for (size_t round = 0; !this->pop(value); ++round) {
+            if (cancel.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            SpscQueue::backoff(round);
+        }
+        return true;
+    }
+
+private:
+    size_t advance(size_t index) const
+    {
+        return index + 1u == this->m_slots.size() ? 0u : index + 1u;
+    }
+
+    static void backoff(size_t round)
+    {
+        if (round < 64u) {
+            return;
+        }
+        if (round < 128u) {
+            std::this_thread::yield();
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+private:
+    std::vector<T>      m_slots;
+    // NOTE 分处不同的缓存行，免得两个线程互相作废对方的缓存
+    alignas(64) std::atomic<size_t> m_head;
+    alignas(64) std::atomic<size_t> m_tail;
+};
+
+
+#endif /* __SPSCQUEUE_HPP_1468547613__ */
@@ -7,6 +7,8 @@
 #include <cstddef>
 #include <iterator>
 #include <utility>
+#include <new>
+#include <type_traits>
 
 /**
  * @brief FIFO 循环队列；
@@ -21,6 +23,8 @@
  *       就是说，实际分配了 m_capacity + 1大小的空间；但最多，只使用
  *       其中的 m_capacity 个；
  *
+ *  NOTE 空间只在构造时分配一次；写满后 push() 返回 false，不会扩容；
+ *
  * @tparam T
  */
 template<typename T>
@@ -46,12 +50,57 @@ public:
     }
 
 public:
-    TCircleBuffer(TCircleBuffer&& ) = default;
-    TCircleBuffer& operator = (TCircleBuffer&& ) = default;
+    TCircleBuffer(TCircleBuffer&& ref) noexcept
+        : m_buffer(ref.m_buffer)
+        , m_capacity(ref.m_capacity)
+        , m_read_index(ref.m_read_index)
+        , m_write_index(ref.m_write_index)
+    {
+        ref.m_buffer = nullptr;
+        ref.m_capacity = 0u;
+        ref.m_read_index = ref.m_write_index = 0u;
+    }
+    TCircleBuffer& operator = (TCircleBuffer&& ref) noexcept
+    {
+        if (this != &ref) {
+            this->clear();
+            delete [] reinterpret_cast<char*>(m_buffer);
+            m_buffer = ref.m_buffer;
+            m_capacity = ref.m_capacity;
+            m_read_index = ref.m_read_index;
+            m_write_index = ref.m_write_index;
+            ref.m_buffer = nullptr;
+            ref.m_capacity = 0u;
+            ref.m_read_index = ref.m_write_index = 0u;
+        }
+        return *this;
+    }
 
 public:
-    TCircleBuffer(const TCircleBuffer& ) = delete;
-    TCircleBuffer& operator = (const TCircleBuffer& ) = delete;
+    // NOTE 复制得到同样容量、同样内容的队列（用于复制匹配现场）
+    TCircleBuffer(const TCircleBuffer& ref)
+        : TCircleBuffer(ref.m_capacity)
+    {
+        for (const_iterator it = ref.begin(); it != ref.end(); ++it) {
+            this->push(*it);
+        }
+    }
+    TCircleBuffer& operator = (const TCircleBuffer& ref)
+    {
+        if (this != &ref) {
+            if (this->m_capacity != ref.m_capacity) {
+                TCircleBuffer tmp(ref);
+                *this = std::move(tmp);
+            }
+            else {
+                this->clear();
+                for (const_iterator it = ref.begin(); it != ref.end(); ++it) {
+                    this->push(*it);
+                }
+            }
+        }
+        return *this;
+    }
 
 protected:
     size_t shift_index(size_t index) const
@@ -62,7 +111,11 @@ protected:
 public:
     size_t   size() const
     {
-        return (m_read_index > m_write_index ? m_write_index + m_capacity : m_write_index) - m_read_index;
+        return (m_read_index > m_write_index ? m_write_index + m_capacity + 1 : m_write_index) - m_read_index;
+    }
+    size_t   capacity() const
+    {
+        return m_capacity;
     }
     bool empty() const
     {
@@ -92,7 +145,7 @@ public:
         // TODO 越界检查
         size_t true_idx = m_read_index + idx;
         if (true_idx > m_capacity) {
-            true_idx -= m_capacity;
+            true_idx -= m_capacity + 1;
         }
         return m_buffer[true_idx];
     }
@@ -116,7 +169,7 @@ public:
         // TODO 越界检查
         size_t true_idx = m_read_index + idx;
         if (true_idx > m_capacity) {
-            true_idx -= m_capacity;
+            true_idx -= m_capacity + 1;
         }
         return m_buffer[true_idx];
     }
@@ -129,7 +182,7 @@ public:
     template
     <
         typename Type,
-        typename UnqualifiedType = std::remove_cv<Type>
+        typename UnqualifiedType = typename std::remove_cv<Type>::type
     >
     class InnerIterator
         : public std::iterator<std::bidirectional_iterator_tag,
@@ -172,7 +225,7 @@ public:
             return *this;
         }
 
-        InnerIterator& operator++(int)
+        InnerIterator operator++(int)
         {
             assert(m_cb != nullptr && "nullptr");
             InnerIterator tmp = *this;
@@ -180,16 +233,28 @@ public:
             return tmp;
         }
 
-        template<typename OtherType>
-            bool operator == (const InnerIterator<OtherType>& rhs)
-            {
-                return this->m_cb == rhs.m_cb && this->m_idx == rhs.m_idx;
-            }
-        template<typename OtherType>
-            bool operator != (const InnerIterator<OtherType>& rhs)
-            {
-                return this->m_cb != rhs.m_cb || this->m_idx != rhs.m_idx;
-            }
+        InnerIterator& operator--()
+        {
+            assert(m_cb != nullptr && "nullptr");
+            m_idx = m_idx ? m_idx - 1 : m_cb->m_capacity;
+            return *this;
+        }
+
+        InnerIterator operator--(int)
+        {
+            InnerIterator tmp = *this;
+            --*this;
+            return tmp;
+        }
+
+        bool operator == (const InnerIterator& rhs) const
+        {
+            return this->m_cb == rhs.m_cb && this->m_idx == rhs.m_idx;
+        }
+        bool operator != (const InnerIterator& rhs) const
+        {
+            return this->m_cb != rhs.m_cb || this->m_idx != rhs.m_idx;
+        }
 
         Type& operator* () const
         {
@@ -214,20 +279,20 @@ public:
 
     iterator begin()
     {
-        return iterator(*this);
+        return iterator(this);
     }
     const_iterator begin() const
     {
-        return const_iterator(*this);
+        return const_iterator(const_cast<TCircleBuffer*>(this));
     }
 
     iterator end()
     {
-        return iterator(*this, true);
+        return iterator(this, true);
     }
     const_iterator end() const
     {
-        return const_iterator(*this, true);
+        return const_iterator(const_cast<TCircleBuffer*>(this), true);
     }
 
     bool pop()
@@ -237,6 +302,7 @@ public:
         }
         (m_buffer + m_read_index)->~T();
         m_read_index = this->shift_index(m_read_index);
+        return true;
     }
     bool push(const T& value)
     {
@@ -245,14 +311,32 @@ public:
         }
         new (m_buffer + m_write_index) T(value);
         m_write_index = this->shift_index(m_write_index);
+        return true;
+    }
+
+    /**
+     * @brief 清空后，依次放入 [first, last)；超出容量的部分被丢弃
+     *
+     * @return 是否全部放入
+     */
+    template<typename InputIt>
+    bool assign(InputIt first, InputIt last)
+    {
+        this->clear();
+        for (; first != last; ++first) {
+            if (!this->push(*first)) {
+                return false;
+            }
+        }
+        return true;
     }
 
     void clear()
     {
-        for (size_t i = m_read_index; shift_index(i) != m_write_index; i = shift_index(i)) {
+        for (size_t i = m_read_index; i != m_write_index; i = shift_index(i)) {
             (m_buffer + i)->~T();
         }
-        m_write_index = m_read_index;
+        m_read_index = m_write_index = 0u;
     }
 
 private:
@@ -0,0 +1,81 @@
+#include "TaskScheduler.hpp"
+
+#include <thread>
+
+TaskScheduler::TaskScheduler(size_t worker_cnt)
+    : m_worker_cnt(worker_cnt ? worker_cnt : hardware_concurrency())
+{
+    for (size_t i = 0; i < this->m_worker_cnt; ++i) {
+        this->m_queues.emplace_back(new Queue);
+    }
+}
+
+size_t TaskScheduler::hardware_concurrency()
+{
+    size_t cnt = std::thread::hardware_concurrency();
+    return cnt ? cnt : 1u;
+}
+
+bool TaskScheduler::pop(size_t self, Task& task)
+{
+    {
+        Queue& own = *this->m_queues[self];
+        std::lock_guard<std::mutex> lock(own.m_mutex);
+        if (!own.m_tasks.empty()) {
+            task = std::move(own.m_tasks.front());
+            own.m_tasks.pop_front();
+            return true;
+        }
+    }
+    // NOTE 任务全部在 run() 开始前就分配好了，不会再有新任务加入；所以，绕一圈
+    // 都偷不到，就可以退出了
+    for (size_t i = 1; i < this->m_worker_cnt; ++i) {
+        Queue& victim = *this->m_queues[(self + i) % this->m_worker_cnt];
+        std::lock_guard<std::mutex> lock(victim.m_mutex);
+        if (!victim.m_tasks.empty()) {
+            task = std::move(victim.m_tasks.back());
+            victim.m_tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskScheduler::work(size_t self)
+{
+    Task task;
+    while (this->pop(self, task)) {
+        try {
+            task();
+        }
+        catch (...) {
+        }
+    }
+}
+
+void TaskScheduler::run(std::vector<Task> tasks)
+{
+    if (this->m_worker_cnt == 1) {
+        for (auto& task : tasks) {
+            try {
+                task();
+            }
+            catch (...) {
+            }
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        this->m_queues[i % this->m_worker_cnt]->m_tasks.push_back(std::move(tasks[i]));
+    }
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < this->m_worker_cnt; ++i) {
+        workers.emplace_back(&TaskScheduler::work, this, i);
+    }
+    this->work(0);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef __TASKSCHEDULER_HPP_1467988410__
+#define __TASKSCHEDULER_HPP_1467988410__
+
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <vector>
+
+/**
+ * @brief 固定数目工作线程的 work-stealing 调度器；
+ *        每个 worker 拥有自己的任务队列；自己的队列空了，就从别人的队列里偷；
+ *
+ *        任务不应抛出异常——调度器只负责兜底，吞掉逃逸的异常，以免影响其他任务；
+ */
+class TaskScheduler
+{
+public:
+    typedef std::function<void()> Task;
+
+public:
+    explicit TaskScheduler(size_t worker_cnt);
+    ~TaskScheduler() = default;
+
+public:
+    TaskScheduler(const TaskScheduler& ) = delete;
+    TaskScheduler& operator = (const TaskScheduler& ) = delete;
+
+public:
+    /**
+     * @brief 运行全部任务，直到完成；
+     *        tasks 应按优先级从高到低排列（比如文件从大到小）——轮流分配到各个
+     *        队列后，worker 总是从自己队列的头部取，即先做最重的；偷的时候，则
+     *        从别人队列的尾部取，与队列主人错开；
+     *        worker_cnt 为 1 时，直接在当前线程按顺序执行；
+     */
+    void run(std::vector<Task> tasks);
+
+    size_t worker_cnt() const
+    {
+        return this->m_worker_cnt;
+    }
+
+    static size_t hardware_concurrency();
+
+private:
+    struct Queue
+    {
+        std::mutex          m_mutex;
+        std::deque<Task>    m_tasks;
+    };
+
+    bool pop(size_t self, Task& task);
+    void work(size_t self);
+
+private:
+    size_t                              m_worker_cnt;
+    std::vector<std::unique_ptr<Queue>> m_queues;
+};
+
+
+#endif /* __TASKSCHEDULER_HPP_1467988410__ */
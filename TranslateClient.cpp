@@ -0,0 +1,70 @@
+#include "TranslateClient.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <sss/util/PostionThrow.hpp>
+
+TranslateClient::TranslateClient(const std::string& socket_path)
+    : m_fd(-1)
+{
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(addr.sun_path)) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "invalid socket path `" << socket_path << "`");
+    }
+    std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1u);
+    this->m_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (this->m_fd == -1) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "socket failed: " << std::strerror(errno));
+    }
+    if (::connect(this->m_fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0) {
+        int err = errno;
+        ::close(this->m_fd);
+        this->m_fd = -1;
+        SSS_POSTION_THROW(std::runtime_error,
+                          "unable to connect to `" << socket_path << "`: " << std::strerror(err));
+    }
+}
+
+TranslateClient::~TranslateClient()
+{
+    if (this->m_fd != -1) {
+        ::close(this->m_fd);
+    }
+}
+
+bool TranslateClient::run(const serve::Request& req, std::ostream& log, std::string& stats_json)
+{
+    serve::send_request(this->m_fd, req);
+    char tag;
+    std::string payload;
+    while (serve::recv_frame(this->m_fd, tag, payload)) {
+        switch (tag) {
+        case serve::T_LOG:
+            log << payload << std::flush;
+            break;
+
+        case serve::T_STATS:
+            stats_json.swap(payload);
+            break;
+
+        case serve::T_EXIT:
+            return payload == "0";
+
+        default:
+            SSS_POSTION_THROW(std::runtime_error,
+                              "unexpected frame `" << tag << "` from server");
+        }
+    }
+    SSS_POSTION_THROW(std::runtime_error,
+                      "server closed the connection");
+}
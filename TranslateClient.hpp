@@ -0,0 +1,37 @@
+#ifndef __TRANSLATECLIENT_HPP_1468387862__
+#define __TRANSLATECLIENT_HPP_1468387862__
+
+#include <ostream>
+#include <string>
+
+#include "ServeProtocol.hpp"
+
+/**
+ * @brief --client：把命令行解析出的请求交给 --serve 守护进程执行；
+ *        一个对象对应一个连接、一次请求
+ */
+class TranslateClient
+{
+public:
+    explicit TranslateClient(const std::string& socket_path);
+    ~TranslateClient();
+
+public:
+    TranslateClient(const TranslateClient& ) = delete;
+    TranslateClient& operator = (const TranslateClient& ) = delete;
+
+public:
+    /**
+     * @brief 发送请求并等待完成；服务端发回的日志写到 log，统计（请求了的话）
+     *        存入 stats_json；
+     *
+     * @return 服务端报告全部成功时为 true
+     */
+    bool run(const serve::Request& req, std::ostream& log, std::string& stats_json);
+
+private:
+    int m_fd;
+};
+
+
+#endif /* __TRANSLATECLIENT_HPP_1468387862__ */
@@ -0,0 +1,343 @@
+#include "TranslateServer.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <sss/util/PostionThrow.hpp>
+
+#include "EmbeddedRules.hpp"
+#include "RunStats.hpp"
+#include "TaskScheduler.hpp"
+
+namespace  {
+    volatile std::sig_atomic_t stop_requested = 0;
+
+    void on_stop_signal(int )
+    {
+        stop_requested = 1;
+    }
+
+    // NOTE 不设 SA_RESTART：让阻塞中的系统调用尽快返回
+    void install_signal_handlers()
+    {
+        struct sigaction sa;
+        std::memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = ::on_stop_signal;
+        sigemptyset(&sa.sa_mask);
+        ::sigaction(SIGINT, &sa, nullptr);
+        ::sigaction(SIGTERM, &sa, nullptr);
+        // NOTE 管道模式下，客户端提前退出，写它的 stdout 会触发 SIGPIPE
+        std::signal(SIGPIPE, SIG_IGN);
+    }
+
+    void fill_address(struct sockaddr_un& addr, const std::string& path)
+    {
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              "invalid socket path `" << path << "`");
+        }
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1u);
+    }
+
+    /**
+     * @brief 上次异常退出留下的 socket 文件：连不上就删掉；连得上说明已有服务
+     *        在运行
+     */
+    void remove_stale_socket(const std::string& path)
+    {
+        struct stat st;
+        if (::lstat(path.c_str(), &st) != 0) {
+            return;
+        }
+        if (!S_ISSOCK(st.st_mode)) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              "`" << path << "` exists and is not a socket");
+        }
+        struct sockaddr_un addr;
+        ::fill_address(addr, path);
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              "socket failed: " << std::strerror(errno));
+        }
+        int ret = ::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+        ::close(fd);
+        if (ret == 0) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              "another server is listening on `" << path << "`");
+        }
+        ::unlink(path.c_str());
+    }
+
+    bool same_user(int sock)
+    {
+        struct ucred cred;
+        socklen_t len = sizeof(cred);
+        if (::getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+            return false;
+        }
+        return cred.uid == ::geteuid();
+    }
+
+    void close_fd(int& fd)
+    {
+        if (fd != -1) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    // NOTE 读请求的超时；请求只含路径与选项，正常的客户端一次就发完
+    enum { request_timeout_s = 30 };
+} // namespace
+
+TranslateServer::TranslateServer(const std::string& socket_path, size_t worker_cnt, bool use_cache)
+    : m_socket_path(socket_path),
+      m_worker_cnt(worker_cnt ? worker_cnt : TaskScheduler::hardware_concurrency()),
+      m_use_cache(use_cache),
+      m_listen_fd(-1),
+      m_stopping(false)
+{
+}
+
+TranslateServer::~TranslateServer()
+{
+    ::close_fd(this->m_listen_fd);
+}
+
+void TranslateServer::listen()
+{
+    ::remove_stale_socket(this->m_socket_path);
+    struct sockaddr_un addr;
+    ::fill_address(addr, this->m_socket_path);
+    this->m_listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (this->m_listen_fd == -1) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "socket failed: " << std::strerror(errno));
+    }
+    if (::bind(this->m_listen_fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "bind `" << this->m_socket_path << "` failed: " << std::strerror(errno));
+    }
+    ::chmod(this->m_socket_path.c_str(), 0600);
+    if (::listen(this->m_listen_fd, SOMAXCONN) != 0) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "listen failed: " << std::strerror(errno));
+    }
+}
+
+void TranslateServer::run()
+{
+    this->listen();
+    ::install_signal_handlers();
+    std::cout << "serving on `" << this->m_socket_path << "` with "
+        << this->m_worker_cnt << " workers" << std::endl;
+
+    for (size_t i = 0; i < this->m_worker_cnt; ++i) {
+        this->m_workers.emplace_back(&TranslateServer::work, this);
+    }
+
+    // NOTE poll 带超时：信号恰好落在检查标志与阻塞之间时，也不会一直睡下去
+    while (!stop_requested) {
+        struct pollfd pfd;
+        pfd.fd = this->m_listen_fd;
+        pfd.events = POLLIN;
+        int ready = ::poll(&pfd, 1, 500);
+        if (ready <= 0) {
+            continue;
+        }
+        int sock = ::accept4(this->m_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (sock == -1) {
+            continue;
+        }
+        if (!::same_user(sock)) {
+            ::close(sock);
+            continue;
+        }
+        struct timeval tv;
+        tv.tv_sec = request_timeout_s;
+        tv.tv_usec = 0;
+        ::setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        std::lock_guard<std::mutex> lock(this->m_queue_mutex);
+        this->m_pending.push_back(sock);
+        this->m_queue_cond.notify_one();
+    }
+
+    ::close_fd(this->m_listen_fd);
+    ::unlink(this->m_socket_path.c_str());
+    {
+        std::lock_guard<std::mutex> lock(this->m_queue_mutex);
+        this->m_stopping = true;
+    }
+    this->m_queue_cond.notify_all();
+    for (auto& worker : this->m_workers) {
+        worker.join();
+    }
+    this->m_workers.clear();
+}
+
+// NOTE 停止时，已经接受的连接仍然处理完
+void TranslateServer::work()
+{
+    while (true) {
+        int sock = -1;
+        {
+            std::unique_lock<std::mutex> lock(this->m_queue_mutex);
+            this->m_queue_cond.wait(lock, [this]() {
+                return this->m_stopping || !this->m_pending.empty();
+            });
+            if (this->m_pending.empty()) {
+                return;
+            }
+            sock = this->m_pending.front();
+            this->m_pending.pop_front();
+        }
+        this->serve(sock);
+        ::close(sock);
+    }
+}
+
+void TranslateServer::serve(int sock)
+{
+    serve::Request req;
+    try {
+        serve::recv_request(sock, req);
+        this->handle(sock, req);
+    }
+    catch (std::exception& e) {
+        try {
+            serve::send_frame(sock, serve::T_LOG, std::string(e.what()) + "\n");
+            serve::send_frame(sock, serve::T_EXIT, "1");
+        }
+        catch (...) {
+        }
+    }
+    catch (...) {
+    }
+    ::close_fd(req.m_in_fd);
+    ::close_fd(req.m_out_fd);
+}
+
+// NOTE 与命令行的处理方式一致：逐个文件，日志整段发回；某个文件出错不影响其他
+void TranslateServer::handle(int sock, const serve::Request& req)
+{
+    if (!req.is_pipe() && req.m_targets.empty()) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "no target in request");
+    }
+    std::shared_ptr<const ByteStreamEditor> editor = this->rule_set(req);
+    std::unique_ptr<RunStats> run_stats;
+    if (req.m_stats) {
+        // NOTE 加载耗时是常驻的这份规则集当初加载时的
+        run_stats.reset(new RunStats(req.m_rule_path, editor->load_times()));
+    }
+
+    size_t failed_cnt = 0u;
+    auto run_one = [&](const std::string& path, const std::function<void(FileStats *, std::ostream&)>& func) {
+        std::ostringstream log;
+        FileStats file_stats;
+        file_stats.m_path = path;
+        try {
+            func(run_stats ? &file_stats : nullptr, log);
+            file_stats.m_ok = true;
+        }
+        catch (std::exception& e) {
+            log << e.what() << std::endl;
+            failed_cnt++;
+        }
+        if (run_stats) {
+            run_stats->add(std::move(file_stats));
+        }
+        if (!log.str().empty()) {
+            serve::send_frame(sock, serve::T_LOG, log.str());
+        }
+    };
+
+    if (req.is_pipe()) {
+        run_one("-", [&](FileStats * stats, std::ostream& ) {
+            editor->translate(req.m_in_fd, req.m_out_fd, stats);
+        });
+    }
+    for (const auto& path : req.m_targets) {
+        run_one(path, [&](FileStats * stats, std::ostream& log) {
+            if (req.m_replace) {
+                editor->translate(path, "", true, log, stats);
+            }
+            else {
+                editor->translate(path, editor->output_path(path), false, log, stats);
+            }
+        });
+    }
+
+    if (run_stats) {
+        std::ostringstream json;
+        run_stats->write_json(json, editor->sm());
+        serve::send_frame(sock, serve::T_STATS, json.str());
+    }
+    serve::send_frame(sock, serve::T_EXIT, failed_cnt ? "1" : "0");
+}
+
+std::shared_ptr<const ByteStreamEditor> TranslateServer::rule_set(const serve::Request& req)
+{
+    // NOTE 同一个文件的不同写法（./rule/x、符号链接等），共用一份
+    std::string path;
+    struct stat st;
+    std::memset(&st, 0, sizeof(st));
+    // NOTE 内置规则集随程序映像而来，不会变；mtime、size 都记为 0
+    if (req.m_rule_path.compare(0, std::strlen(EmbeddedRules::path_prefix), EmbeddedRules::path_prefix) == 0) {
+        path = req.m_rule_path;
+    }
+    else {
+        if (!req.m_rule_path.empty() && req.m_rule_path[0] == '/') {
+            std::unique_ptr<char, void (*)(void *)> real(::realpath(req.m_rule_path.c_str(), nullptr), std::free);
+            if (real) {
+                path = real.get();
+            }
+        }
+        if (path.empty() || ::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              req.m_rule_path << " not readable");
+        }
+    }
+    int64_t mtime_ns = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    std::string key = path;
+    key += '\n';
+    key += req.m_fsync ? 'f' : '-';
+    key += req.m_mmap ? 'm' : '-';
+    key += req.m_skip_noop ? 'n' : '-';
+
+    std::lock_guard<std::mutex> lock(this->m_rule_mutex);
+    auto it = this->m_rule_sets.find(key);
+    if (it != this->m_rule_sets.end() &&
+        it->second.m_mtime_ns == mtime_ns && it->second.m_size == uint64_t(st.st_size))
+    {
+        return it->second.m_editor;
+    }
+    // NOTE 旧的规则集由处理中的请求继续持有，用完即释放
+    std::shared_ptr<ByteStreamEditor> editor = std::make_shared<ByteStreamEditor>();
+    editor->set_use_cache(this->m_use_cache);
+    editor->load(path);
+    editor->set_use_mmap(req.m_mmap);
+    editor->set_fsync(req.m_fsync);
+    editor->set_skip_noop(req.m_skip_noop);
+    RuleSet& rule_set = this->m_rule_sets[key];
+    rule_set.m_editor = editor;
+    rule_set.m_mtime_ns = mtime_ns;
+    rule_set.m_size = st.st_size;
+    return editor;
+}
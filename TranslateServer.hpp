@@ -0,0 +1,78 @@
+#ifndef __TRANSLATESERVER_HPP_1468387533__
+#define __TRANSLATESERVER_HPP_1468387533__
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ByteStreamEditor.hpp"
+#include "ServeProtocol.hpp"
+
+/**
+ * @brief --serve：常驻进程，在 Unix domain socket 上接受翻译请求；
+ *
+ *        编译好的规则集常驻内存，按（解析后的）规则文件路径缓存；规则文件的
+ *        大小或修改时间变了，下一次请求时重新加载；
+ *        每个连接是一个请求，交给固定数目的工作线程之一处理；
+ *        只接受与本进程同一用户的连接——服务端以自己的权限读写客户端指定的文件；
+ */
+class TranslateServer
+{
+public:
+    TranslateServer(const std::string& socket_path, size_t worker_cnt, bool use_cache);
+    ~TranslateServer();
+
+public:
+    TranslateServer(const TranslateServer& ) = delete;
+    TranslateServer& operator = (const TranslateServer& ) = delete;
+
+public:
+    /**
+     * @brief 监听并服务，直到收到 SIGINT 或 SIGTERM；
+     *        退出前等待处理中的请求完成，并删除 socket 文件
+     */
+    void run();
+
+private:
+    struct RuleSet
+    {
+        std::shared_ptr<const ByteStreamEditor> m_editor;
+        int64_t                                 m_mtime_ns;
+        uint64_t                                m_size;
+    };
+
+    void listen();
+    void work();
+    void serve(int sock);
+    void handle(int sock, const serve::Request& req);
+
+    /**
+     * @brief fsync 与 mmap 是 ByteStreamEditor 的设置，所以也是缓存键的一部分
+     */
+    std::shared_ptr<const ByteStreamEditor> rule_set(const serve::Request& req);
+
+private:
+    std::string                     m_socket_path;
+    size_t                          m_worker_cnt;
+    bool                            m_use_cache;
+    int                             m_listen_fd;
+
+    std::mutex                      m_queue_mutex;
+    std::condition_variable         m_queue_cond;
+    std::deque<int>                 m_pending;
+    bool                            m_stopping;
+    std::vector<std::thread>        m_workers;
+
+    // NOTE 加载（解析、编译）时持有该锁；规则集变动少，不值得更细的锁
+    std::mutex                      m_rule_mutex;
+    std::map<std::string, RuleSet>  m_rule_sets;
+};
+
+
+#endif /* __TRANSLATESERVER_HPP_1468387533__ */
@@ -0,0 +1,109 @@
+#include "WritevSink.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <limits.h>
+#include <unistd.h>
+
+#include <sss/util/PostionThrow.hpp>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+WritevSink::WritevSink(int fd)
+    : m_fd(fd), m_chunk_used(0u), m_chunk_cnt(0u)
+{
+    this->m_iov.reserve(IOV_MAX);
+}
+
+WritevSink::~WritevSink()
+{
+    // NOTE 析构时不 flush——出错无法报告；调用方须显式 flush()
+}
+
+void WritevSink::append(const char * data, size_t len)
+{
+    if (!len) {
+        return;
+    }
+    if (!this->m_iov.empty()) {
+        struct iovec& last = this->m_iov.back();
+        if (static_cast<const char *>(last.iov_base) + last.iov_len == data) {
+            last.iov_len += len;
+            return;
+        }
+    }
+    if (this->m_iov.size() == IOV_MAX) {
+        this->flush();
+    }
+    this->m_iov.push_back(iovec{const_cast<char *>(data), len});
+}
+
+void WritevSink::write_ref(const char * data, size_t len)
+{
+    this->append(data, len);
+}
+
+void WritevSink::write(const char * data, size_t len)
+{
+    // NOTE 先保证 m_iov 有空位——append() 中途 flush() 的话，刚复制进分块的
+    // 数据就会被后续写入覆盖
+    if (this->m_iov.size() == IOV_MAX) {
+        this->flush();
+    }
+    if (len >= chunk_size / 4) {
+        // NOTE 大段数据，复制也没有意义
+        this->flush();
+        this->append(data, len);
+        this->flush();
+        return;
+    }
+    if (!this->m_chunk_cnt || this->m_chunk_used + len > chunk_size) {
+        if (this->m_chunk_cnt == this->m_chunks.size()) {
+            if (this->m_chunk_cnt >= 16u) {
+                this->flush();
+            }
+            else {
+                this->m_chunks.emplace_back(new char[chunk_size]);
+            }
+        }
+        this->m_chunk_cnt++;
+        this->m_chunk_used = 0u;
+    }
+    char * dest = this->m_chunks[this->m_chunk_cnt - 1].get() + this->m_chunk_used;
+    std::memcpy(dest, data, len);
+    this->m_chunk_used += len;
+    this->append(dest, len);
+}
+
+void WritevSink::flush()
+{
+    struct iovec * iov = this->m_iov.data();
+    size_t cnt = this->m_iov.size();
+    while (cnt) {
+        ssize_t ret = ::writev(this->m_fd, iov, cnt);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            SSS_POSTION_THROW(std::runtime_error,
+                              "writev failed: " << std::strerror(errno));
+        }
+        size_t done = ret;
+        while (cnt && done >= iov->iov_len) {
+            done -= iov->iov_len;
+            ++iov;
+            --cnt;
+        }
+        if (cnt) {
+            iov->iov_base = static_cast<char *>(iov->iov_base) + done;
+            iov->iov_len -= done;
+        }
+    }
+    this->m_iov.clear();
+    this->m_chunk_cnt = 0u;
+    this->m_chunk_used = 0u;
+}
@@ -0,0 +1,49 @@
+#ifndef __WRITEVSINK_HPP_1467902217__
+#define __WRITEVSINK_HPP_1467902217__
+
+#include <vector>
+#include <memory>
+
+#include <sys/uio.h>
+
+#include "SequenceSM.hpp"
+
+/**
+ * @brief 基于 writev(2) 的输出端；
+ *        write_ref() 的数据只记录指针，不复制——配合 MappedFile，原样输出的字节
+ *        不会被拷贝到用户态缓冲区；write() 的数据（替换串等）复制到内部的分块
+ *        缓冲区中；
+ *        调用方须保证：write_ref() 的数据，在 flush() 之前一直有效；
+ */
+class WritevSink : public SequenceSM::Sink
+{
+public:
+    explicit WritevSink(int fd);
+    ~WritevSink();
+
+public:
+    WritevSink(const WritevSink& ) = delete;
+    WritevSink& operator = (const WritevSink& ) = delete;
+
+public:
+    void write(const char * data, size_t len) override;
+    void write_ref(const char * data, size_t len) override;
+
+    void flush() override;
+
+public:
+    enum { chunk_size = 64 * 1024 };
+
+private:
+    void append(const char * data, size_t len);
+
+private:
+    int                                 m_fd;
+    std::vector<struct iovec>           m_iov;
+    std::vector<std::unique_ptr<char[]>> m_chunks;
+    size_t                              m_chunk_used;
+    size_t                              m_chunk_cnt;   // 当前批次已用的分块数
+};
+
+
+#endif /* __WRITEVSINK_HPP_1467902217__ */
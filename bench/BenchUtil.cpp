@@ -0,0 +1,281 @@
+#include "BenchUtil.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <unordered_set>
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include <sss/util/PostionThrow.hpp>
+
+namespace  {
+    const char * ascii_words[] = {
+        "the ", "quick ", "brown ", "fox ", "2026-10-17T06:00:00Z ", "INFO ",
+        "request_id=42 ", "status=200 ", "path=/index.html ", "\n"
+    };
+
+    void append_ascii_word(std::string& out, std::mt19937_64& rng)
+    {
+        out += ascii_words[rng() % (sizeof(ascii_words) / sizeof(ascii_words[0]))];
+    }
+
+    // NOTE GB2312 汉字区：首字节 0xB0-0xF7，尾字节 0xA1-0xFE
+    void append_cjk_char(std::string& out, std::mt19937_64& rng)
+    {
+        out += char(0xB0 + rng() % (0xF7 - 0xB0 + 1));
+        out += char(0xA1 + rng() % (0xFE - 0xA1 + 1));
+    }
+
+    // NOTE CJK 统一汉字 U+4E00-U+9FA5 的 UTF-8 编码，三个字节
+    void append_utf8_cjk_char(std::string& out, std::mt19937_64& rng)
+    {
+        unsigned cp = 0x4E00u + rng() % (0x9FA5u - 0x4E00u + 1u);
+        out += char(0xE0u | (cp >> 12));
+        out += char(0x80u | ((cp >> 6) & 0x3Fu));
+        out += char(0x80u | (cp & 0x3Fu));
+    }
+
+    // NOTE 生成规则用的小字符集：4 个首字节 x 16 个尾字节；
+    // 尾字节避开 '"' 与 '\\'，写成规则文件时不需要转义
+    void append_rule_char(std::string& out, std::mt19937_64& rng)
+    {
+        unsigned ch = rng() % 64u;
+        out += char(0xB0 + ch / 16u);
+        out += char(0xA1 + ch % 16u);
+    }
+
+    void append_cjk_or_key(std::string& out, std::mt19937_64& rng,
+                           const std::vector<std::string>& keys)
+    {
+        if (!keys.empty() && rng() % 20u == 0u) {
+            out += keys[rng() % keys.size()];
+        }
+        else {
+            ::append_cjk_char(out, rng);
+        }
+    }
+} // namespace
+
+namespace bench {
+
+const std::vector<std::string>& corpus_names()
+{
+    static const std::vector<std::string> names = {
+        "ascii", "cjk", "utf8", "mixed", "nearmiss", "binary"
+    };
+    return names;
+}
+
+std::string make_corpus(const std::string& name, size_t size,
+                        const std::vector<std::string>& keys, uint64_t seed)
+{
+    std::mt19937_64 rng(seed);
+    std::string corpus;
+    corpus.reserve(size + 64u);
+    if (name == "ascii") {
+        while (corpus.size() < size) {
+            ::append_ascii_word(corpus, rng);
+        }
+    }
+    else if (name == "cjk") {
+        while (corpus.size() < size) {
+            ::append_cjk_or_key(corpus, rng, keys);
+        }
+    }
+    else if (name == "utf8") {
+        // NOTE 与 cjk 相同，但是 UTF-8 编码的汉字；键的比例也相同
+        while (corpus.size() < size) {
+            if (!keys.empty() && rng() % 20u == 0u) {
+                corpus += keys[rng() % keys.size()];
+            }
+            else {
+                ::append_utf8_cjk_char(corpus, rng);
+            }
+        }
+    }
+    else if (name == "mixed") {
+        while (corpus.size() < size) {
+            if (rng() % 10u < 7u) {
+                ::append_ascii_word(corpus, rng);
+            }
+            else {
+                ::append_cjk_or_key(corpus, rng, keys);
+            }
+        }
+    }
+    else if (name == "nearmiss") {
+        // NOTE 每个键都只差最后一个字节；键本身只有一个字节时，退化为汉字
+        while (corpus.size() < size) {
+            const std::string * key = keys.empty() ? nullptr : &keys[rng() % keys.size()];
+            if (key && key->size() > 1u) {
+                corpus.append(*key, 0, key->size() - 1u);
+            }
+            else {
+                ::append_cjk_char(corpus, rng);
+            }
+        }
+    }
+    else if (name == "binary") {
+        while (corpus.size() < size) {
+            uint64_t word = rng();
+            corpus.append(reinterpret_cast<const char *>(&word), sizeof(word));
+        }
+    }
+    else {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "unknown corpus `" << name << "`");
+    }
+    corpus.resize(size);
+    return corpus;
+}
+
+RuleList make_rules(size_t cnt, uint64_t seed)
+{
+    std::mt19937_64 rng(seed);
+    std::unordered_set<std::string> seen;
+    RuleList rules;
+    rules.reserve(cnt);
+    while (rules.size() < cnt) {
+        // NOTE 长键为主：64 个单字、4096 个双字，很快就会用完
+        size_t char_cnt = 1u + rng() % 4u;
+        std::string key;
+        for (size_t i = 0; i < char_cnt; ++i) {
+            ::append_rule_char(key, rng);
+        }
+        if (!seen.insert(key).second) {
+            continue;
+        }
+        std::string value;
+        for (size_t i = 0; i < char_cnt; ++i) {
+            ::append_rule_char(value, rng);
+        }
+        rules.emplace_back(key, value);
+    }
+    return rules;
+}
+
+void write_rule_file(const std::string& path, const RuleList& rules)
+{
+    std::ofstream ofs(path, std::ios_base::out | std::ios_base::binary);
+    if (!ofs.good()) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "unable to open file `" << path << "` to write");
+    }
+    ofs << "// generated by bse-bench\n";
+    for (const auto& rule : rules) {
+        ofs << '"' << rule.first << "\",\"" << rule.second << "\"\n";
+    }
+}
+
+std::vector<std::string> read_rule_keys(const std::string& path)
+{
+    std::vector<std::string> keys;
+    std::ifstream ifs(path, std::ios_base::in | std::ios_base::binary);
+    std::string line;
+    while (std::getline(ifs, line)) {
+        std::string::size_type sep = line.find("\",\"");
+        if (line.size() > 2 && line[0] == '"' && sep != std::string::npos) {
+            std::string key = line.substr(1, sep - 1);
+            if (key.find('\\') == std::string::npos) {
+                keys.push_back(key);
+            }
+        }
+    }
+    return keys;
+}
+
+long peak_rss_kb()
+{
+    struct rusage usage;
+    if (::getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return usage.ru_maxrss;
+}
+
+PerfCounters::PerfCounters(bool enable)
+{
+    static const uint64_t configs[counter_cnt] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+    for (int i = 0; i < counter_cnt; ++i) {
+        this->m_fds[i] = -1;
+        this->m_values[i] = 0u;
+    }
+    if (!enable) {
+        return;
+    }
+    for (int i = 0; i < counter_cnt; ++i) {
+        struct perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = configs[i];
+        attr.disabled = i == 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        int fd = ::syscall(__NR_perf_event_open, &attr, 0, -1, i ? this->m_fds[0] : -1, 0);
+        if (fd == -1) {
+            // NOTE 要么全有，要么全无；分组读取时下标才对得上
+            for (int j = 0; j < i; ++j) {
+                ::close(this->m_fds[j]);
+                this->m_fds[j] = -1;
+            }
+            return;
+        }
+        this->m_fds[i] = fd;
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+    for (int i = 0; i < counter_cnt; ++i) {
+        if (this->m_fds[i] != -1) {
+            ::close(this->m_fds[i]);
+        }
+    }
+}
+
+void PerfCounters::start()
+{
+    if (!this->available()) {
+        return;
+    }
+    ::ioctl(this->m_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ::ioctl(this->m_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void PerfCounters::stop()
+{
+    if (!this->available()) {
+        return;
+    }
+    ::ioctl(this->m_fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    uint64_t buf[1 + counter_cnt];
+    if (::read(this->m_fds[0], buf, sizeof(buf)) == ssize_t(sizeof(buf)) && buf[0] == counter_cnt) {
+        for (int i = 0; i < counter_cnt; ++i) {
+            this->m_values[i] = buf[1 + i];
+        }
+    }
+}
+
+const char * PerfCounters::counter_name(int idx)
+{
+    static const char * names[counter_cnt] = {
+        "cycles", "instructions", "cache_misses", "branch_misses"
+    };
+    return names[idx];
+}
+
+} // namespace bench
@@ -0,0 +1,106 @@
+#ifndef __BENCHUTIL_HPP_1468112405__
+#define __BENCHUTIL_HPP_1468112405__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+
+#include "SequenceSM.hpp"
+#include "JsonWriter.hpp"
+
+/**
+ * @brief 基准测试的公共部件：丢弃输出的 Sink、可复现的语料与规则生成、内存
+ *        峰值与硬件计数器；
+ *        只供 bench/ 下的程序使用，不进入 byte-stream-editor；
+ */
+namespace bench {
+
+    class NullSink : public SequenceSM::Sink
+    {
+    public:
+        NullSink()
+            : m_size(0u)
+        {}
+        void write(const char * , size_t len) override
+        {
+            this->m_size += len;
+        }
+        size_t m_size;
+    };
+
+    typedef std::vector<std::pair<std::string, std::string>> RuleList;
+
+    /**
+     * @brief 按名字生成语料；同样的名字、大小与种子，得到同样的字节；
+     *        ascii    英文日志样式的文本
+     *        cjk      稠密的 GBK 双字节汉字；keys 非空时，夹杂其中的键
+     *        utf8     同 cjk，但是 UTF-8 编码的三字节汉字
+     *        mixed    七成 ascii，三成 cjk
+     *        nearmiss 反复出现"差最后一个字节"的键前缀，逼出最多的回退
+     *        binary   均匀随机字节
+     */
+    std::string make_corpus(const std::string& name, size_t size,
+                            const std::vector<std::string>& keys, uint64_t seed = 20161017u);
+
+    const std::vector<std::string>& corpus_names();
+
+    /**
+     * @brief 生成 cnt 条互不相同的规则；键为 1~4 个 GBK 汉字，取自一个较小的
+     *        字符集，使前缀大量共享，接近真实的繁简表
+     */
+    RuleList make_rules(size_t cnt, uint64_t seed = 20161017u);
+
+    /**
+     * @brief 按 ByteStreamEditor::load() 能解析的格式写出规则文件
+     */
+    void write_rule_file(const std::string& path, const RuleList& rules);
+
+    /**
+     * @brief 从规则文件中取出不含转义的键，用于生成会命中的语料
+     */
+    std::vector<std::string> read_rule_keys(const std::string& path);
+
+    /**
+     * @brief 进程至今的常驻内存峰值，单位 KiB
+     */
+    long peak_rss_kb();
+
+    /**
+     * @brief perf_event_open(2) 的一组硬件计数器：cycles、instructions、
+     *        cache-misses、branch-misses；
+     *        内核或容器不允许时，available() 为 false，其余调用都无效果
+     */
+    class PerfCounters
+    {
+    public:
+        explicit PerfCounters(bool enable);
+        ~PerfCounters();
+
+    public:
+        PerfCounters(const PerfCounters& ) = delete;
+        PerfCounters& operator = (const PerfCounters& ) = delete;
+
+    public:
+        bool available() const
+        {
+            return this->m_fds[0] != -1;
+        }
+        void start();
+        void stop();
+
+        enum { counter_cnt = 4 };
+        static const char * counter_name(int idx);
+        uint64_t value(int idx) const
+        {
+            return this->m_values[idx];
+        }
+
+    private:
+        int         m_fds[counter_cnt];
+        uint64_t    m_values[counter_cnt];
+    };
+
+} // namespace bench
+
+#endif /* __BENCHUTIL_HPP_1468112405__ */
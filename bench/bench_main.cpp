@@ -0,0 +1,364 @@
+/**
+ * @brief 吞吐量基准：若干规则集 x 若干语料，结果以 JSON 输出，便于在版本之间
+ *        diff；进度信息写到 stderr；
+ *
+ *  bse-bench [--size MiB] [--rounds N] [--rules-max N] [--rule-dir dir]
+ *            [--corpus name ...] [--perf] [-o out.json]
+ *
+ *  规则集：<rule-dir>/ts.rule、<rule-dir>/test1.rule，以及生成的 10、100、……
+ *  条规则（不超过 --rules-max，默认 100000；稠密跳转表每个状态 1 KiB，
+ *  1000000 条规则需要数 GiB 内存，须显式指定）；
+ *
+ *  每种语料另有 matcher_trained：在同类语料的另一份样本（换一个种子生成）上
+ *  训练、重新编号状态之后再测（见 SequenceSM::renumber()）；不走单码位引擎，
+ *  所以对照的是 matcher_trie（若有），否则是 matcher；加 --perf 时，两者的
+ *  cache-misses 即是重新编号前后的对比；
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <sss/util/PostionThrow.hpp>
+
+#include "ByteStreamEditor.hpp"
+#include "BenchUtil.hpp"
+
+namespace  {
+    struct Options
+    {
+        size_t                      m_size_mib = 16u;
+        int                         m_rounds = 3;
+        size_t                      m_rules_max = 100000u;
+        std::string                 m_rule_dir = "rule";
+        std::vector<std::string>    m_corpora;
+        bool                        m_perf = false;
+        std::string                 m_out_path;
+    };
+
+    struct RuleSet
+    {
+        std::string m_name;
+        std::string m_path;
+        bool        m_generated;
+    };
+
+    // NOTE 只统计字节数的 streambuf，供 SequenceSM::translate(istream, ostream)
+    class CountingBuf : public std::streambuf
+    {
+    public:
+        CountingBuf()
+            : m_size(0u)
+        {}
+        size_t m_size;
+
+    protected:
+        int_type overflow(int_type ch) override
+        {
+            ++this->m_size;
+            return traits_type::not_eof(ch);
+        }
+        std::streamsize xsputn(const char * , std::streamsize len) override
+        {
+            this->m_size += len;
+            return len;
+        }
+    };
+
+    double seconds_since(std::chrono::steady_clock::time_point t0)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    // NOTE 跳转表、类号映射、depth、flags、value 两项，以及替换串池；双数组以
+    // base、check、fail 三项代替跳转表
+    uint64_t table_bytes(const SequenceSM::Table& table)
+    {
+        if (table.m_backend == SequenceSM::B_DOUBLE_ARRAY) {
+            return uint64_t(table.m_state_cnt) * (3u * 4u + 4u + 1u + 8u) + 256u + table.m_pool_size;
+        }
+        return uint64_t(table.m_state_cnt) * (table.m_class_cnt * 4u + 4u + 1u + 8u) + 256u + table.m_pool_size;
+    }
+
+    void write_speed(JsonWriter& json, size_t bytes, double best)
+    {
+        json.key("seconds").value(best);
+        json.key("mb_per_s").value(bytes / best / 1e6);
+        json.key("ns_per_byte").value(best * 1e9 / bytes);
+    }
+
+    // NOTE 与 ByteStreamEditor 的文件路径一致：按 block_size 分块喂给 Matcher
+    void bench_matcher(JsonWriter& json, const char * name, const SequenceSM& sm,
+                       const std::string& corpus, const Options& opt)
+    {
+        bench::PerfCounters perf(opt.m_perf);
+        double best = 1e30;
+        size_t out_size = 0u;
+        uint64_t counters[bench::PerfCounters::counter_cnt] = {0u};
+        for (int round = 0; round < opt.m_rounds; ++round) {
+            bench::NullSink sink;
+            SequenceSM::Matcher matcher(sm);
+            perf.start();
+            auto t0 = std::chrono::steady_clock::now();
+            for (size_t off = 0; off < corpus.size(); off += ByteStreamEditor::block_size) {
+                size_t len = std::min<size_t>(ByteStreamEditor::block_size, corpus.size() - off);
+                matcher.feed(corpus.data() + off, len, sink);
+            }
+            matcher.finish(sink);
+            double sec = ::seconds_since(t0);
+            perf.stop();
+            if (sec < best) {
+                best = sec;
+                for (int i = 0; i < bench::PerfCounters::counter_cnt; ++i) {
+                    counters[i] = perf.value(i);
+                }
+            }
+            out_size = sink.m_size;
+        }
+        json.key(name).begin_object();
+        ::write_speed(json, corpus.size(), best);
+        json.key("out_bytes").value(uint64_t(out_size));
+        json.key("counters");
+        if (perf.available()) {
+            json.begin_object();
+            for (int i = 0; i < bench::PerfCounters::counter_cnt; ++i) {
+                json.key(bench::PerfCounters::counter_name(i)).value(counters[i]);
+            }
+            json.key("per_byte").begin_object();
+            for (int i = 0; i < bench::PerfCounters::counter_cnt; ++i) {
+                json.key(bench::PerfCounters::counter_name(i)).value(double(counters[i]) / corpus.size());
+            }
+            json.end_object();
+            json.end_object();
+        }
+        else {
+            json.null();
+        }
+        json.end_object();
+    }
+
+    // NOTE 训练样本与测量用的语料同类、不同种子：不在测量数据本身上训练
+    SequenceSM trained_copy(const SequenceSM& trie_sm, const std::string& name, size_t size,
+                            const std::vector<std::string>& keys)
+    {
+        SequenceSM trained = trie_sm;
+        std::string sample = bench::make_corpus(name, size, keys, 19491001u);
+        std::vector<uint64_t> visits(trained.table().m_state_cnt, 0u);
+        trained.count_visits(sample.data(), sample.size(), visits);
+        trained.renumber(visits);
+        return trained;
+    }
+
+    void bench_translate(JsonWriter& json, SequenceSM& sm, const std::string& corpus,
+                         const Options& opt)
+    {
+        double best = 1e30;
+        for (int round = 0; round < opt.m_rounds; ++round) {
+            std::istringstream iss(corpus);
+            CountingBuf buf;
+            std::ostream out(&buf);
+            auto t0 = std::chrono::steady_clock::now();
+            sm.translate(iss, out);
+            double sec = ::seconds_since(t0);
+            if (sec < best) {
+                best = sec;
+            }
+        }
+        json.key("translate").begin_object();
+        ::write_speed(json, corpus.size(), best);
+        json.end_object();
+    }
+
+    void bench_rule_set(JsonWriter& json, const RuleSet& rule_set, const Options& opt)
+    {
+        std::cerr << "rule set " << rule_set.m_name << std::endl;
+        json.begin_object();
+        json.key("name").value(rule_set.m_name);
+        json.key("generated").value(rule_set.m_generated);
+
+        ByteStreamEditor b;
+        auto t0 = std::chrono::steady_clock::now();
+        b.load(rule_set.m_path);
+        double load_sec = ::seconds_since(t0);
+
+        const SequenceSM::Table& table = b.sm().table();
+        uint64_t rule_cnt = 0u;
+        for (uint32_t i = 0; i < table.m_state_cnt; ++i) {
+            rule_cnt += (table.m_flags[i] & SequenceSM::F_TERMINAL) ? 1u : 0u;
+        }
+        json.key("rules").value(rule_cnt);
+        json.key("states").value(uint64_t(table.m_state_cnt));
+        json.key("max_key_len").value(uint64_t(table.m_max_jump_cnt));
+        json.key("byte_classes").value(uint64_t(table.m_class_cnt));
+        json.key("table_bytes").value(::table_bytes(table));
+        json.key("load").begin_object();
+        json.key("seconds").value(load_sec);
+        json.key("rules_per_s").value(rule_cnt / load_sec);
+        json.end_object();
+
+        std::vector<std::string> keys = bench::read_rule_keys(rule_set.m_path);
+        SequenceSM sm = b.sm();
+        // NOTE 单码位规则集：另测一遍通用跳转表，作为对照
+        SequenceSM trie_sm = b.sm();
+        trie_sm.set_codepoint_engine(false);
+        // NOTE 按字节等价类压缩了的：另编译一份不压缩的稠密布局，作为对照
+        const bool has_classes = table.m_class_cnt < 256u;
+        SequenceSM dense_sm = b.sm();
+        if (has_classes) {
+            dense_sm.set_byte_classes(false);
+            dense_sm.set_codepoint_engine(false);
+            dense_sm.compile();
+            json.key("dense_table_bytes").value(::table_bytes(dense_sm.table()));
+        }
+        // NOTE 双数组后端：从规则文件整批建表，与上面的稠密表对照
+        ByteStreamEditor da_b;
+        da_b.set_backend(SequenceSM::B_DOUBLE_ARRAY);
+        t0 = std::chrono::steady_clock::now();
+        da_b.load(rule_set.m_path);
+        double da_load_sec = ::seconds_since(t0);
+        SequenceSM da_sm = da_b.sm();
+        da_sm.set_codepoint_engine(false);
+        json.key("double_array").begin_object();
+        json.key("slots").value(uint64_t(da_sm.table().m_state_cnt));
+        json.key("table_bytes").value(::table_bytes(da_sm.table()));
+        json.key("load_seconds").value(da_load_sec);
+        json.end_object();
+        json.key("codepoint_engine").value(sm.codepoint_engine());
+        json.key("corpora").begin_array();
+        for (const std::string& name : opt.m_corpora) {
+            std::cerr << "  corpus " << name << std::endl;
+            std::string corpus = bench::make_corpus(name, opt.m_size_mib * 1024u * 1024u, keys);
+            json.begin_object();
+            json.key("name").value(name);
+            json.key("bytes").value(uint64_t(corpus.size()));
+            ::bench_matcher(json, "matcher", sm, corpus, opt);
+            if (sm.codepoint_engine()) {
+                ::bench_matcher(json, "matcher_trie", trie_sm, corpus, opt);
+            }
+            if (has_classes) {
+                ::bench_matcher(json, "matcher_dense", dense_sm, corpus, opt);
+            }
+            ::bench_matcher(json, "matcher_double_array", da_sm, corpus, opt);
+            {
+                SequenceSM trained_sm = ::trained_copy(trie_sm, name, corpus.size(), keys);
+                ::bench_matcher(json, "matcher_trained", trained_sm, corpus, opt);
+            }
+            ::bench_translate(json, sm, corpus, opt);
+            json.end_object();
+        }
+        json.end_array();
+        json.key("peak_rss_kb").value(int64_t(bench::peak_rss_kb()));
+        json.end_object();
+    }
+
+    Options parse_options(int argc, char * argv[])
+    {
+        Options opt;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool has_next = i + 1 < argc;
+            if (arg == "--size" && has_next) {
+                opt.m_size_mib = std::strtoul(argv[++i], nullptr, 10);
+            }
+            else if (arg == "--rounds" && has_next) {
+                opt.m_rounds = std::max(1, std::atoi(argv[++i]));
+            }
+            else if (arg == "--rules-max" && has_next) {
+                opt.m_rules_max = std::strtoul(argv[++i], nullptr, 10);
+            }
+            else if (arg == "--rule-dir" && has_next) {
+                opt.m_rule_dir = argv[++i];
+            }
+            else if (arg == "--corpus" && has_next) {
+                opt.m_corpora.push_back(argv[++i]);
+            }
+            else if (arg == "--perf") {
+                opt.m_perf = true;
+            }
+            else if (arg == "-o" && has_next) {
+                opt.m_out_path = argv[++i];
+            }
+            else {
+                SSS_POSTION_THROW(std::runtime_error,
+                                  "unknown option `" << arg << "`");
+            }
+        }
+        if (opt.m_corpora.empty()) {
+            opt.m_corpora = bench::corpus_names();
+        }
+        if (!opt.m_size_mib) {
+            opt.m_size_mib = 1u;
+        }
+        return opt;
+    }
+} // namespace
+
+int main(int argc, char * argv[])
+{
+    std::vector<std::string> temp_files;
+    int ret = EXIT_FAILURE;
+    try {
+        Options opt = ::parse_options(argc, argv);
+
+        std::vector<RuleSet> rule_sets;
+        rule_sets.push_back(RuleSet{"ts.rule", opt.m_rule_dir + "/ts.rule", false});
+        rule_sets.push_back(RuleSet{"test1.rule", opt.m_rule_dir + "/test1.rule", false});
+        for (size_t cnt = 10u; cnt <= opt.m_rules_max; cnt *= 10u) {
+            std::string path = "/tmp/bse-bench-XXXXXX";
+            int fd = ::mkstemp(&path[0]);
+            if (fd == -1) {
+                SSS_POSTION_THROW(std::runtime_error,
+                                  "unable to create temporary rule file");
+            }
+            ::close(fd);
+            temp_files.push_back(path);
+            bench::write_rule_file(path, bench::make_rules(cnt));
+            rule_sets.push_back(RuleSet{"gen-" + std::to_string(cnt), path, true});
+        }
+
+        std::ofstream ofs;
+        if (!opt.m_out_path.empty()) {
+            ofs.open(opt.m_out_path, std::ios_base::out | std::ios_base::binary);
+            if (!ofs.good()) {
+                SSS_POSTION_THROW(std::runtime_error,
+                                  "unable to open file `" << opt.m_out_path << "` to write");
+            }
+        }
+        std::ostringstream oss;
+        JsonWriter json(oss);
+        json.begin_object();
+        json.key("bench").value("bse-bench");
+        json.key("format").value(uint64_t(1u));
+        json.key("scan_kernel").value(ByteScanner::kernel_name(ByteScanner::best_kernel()));
+        json.key("corpus_mib").value(uint64_t(opt.m_size_mib));
+        json.key("rounds").value(int64_t(opt.m_rounds));
+        json.key("rule_sets").begin_array();
+        for (const auto& rule_set : rule_sets) {
+            ::bench_rule_set(json, rule_set, opt);
+        }
+        json.end_array();
+        json.key("peak_rss_kb").value(int64_t(bench::peak_rss_kb()));
+        json.end_object();
+
+        if (ofs.is_open()) {
+            ofs << oss.str();
+        }
+        else {
+            std::cout << oss.str();
+        }
+        ret = EXIT_SUCCESS;
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+    }
+    for (const auto& path : temp_files) {
+        ::unlink(path.c_str());
+    }
+    return ret;
+}
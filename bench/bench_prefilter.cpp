@@ -0,0 +1,90 @@
+/**
+ * @brief 对比 S0 字节跳过内核的吞吐量；
+ *        输入为以 ASCII 为主、夹杂少量规则文件中的键的文本；
+ *
+ *  bse-bench-prefilter [rule-file] [MiB] [non-ascii-permille]
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ByteStreamEditor.hpp"
+#include "BenchUtil.hpp"
+
+namespace  {
+    std::string make_corpus(const std::vector<std::string>& keys, size_t size, unsigned permille)
+    {
+        static const char * words[] = {
+            "the ", "quick ", "brown ", "fox ", "2026-10-17T06:00:00Z ", "INFO ",
+            "request_id=42 ", "status=200 ", "path=/index.html ", "\n"
+        };
+        std::mt19937_64 rng(20161017u);
+        std::string corpus;
+        corpus.reserve(size + 64u);
+        while (corpus.size() < size) {
+            if (!keys.empty() && rng() % 1000u < permille) {
+                corpus += keys[rng() % keys.size()];
+            }
+            else {
+                corpus += words[rng() % (sizeof(words) / sizeof(words[0]))];
+            }
+        }
+        corpus.resize(size);
+        return corpus;
+    }
+} // namespace 
+
+int main(int argc, char * argv[])
+{
+    try {
+        std::string rule_path = argc > 1 ? argv[1] : "rule/ts.rule";
+        size_t mib = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 64u;
+        unsigned permille = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 5u;
+
+        ByteStreamEditor b(rule_path);
+        // NOTE 用规则中的键本身作为"非 ASCII"部分，保证会发生匹配
+        std::vector<std::string> keys = bench::read_rule_keys(rule_path);
+        std::string corpus = make_corpus(keys, mib * 1024u * 1024u, permille);
+
+        std::printf("rule=%s size=%zuMiB non-ascii=%u/1000 best=%s\n",
+                    rule_path.c_str(), mib, permille,
+                    ByteScanner::kernel_name(ByteScanner::best_kernel()));
+
+        const ByteScanner::Kernel kernels[] = {
+            ByteScanner::k_none, ByteScanner::k_scalar, ByteScanner::k_sse2, ByteScanner::k_avx2
+        };
+        for (ByteScanner::Kernel kernel : kernels) {
+            if (kernel > ByteScanner::best_kernel()) {
+                continue;
+            }
+            SequenceSM sm = b.sm();
+            sm.set_scan_kernel(kernel);
+            double best = 1e30;
+            size_t out_size = 0;
+            for (int round = 0; round < 5; ++round) {
+                bench::NullSink sink;
+                SequenceSM::Matcher matcher(sm);
+                auto t0 = std::chrono::steady_clock::now();
+                matcher.feed(corpus.data(), corpus.size(), sink);
+                matcher.finish(sink);
+                auto t1 = std::chrono::steady_clock::now();
+                double sec = std::chrono::duration<double>(t1 - t0).count();
+                if (sec < best) {
+                    best = sec;
+                }
+                out_size = sink.m_size;
+            }
+            std::printf("%-8s %10.1f MB/s %8.3f ns/byte out=%zu\n",
+                        ByteScanner::kernel_name(kernel),
+                        corpus.size() / best / 1e6, best * 1e9 / corpus.size(), out_size);
+        }
+        return EXIT_SUCCESS;
+    }
+    catch (std::exception& e) {
+        std::printf("%s\n", e.what());
+    }
+    return EXIT_FAILURE;
+}
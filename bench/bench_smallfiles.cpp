@@ -0,0 +1,205 @@
+/**
+ * @brief 大量小文件时，逐个文件 ByteStreamEditor::translate() 与
+ *        BatchTranslator（blocking、io_uring）的对比；
+ *        在临时目录下生成 file-cnt 个 1~10 KiB 的文件，每种方式各跑 rounds 轮，
+ *        取最好的一轮；每轮之前删除上一轮的 .ts（并 sync），即每轮都是新建输出；
+ *
+ *  bse-bench-smallfiles [rule-file] [file-cnt] [rounds] [-j N]
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <sss/util/PostionThrow.hpp>
+
+#include "ByteStreamEditor.hpp"
+#include "BatchTranslator.hpp"
+#include "IoUring.hpp"
+#include "TaskScheduler.hpp"
+#include "BenchUtil.hpp"
+
+namespace  {
+    void write_file(const std::string& path, const std::string& content)
+    {
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              "unable to open file `" << path << "` to write");
+        }
+        bool ok = ::write(fd, content.data(), content.size()) == ssize_t(content.size());
+        ::close(fd);
+        if (!ok) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              "unable to write file `" << path << "`");
+        }
+    }
+
+    // NOTE 每 100 个文件一个子目录，接近真实的源码树
+    std::vector<FileJob> make_tree(const std::string& root, size_t file_cnt,
+                                   const std::vector<std::string>& keys)
+    {
+        std::mt19937_64 rng(20161017u);
+        std::vector<FileJob> jobs;
+        jobs.reserve(file_cnt);
+        for (size_t i = 0; i < file_cnt; ++i) {
+            std::string dir = root + "/d" + std::to_string(i / 100u);
+            if (i % 100u == 0u && ::mkdir(dir.c_str(), 0755) == -1) {
+                SSS_POSTION_THROW(std::runtime_error,
+                                  "unable to create directory `" << dir << "`");
+            }
+            size_t size = 1024u + rng() % (9u * 1024u);
+            std::string path = dir + "/f" + std::to_string(i) + ".txt";
+            ::write_file(path, bench::make_corpus("mixed", size, keys, rng()));
+            jobs.emplace_back(path, size);
+        }
+        return jobs;
+    }
+
+    void remove_outputs(const ByteStreamEditor& b, const std::vector<FileJob>& jobs)
+    {
+        for (const auto& job : jobs) {
+            ::unlink(b.output_path(job.m_path).c_str());
+        }
+    }
+
+    void remove_tree(const ByteStreamEditor& b, const std::string& root, const std::vector<FileJob>& jobs)
+    {
+        ::remove_outputs(b, jobs);
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            ::unlink(jobs[i].m_path.c_str());
+        }
+        for (size_t i = 0; i < jobs.size(); i += 100u) {
+            ::rmdir((root + "/d" + std::to_string(i / 100u)).c_str());
+        }
+        ::rmdir(root.c_str());
+    }
+
+    // NOTE 与 main.cpp 中逐个文件的处理方式相同：每个文件一个任务，输出信息整段
+    // 收集；这里不打印，只计数
+    size_t run_per_file(const ByteStreamEditor& b, const std::vector<FileJob>& jobs, size_t worker_cnt)
+    {
+        std::atomic<size_t> failed_cnt(0u);
+        std::vector<TaskScheduler::Task> tasks;
+        tasks.reserve(jobs.size());
+        for (const auto& job : jobs) {
+            const std::string& path = job.m_path;
+            tasks.push_back([&b, &path, &failed_cnt]() {
+                std::ostringstream log;
+                try {
+                    b.translate(path, b.output_path(path), false, log);
+                }
+                catch (std::exception& ) {
+                    failed_cnt++;
+                }
+            });
+        }
+        TaskScheduler scheduler(worker_cnt);
+        scheduler.run(std::move(tasks));
+        return failed_cnt;
+    }
+
+    size_t run_batch(const ByteStreamEditor& b, const std::vector<FileJob>& jobs, size_t worker_cnt,
+                     BatchTranslator::Engine engine)
+    {
+        std::atomic<size_t> failed_cnt(0u);
+        BatchTranslator batch(b, worker_cnt, engine);
+        batch.run(jobs, false, [&failed_cnt](size_t , bool ok, const std::string& , FileStats& ) {
+            if (!ok) {
+                failed_cnt++;
+            }
+        });
+        return failed_cnt;
+    }
+} // namespace
+
+int main(int argc, char * argv[])
+{
+    std::string root;
+    std::vector<FileJob> jobs;
+    int ret = EXIT_FAILURE;
+    try {
+        std::vector<const char *> args;
+        size_t worker_cnt = 0u;
+        for (int i = 1; i < argc; ++i) {
+            if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+                worker_cnt = std::strtoul(argv[++i], nullptr, 10);
+            }
+            else {
+                args.push_back(argv[i]);
+            }
+        }
+        std::string rule_path = args.size() > 0 ? args[0] : "rule/ts.rule";
+        size_t file_cnt = args.size() > 1 ? std::strtoul(args[1], nullptr, 10) : 10000u;
+        int rounds = args.size() > 2 ? std::atoi(args[2]) : 3;
+
+        ByteStreamEditor b(rule_path);
+        std::vector<std::string> keys = bench::read_rule_keys(rule_path);
+
+        root = "/tmp/bse-bench-smallfiles-XXXXXX";
+        if (::mkdtemp(&root[0]) == nullptr) {
+            root.clear();
+            SSS_POSTION_THROW(std::runtime_error,
+                              "unable to create temporary directory");
+        }
+        jobs = ::make_tree(root, file_cnt, keys);
+
+        std::printf("rule=%s files=%zu rounds=%d io_uring=%s\n",
+                    rule_path.c_str(), file_cnt, rounds,
+                    IoUring::available() ? "yes" : "no");
+
+        struct Method
+        {
+            const char *            m_name;
+            bool                    m_batch;
+            BatchTranslator::Engine m_engine;
+        };
+        const Method methods[] = {
+            {"per-file", false, BatchTranslator::E_AUTO},
+            {"blocking", true, BatchTranslator::E_BLOCKING},
+            {"io_uring", true, BatchTranslator::E_URING},
+        };
+        for (const auto& method : methods) {
+            if (method.m_engine == BatchTranslator::E_URING && !IoUring::available()) {
+                continue;
+            }
+            double best = 1e30;
+            size_t failed_cnt = 0u;
+            for (int round = 0; round < rounds; ++round) {
+                // NOTE 先把删除与上一轮的写出落盘，免得回写算到这一轮头上
+                ::remove_outputs(b, jobs);
+                ::sync();
+                auto t0 = std::chrono::steady_clock::now();
+                failed_cnt = method.m_batch
+                    ? ::run_batch(b, jobs, worker_cnt, method.m_engine)
+                    : ::run_per_file(b, jobs, worker_cnt);
+                auto t1 = std::chrono::steady_clock::now();
+                double sec = std::chrono::duration<double>(t1 - t0).count();
+                if (sec < best) {
+                    best = sec;
+                }
+            }
+            std::printf("%-9s %9.3f s %10.0f files/s failed=%zu\n",
+                        method.m_name, best, file_cnt / best, failed_cnt);
+        }
+        ::remove_tree(b, root, jobs);
+        root.clear();
+        ret = EXIT_SUCCESS;
+    }
+    catch (std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+    }
+    if (!root.empty()) {
+        std::fprintf(stderr, "leaving `%s` behind\n", root.c_str());
+    }
+    return ret;
+}
@@ -0,0 +1,309 @@
+#include "bse.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include "ByteStreamEditor.hpp"
+
+struct bse_ruleset
+{
+    ByteStreamEditor    m_editor;
+};
+
+namespace  {
+    thread_local std::string last_error;
+
+    bse_status fail(bse_status status, const char * msg)
+    {
+        try {
+            last_error = msg;
+        }
+        catch (...) {
+        }
+        return status;
+    }
+
+    // NOTE C 接口的边界：异常一律在这里转换为错误码
+    template<typename Func>
+    bse_status guard(Func func)
+    {
+        try {
+            return func();
+        }
+        catch (std::bad_alloc& ) {
+            return ::fail(BSE_ENOMEM, "out of memory");
+        }
+        catch (std::exception& e) {
+            return ::fail(BSE_EINTERNAL, e.what());
+        }
+        catch (...) {
+            return ::fail(BSE_EINTERNAL, "unknown exception");
+        }
+    }
+
+    /**
+     * @brief 把 Matcher 的输出转交给 bse_sink_fn；
+     *        回调出错后，不再调用它——Matcher 本身不会因此中断，也不抛出
+     */
+    class CallbackSink : public SequenceSM::Sink
+    {
+    public:
+        CallbackSink(bse_sink_fn func, void * user)
+            : m_func(func), m_user(user), m_failed(false)
+        {}
+
+        void write(const char * data, size_t len) override
+        {
+            if (len && !this->m_failed && this->m_func(this->m_user, data, len) != 0) {
+                this->m_failed = true;
+            }
+        }
+
+        bool failed() const
+        {
+            return this->m_failed;
+        }
+
+        /**
+         * @brief 开始下一条数据流：回调重新生效
+         */
+        void reset()
+        {
+            this->m_failed = false;
+        }
+
+    private:
+        bse_sink_fn m_func;
+        void *      m_user;
+        bool        m_failed;
+    };
+
+    /**
+     * @brief bse_translate() 用：输出收集到 malloc 的缓冲区
+     */
+    class MallocSink : public SequenceSM::Sink
+    {
+    public:
+        MallocSink()
+            : m_data(nullptr), m_size(0u), m_capacity(0u), m_failed(false)
+        {}
+        ~MallocSink()
+        {
+            std::free(this->m_data);
+        }
+
+        void write(const char * data, size_t len) override
+        {
+            if (this->m_failed || !len) {
+                return;
+            }
+            if (this->m_size + len > this->m_capacity) {
+                size_t capacity = std::max(this->m_capacity * 2u, this->m_size + len);
+                char * grown = static_cast<char *>(std::realloc(this->m_data, capacity));
+                if (!grown) {
+                    this->m_failed = true;
+                    return;
+                }
+                this->m_data = grown;
+                this->m_capacity = capacity;
+            }
+            std::memcpy(this->m_data + this->m_size, data, len);
+            this->m_size += len;
+        }
+
+        bool failed() const
+        {
+            return this->m_failed;
+        }
+
+        char * release(size_t& size)
+        {
+            char * data = this->m_data;
+            size = this->m_size;
+            this->m_data = nullptr;
+            this->m_size = this->m_capacity = 0u;
+            return data;
+        }
+
+    private:
+        char *  m_data;
+        size_t  m_size;
+        size_t  m_capacity;
+        bool    m_failed;
+    };
+} // namespace
+
+struct bse_stream
+{
+    SequenceSM::Matcher m_matcher;
+    CallbackSink        m_sink;
+
+    bse_stream(const SequenceSM& sm, bse_sink_fn func, void * user)
+        : m_matcher(sm), m_sink(func, user)
+    {}
+};
+
+uint32_t bse_version(void)
+{
+    return (uint32_t(BSE_VERSION_MAJOR) << 16) | BSE_VERSION_MINOR;
+}
+
+const char * bse_strerror(bse_status status)
+{
+    switch (status) {
+    case BSE_OK:        return "success";
+    case BSE_EINVAL:    return "invalid argument";
+    case BSE_ENOMEM:    return "out of memory";
+    case BSE_EIO:       return "i/o error";
+    case BSE_ESINK:     return "sink callback failed";
+    case BSE_EINTERNAL: return "internal error";
+    }
+    return "unknown status";
+}
+
+const char * bse_last_error(void)
+{
+    return last_error.c_str();
+}
+
+bse_status bse_ruleset_load(const char * path, unsigned flags, bse_ruleset ** out)
+{
+    if (!path || !out) {
+        return ::fail(BSE_EINVAL, "null argument");
+    }
+    *out = nullptr;
+    return ::guard([&]() {
+        std::unique_ptr<bse_ruleset> rs(new bse_ruleset);
+        rs->m_editor.set_use_cache(flags & BSE_LOAD_USE_CACHE);
+        try {
+            rs->m_editor.load(path);
+        }
+        catch (std::runtime_error& e) {
+            return ::fail(BSE_EIO, e.what());
+        }
+        *out = rs.release();
+        return BSE_OK;
+    });
+}
+
+bse_status bse_ruleset_new(bse_ruleset ** out)
+{
+    if (!out) {
+        return ::fail(BSE_EINVAL, "null argument");
+    }
+    *out = nullptr;
+    return ::guard([&]() {
+        *out = new bse_ruleset;
+        return BSE_OK;
+    });
+}
+
+bse_status bse_ruleset_add(bse_ruleset * rs, const char * key, size_t key_len,
+                           const char * value, size_t value_len)
+{
+    if (!rs || !key || !key_len || (!value && value_len)) {
+        return ::fail(BSE_EINVAL, "invalid rule");
+    }
+    return ::guard([&]() {
+        rs->m_editor.add_rule(std::string(key, key_len),
+                              value_len ? std::string(value, value_len) : std::string());
+        return BSE_OK;
+    });
+}
+
+bse_status bse_ruleset_compile(bse_ruleset * rs)
+{
+    if (!rs) {
+        return ::fail(BSE_EINVAL, "null argument");
+    }
+    return ::guard([&]() {
+        rs->m_editor.compile();
+        return BSE_OK;
+    });
+}
+
+void bse_ruleset_free(bse_ruleset * rs)
+{
+    delete rs;
+}
+
+bse_status bse_stream_new(const bse_ruleset * rs, bse_sink_fn sink, void * user, bse_stream ** out)
+{
+    if (!rs || !sink || !out) {
+        return ::fail(BSE_EINVAL, "null argument");
+    }
+    *out = nullptr;
+    if (!rs->m_editor.sm().is_compiled()) {
+        return ::fail(BSE_EINVAL, "rule set not compiled");
+    }
+    return ::guard([&]() {
+        *out = new bse_stream(rs->m_editor.sm(), sink, user);
+        return BSE_OK;
+    });
+}
+
+// NOTE Matcher::feed() 不分配内存（缓冲区在构造时已经就绪），字面替换串也
+// 不会抛出；guard 只是兜底
+bse_status bse_stream_feed(bse_stream * stream, const char * data, size_t len)
+{
+    if (!stream || (!data && len)) {
+        return ::fail(BSE_EINVAL, "invalid argument");
+    }
+    return ::guard([&]() {
+        stream->m_matcher.feed(data, len, stream->m_sink);
+        return stream->m_sink.failed() ? ::fail(BSE_ESINK, "sink callback failed") : BSE_OK;
+    });
+}
+
+bse_status bse_stream_finish(bse_stream * stream)
+{
+    if (!stream) {
+        return ::fail(BSE_EINVAL, "null argument");
+    }
+    bse_status status = ::guard([&]() {
+        stream->m_matcher.finish(stream->m_sink);
+        return stream->m_sink.failed() ? ::fail(BSE_ESINK, "sink callback failed") : BSE_OK;
+    });
+    // NOTE 无论成败，都回到初始状态：finish() 已把 Matcher 清空，这里再让回调
+    // 重新生效；否则一次回调出错之后，同一 stream 上的数据流全都返回 BSE_ESINK
+    stream->m_sink.reset();
+    return status;
+}
+
+void bse_stream_free(bse_stream * stream)
+{
+    delete stream;
+}
+
+bse_status bse_translate(const bse_ruleset * rs, const char * in, size_t len,
+                         char ** out, size_t * out_len)
+{
+    if (!rs || (!in && len) || !out || !out_len) {
+        return ::fail(BSE_EINVAL, "invalid argument");
+    }
+    *out = nullptr;
+    *out_len = 0u;
+    if (!rs->m_editor.sm().is_compiled()) {
+        return ::fail(BSE_EINVAL, "rule set not compiled");
+    }
+    return ::guard([&]() {
+        MallocSink sink;
+        SequenceSM::Matcher matcher(rs->m_editor.sm());
+        matcher.feed(in, len, sink);
+        matcher.finish(sink);
+        if (sink.failed()) {
+            return ::fail(BSE_ENOMEM, "out of memory");
+        }
+        *out = sink.release(*out_len);
+        return BSE_OK;
+    });
+}
+
+void bse_free(void * ptr)
+{
+    std::free(ptr);
+}
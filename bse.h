@@ -0,0 +1,110 @@
+#ifndef __BSE_H_1468300512__
+#define __BSE_H_1468300512__
+
+/**
+ * @brief libbse：byte-stream-editor 引擎的 C 接口；
+ *
+ *  用法：
+ *    1. bse_ruleset_load()（或 bse_ruleset_new() + bse_ruleset_add() +
+ *       bse_ruleset_compile()）得到编译好的规则集；
+ *    2. 每条数据流 bse_stream_new() 一个匹配现场，任意大小地
+ *       bse_stream_feed()，最后 bse_stream_finish()；之后可以继续用于下一条
+ *       数据流；
+ *    3. 输出通过 bse_sink_fn 回调交给调用方；或者用 bse_translate() 一次性
+ *       翻译整段内存；
+ *
+ *  线程安全：编译好的规则集只读，可以被任意多个线程、任意多个 bse_stream 同
+ *  时使用，无需加锁；单个 bse_stream 同一时刻只能由一个线程使用；
+ *  bse_ruleset_add()/bse_ruleset_compile() 须在共享之前完成。
+ *
+ *  所有函数都不抛出异常；返回 bse_status，出错时 bse_last_error() 给出当前线
+ *  程最近一次错误的详细信息。
+ *
+ *  本头文件的接口（函数签名与枚举值）在同一主版本内保持兼容。
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#  define BSE_API __declspec(dllexport)
+#else
+#  define BSE_API __attribute__((visibility("default")))
+#endif
+
+#define BSE_VERSION_MAJOR 1
+#define BSE_VERSION_MINOR 0
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum bse_status {
+    BSE_OK = 0,
+    BSE_EINVAL,         /* 参数无效，或者调用顺序不对 */
+    BSE_ENOMEM,
+    BSE_EIO,            /* 规则文件读取失败 */
+    BSE_ESINK,          /* bse_sink_fn 返回了非零值；此后直到 bse_stream_finish()，
+                           该数据流的输出被丢弃 */
+    BSE_EINTERNAL
+} bse_status;
+
+typedef struct bse_ruleset bse_ruleset;
+typedef struct bse_stream  bse_stream;
+
+/**
+ * @brief 输出回调；data 只在本次调用期间有效；
+ *        返回 0 表示继续，非零表示出错（之后的 feed/finish 返回 BSE_ESINK）
+ */
+typedef int (*bse_sink_fn)(void * user, const char * data, size_t len);
+
+/* bse_ruleset_load() 的 flags */
+#define BSE_LOAD_USE_CACHE  0x1u    /* 使用/生成 .rule.bin 缓存 */
+
+/**
+ * @brief (BSE_VERSION_MAJOR << 16) | BSE_VERSION_MINOR
+ */
+BSE_API uint32_t        bse_version(void);
+BSE_API const char *    bse_strerror(bse_status status);
+BSE_API const char *    bse_last_error(void);
+
+/**
+ * @brief 读入并编译规则文件（格式同 byte-stream-editor 的 .rule 文件）
+ */
+BSE_API bse_status  bse_ruleset_load(const char * path, unsigned flags, bse_ruleset ** out);
+
+/**
+ * @brief 空规则集；用 bse_ruleset_add() 逐条加入，再 bse_ruleset_compile()
+ */
+BSE_API bse_status  bse_ruleset_new(bse_ruleset ** out);
+BSE_API bse_status  bse_ruleset_add(bse_ruleset * rs, const char * key, size_t key_len,
+                                    const char * value, size_t value_len);
+BSE_API bse_status  bse_ruleset_compile(bse_ruleset * rs);
+BSE_API void        bse_ruleset_free(bse_ruleset * rs);
+
+/**
+ * @brief 规则集须已编译，且寿命长于 stream
+ */
+BSE_API bse_status  bse_stream_new(const bse_ruleset * rs, bse_sink_fn sink, void * user,
+                                   bse_stream ** out);
+BSE_API bse_status  bse_stream_feed(bse_stream * stream, const char * data, size_t len);
+
+/**
+ * @brief 输入结束；输出剩余的字节，并回到初始状态（可以开始新的数据流）；
+ *        无论返回什么（包括 BSE_ESINK），stream 都回到初始状态，回调重新生效
+ */
+BSE_API bse_status  bse_stream_finish(bse_stream * stream);
+BSE_API void        bse_stream_free(bse_stream * stream);
+
+/**
+ * @brief 一次性翻译 [in, in + len)；*out 由 malloc 分配，用 bse_free() 释放
+ */
+BSE_API bse_status  bse_translate(const bse_ruleset * rs, const char * in, size_t len,
+                                  char ** out, size_t * out_len);
+BSE_API void        bse_free(void * ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BSE_H_1468300512__ */
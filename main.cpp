@@ -1,29 +1,122 @@
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
 #include <string>
 #include <iostream>
+#include <sstream>
+#include <fstream>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+
+#include <unistd.h>
 
 #include <sss/utlstring.hpp>
 #include <sss/path.hpp>
 #include <sss/util/PostionThrow.hpp>
 
 #include "ByteStreamEditor.hpp"
+#include "TaskScheduler.hpp"
+#include "DirWalker.hpp"
+#include "EmbeddedRules.hpp"
+#include "Manifest.hpp"
+#include "RunStats.hpp"
+#include "TranslateServer.hpp"
+#include "TranslateClient.hpp"
+#include "Compression.hpp"
+#include "BatchTranslator.hpp"
+#include "JsonWriter.hpp"
 
 const char * rule_dir = "rule";
 const char * rule_suffix = ".rule";
+const size_t max_reported = 100u;
 
 void help_msg()
 {
     std::string app = sss::path::basename(sss::path::getbin());
     std::cout
-        << app << " [-r] ( rule-name | /path/to/rule ) [target-file ... ]"
-        << std::endl;
+        << app << " [-r] [--fsync] [--mmap] [--stats file] [--no-cache] [--manifest file] [--skip-noop] [--backend dense|double-array] [--compress none|gzip|zstd] [--io auto|io_uring|blocking|off] [--train corpus ...] [-j N] [-R dir ...] ( rule-name | /path/to/rule ) [target-file ... ]"
+        << std::endl
+        << app << " ( --scan [--offsets] | --list-changed ) [--mmap] [--no-cache] [--backend dense|double-array] [-j N] [-R dir ...] ( rule-name | /path/to/rule ) [target-file ... ]" << std::endl
+        << app << " [--no-cache] [-j N] --serve /path/to.sock" << std::endl
+        << app << " --client /path/to.sock [options as above] ( rule-name | /path/to/rule ) [target-file ... ]" << std::endl
+        << "  target-file `-' reads stdin and writes stdout" << std::endl
+        << "  --stats writes JSON statistics to file (`-' for stderr)" << std::endl
+        << "  --manifest skips files unchanged since they were last processed with the same rules" << std::endl
+        << "  --skip-noop leaves files without any match alone (no rewrite, no .ts)" << std::endl
+        << "  --backend selects the compiled form: dense table (default) or double-array trie;" << std::endl
+        << "    double-array is compact for huge dictionaries; it bypasses the cache and built-ins" << std::endl
+        << "  gzip/zstd input is detected by its magic bytes; by default the output keeps the" << std::endl
+        << "    input format (a.txt.gz -> a.txt.ts.gz); --compress picks another one" << std::endl
+        << "  --io selects how many small files are read and written together: io_uring" << std::endl
+        << "    (auto, when the kernel allows it), blocking syscalls, or off (one by one)" << std::endl
+        << "  --scan writes nothing: one JSON line per file with its match count; --offsets" << std::endl
+        << "    adds the byte offset and rule (state, key_hex) of every match" << std::endl
+        << "  --list-changed prints just the paths of files with at least one match" << std::endl
+        << "  --train renumbers the states by how often the corpus visits them, so hot states" << std::endl
+        << "    share cache lines; the order is saved in the rule cache, targets are optional" << std::endl;
+    std::vector<const EmbeddedRuleSet *> builtins = EmbeddedRules::list();
+    if (!builtins.empty()) {
+        std::cout << "  built-in rule-name:";
+        for (const EmbeddedRuleSet * rule_set : builtins) {
+            std::cout << " " << rule_set->m_name;
+        }
+        std::cout << " (`" << EmbeddedRules::path_prefix << "name' forces one)" << std::endl;
+    }
+}
+
+bool is_builtin_path(const std::string& rule_path)
+{
+    return rule_path.compare(0, std::strlen(EmbeddedRules::path_prefix), EmbeddedRules::path_prefix) == 0;
+}
+
+void write_stats(const std::string& path, const std::string& json)
+{
+    if (path == "-") {
+        std::cerr << json;
+        return;
+    }
+    std::ofstream ofs(path, std::ios_base::out | std::ios_base::binary);
+    if (!ofs.good()) {
+        SSS_POSTION_THROW(std::runtime_error,
+                          "unable to open file `" << path << "` to write");
+    }
+    ofs << json;
+}
+
+void write_stats(const std::string& path, const RunStats& stats, const SequenceSM& sm)
+{
+    std::ostringstream oss;
+    stats.write_json(oss, sm);
+    write_stats(path, oss.str());
+}
+
+// NOTE ֮ǰеָʽ㣻 compression::output_path()
+std::vector<std::string> output_suffixes(bool replace)
+{
+    std::vector<std::string> suffixes;
+    if (!replace) {
+        for (compression::Codec codec : {compression::C_NONE, compression::C_GZIP, compression::C_ZSTD}) {
+            suffixes.push_back(std::string(".ts") + compression::codec_suffix(codec));
+        }
+    }
+    return suffixes;
+}
+
+std::string absolute_path(const std::string& path)
+{
+    if (sss::path::is_absolute(path)) {
+        return path;
+    }
+    return sss::path::append_copy(sss::path::getcwd(), path);
 }
 
 void ensule_rule_path(std::string& rule_path)
 {
-    if (sss::path::filereadable(rule_path)) {
+    if (is_builtin_path(rule_path) || sss::path::filereadable(rule_path)) {
         return;
     }
     else {
@@ -38,33 +131,239 @@ void ensule_rule_path(std::string& rule_path)
     }
 }
 
+// NOTE --scan / --list-changedֻ״̬ƴByteStreamEditor::scan()
+// ÿļ꼴ӡеȺȣϵ˳
+bool run_scan(const ByteStreamEditor& b, std::vector<FileJob>& jobs, size_t jobs_cnt,
+              bool list_changed, bool offsets)
+{
+    TaskScheduler scheduler(jobs_cnt);
+    if (scheduler.worker_cnt() > 1) {
+        std::stable_sort(jobs.begin(), jobs.end(),
+                         [](const FileJob& lhs, const FileJob& rhs) {
+                             return lhs.m_size > rhs.m_size;
+                         });
+    }
+    const std::vector<std::string> keys = offsets ? b.sm().terminal_keys() : std::vector<std::string>();
+    std::mutex out_mutex;
+    std::atomic<size_t> failed_cnt(0u);
+    std::atomic<size_t> changed_cnt(0u);
+    std::atomic<uint64_t> match_cnt(0u);
+    std::vector<TaskScheduler::Task> tasks;
+    for (const auto& job : jobs) {
+        const std::string& path = job.m_path;
+        tasks.push_back([&, list_changed, offsets]() {
+            std::ostringstream line;
+            std::string error;
+            JsonWriter json(line, true);
+            try {
+                SequenceSM::MatchStats match(0u);
+                match.m_locate = offsets;
+                uint64_t size = b.scan(path, match, list_changed);
+                if (match.m_matches) {
+                    changed_cnt++;
+                    match_cnt += match.m_matches;
+                }
+                if (list_changed) {
+                    if (match.m_matches) {
+                        line << path << '\n';
+                    }
+                }
+                else {
+                    json.begin_object();
+                    json.path("path", path);
+                    json.key("ok").value(true);
+                    json.key("bytes").value(size);
+                    json.key("matches").value(match.m_matches);
+                    json.key("delta").value(match.m_delta);
+                    if (offsets) {
+                        json.key("hits").begin_array();
+                        for (const auto& spot : match.m_spots) {
+                            json.begin_object();
+                            json.key("offset").value(spot.first);
+                            json.key("state").value(uint64_t(spot.second));
+                            json.key("key_hex").hex(spot.second < keys.size() ? keys[spot.second] : std::string());
+                            json.end_object();
+                        }
+                        json.end_array();
+                    }
+                    json.end_object();
+                }
+            }
+            catch (std::exception& e) {
+                failed_cnt++;
+                error = e.what();
+                if (!list_changed) {
+                    line.str("");
+                    JsonWriter err_json(line, true);
+                    err_json.begin_object();
+                    err_json.path("path", path);
+                    err_json.key("ok").value(false);
+                    err_json.key("error").value(error);
+                    err_json.end_object();
+                }
+            }
+            std::lock_guard<std::mutex> lock(out_mutex);
+            std::cout << line.str() << std::flush;
+            if (!error.empty()) {
+                std::cerr << error << std::endl;
+            }
+        });
+    }
+    scheduler.run(std::move(tasks));
+    if (!list_changed) {
+        std::cerr << "scanned " << jobs.size() << " files: " << changed_cnt << " with matches, "
+                  << match_cnt << " matches, " << failed_cnt << " failed" << std::endl;
+    }
+    return failed_cnt == 0u;
+}
+
 int main (int argc, char *argv[])
 {
     try {
         (void) argc;
         (void) argv;
 
-        if (argc < 3) {
-            help_msg();
+        int arg_idx = 1;
+        bool replace = false;
+        bool use_fsync = false;
+        bool use_mmap = false;
+        bool use_cache = true;
+        size_t jobs_cnt = 1;
+        bool jobs_given = false;
+        std::string serve_path;
+        std::string client_path;
+        std::vector<std::string> walk_dirs;
+        std::string stats_path;
+        std::string manifest_path;
+        bool skip_noop = false;
+        SequenceSM::Backend backend = SequenceSM::B_DENSE;
+        compression::Codec output_codec = compression::C_SAME;
+        bool batch_io = true;
+        BatchTranslator::Engine io_engine = BatchTranslator::E_AUTO;
+        bool scan = false;
+        bool list_changed = false;
+        bool scan_offsets = false;
+        std::vector<std::string> train_paths;
+        for (; arg_idx < argc; ++arg_idx) {
+            if (sss::is_equal(argv[arg_idx], "-r")) {
+                replace = true;
+            }
+            else if (sss::is_equal(argv[arg_idx], "--fsync")) {
+                use_fsync = true;
+            }
+            else if (sss::is_equal(argv[arg_idx], "--mmap")) {
+                use_mmap = true;
+            }
+            else if (sss::is_equal(argv[arg_idx], "--no-cache")) {
+                use_cache = false;
+            }
+            else if (sss::is_equal(argv[arg_idx], "-j") && arg_idx + 1 < argc) {
+                // NOTE -j 0 ʾÿһ߳
+                jobs_cnt = std::strtoul(argv[++arg_idx], nullptr, 10);
+                jobs_given = true;
+            }
+            else if (sss::is_equal(argv[arg_idx], "--stats") && arg_idx + 1 < argc) {
+                stats_path = argv[++arg_idx];
+            }
+            else if (sss::is_equal(argv[arg_idx], "--manifest") && arg_idx + 1 < argc) {
+                manifest_path = argv[++arg_idx];
+            }
+            else if (sss::is_equal(argv[arg_idx], "--skip-noop")) {
+                skip_noop = true;
+            }
+            else if (sss::is_equal(argv[arg_idx], "--backend") && arg_idx + 1 < argc) {
+                ++arg_idx;
+                if (sss::is_equal(argv[arg_idx], SequenceSM::backend_name(SequenceSM::B_DOUBLE_ARRAY))) {
+                    backend = SequenceSM::B_DOUBLE_ARRAY;
+                }
+                else if (!sss::is_equal(argv[arg_idx], SequenceSM::backend_name(SequenceSM::B_DENSE))) {
+                    std::cerr << "unknown backend `" << argv[arg_idx] << "'" << std::endl;
+                    return EXIT_FAILURE;
+                }
+            }
+            else if (sss::is_equal(argv[arg_idx], "--compress") && arg_idx + 1 < argc) {
+                ++arg_idx;
+                if (!compression::parse_codec(argv[arg_idx], output_codec)) {
+                    std::cerr << "unknown compression `" << argv[arg_idx] << "'" << std::endl;
+                    return EXIT_FAILURE;
+                }
+                if (!compression::is_supported(output_codec)) {
+                    std::cerr << argv[arg_idx] << " support is not built in" << std::endl;
+                    return EXIT_FAILURE;
+                }
+            }
+            else if (sss::is_equal(argv[arg_idx], "--io") && arg_idx + 1 < argc) {
+                ++arg_idx;
+                if (sss::is_equal(argv[arg_idx], "off")) {
+                    batch_io = false;
+                }
+                else if (sss::is_equal(argv[arg_idx], BatchTranslator::engine_name(BatchTranslator::E_URING))) {
+                    io_engine = BatchTranslator::E_URING;
+                }
+                else if (sss::is_equal(argv[arg_idx], BatchTranslator::engine_name(BatchTranslator::E_BLOCKING))) {
+                    io_engine = BatchTranslator::E_BLOCKING;
+                }
+                else if (!sss::is_equal(argv[arg_idx], BatchTranslator::engine_name(BatchTranslator::E_AUTO))) {
+                    std::cerr << "unknown I/O engine `" << argv[arg_idx] << "'" << std::endl;
+                    return EXIT_FAILURE;
+                }
+            }
+            else if (sss::is_equal(argv[arg_idx], "--scan")) {
+                scan = true;
+            }
+            else if (sss::is_equal(argv[arg_idx], "--list-changed")) {
+                list_changed = true;
+            }
+            else if (sss::is_equal(argv[arg_idx], "--offsets")) {
+                scan_offsets = true;
+            }
+            else if (sss::is_equal(argv[arg_idx], "--train") && arg_idx + 1 < argc) {
+                train_paths.push_back(argv[++arg_idx]);
+            }
+            else if (sss::is_equal(argv[arg_idx], "-R") && arg_idx + 1 < argc) {
+                walk_dirs.push_back(argv[++arg_idx]);
+            }
+            else if (sss::is_equal(argv[arg_idx], "--serve") && arg_idx + 1 < argc) {
+                serve_path = argv[++arg_idx];
+            }
+            else if (sss::is_equal(argv[arg_idx], "--client") && arg_idx + 1 < argc) {
+                client_path = argv[++arg_idx];
+            }
+            else {
+                break;
+            }
+        }
+
+        // NOTE ػģʽ-j ΪͬʱĬÿһ
+        if (!serve_path.empty()) {
+            TranslateServer server(serve_path, jobs_given ? jobs_cnt : 0u, use_cache);
+            server.run();
             return EXIT_SUCCESS;
         }
 
-        int arg_idx = 1;
-        bool replace = false;
-        if (sss::is_equal(argv[arg_idx], "-r")) {
-            replace = true;
-            arg_idx++;
+        if (argc - arg_idx < (walk_dirs.empty() && train_paths.empty() ? 2 : 1)) {
+            help_msg();
+            return EXIT_SUCCESS;
         }
+
         std::string rule_path;
 
         // TODO ʡrule׺
-        if (sss::path::is_absolute(argv[arg_idx])) {
+        if (sss::path::is_absolute(argv[arg_idx]) || is_builtin_path(argv[arg_idx])) {
             rule_path = argv[arg_idx];
         }
         else {
             if (argv[arg_idx][0] == '.') {
                 rule_path = sss::path::append_copy(sss::path::getcwd(), argv[arg_idx]);
             }
+            else if (const EmbeddedRuleSet * rule_set =
+                     backend == SequenceSM::B_DENSE ? EmbeddedRules::find(argv[arg_idx]) : nullptr)
+            {
+                // NOTE ù rule/ Ŀ¼Ҫļд·./name
+                // /path/to/nameõԤĳܱ --backend
+                // double-array ʱĶļ
+                rule_path = std::string(EmbeddedRules::path_prefix) + rule_set->m_name;
+            }
             else {
                 rule_path = sss::path::append_copy(sss::path::dirname(sss::path::getbin()), rule_dir);
                 sss::path::append(rule_path, argv[arg_idx]);
@@ -74,23 +373,296 @@ int main (int argc, char *argv[])
         
         ensule_rule_path(rule_path);
 
-        ByteStreamEditor b {rule_path};
+        bool pipe_mode = argc - arg_idx == 1 && sss::is_equal(argv[arg_idx], "-") && walk_dirs.empty();
+        if (pipe_mode && replace) {
+            std::cerr << "-r cannot be used with `-'" << std::endl;
+            return EXIT_FAILURE;
+        }
+        // NOTE ɨ費йصѡ
+        if (scan || list_changed) {
+            const char * scan_opt = scan ? "--scan" : "--list-changed";
+            const char * conflict = nullptr;
+            if (scan && list_changed) {
+                conflict = "--list-changed";
+            }
+            else if (replace) {
+                conflict = "-r";
+            }
+            else if (pipe_mode) {
+                conflict = "`-'";
+            }
+            else if (!client_path.empty()) {
+                conflict = "--client";
+            }
+            else if (!manifest_path.empty()) {
+                conflict = "--manifest";
+            }
+            else if (!stats_path.empty()) {
+                conflict = "--stats";
+            }
+            else if (skip_noop) {
+                conflict = "--skip-noop";
+            }
+            else if (output_codec != compression::C_SAME) {
+                conflict = "--compress";
+            }
+            if (conflict) {
+                std::cerr << conflict << " cannot be used with " << scan_opt << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        if (scan_offsets && !scan) {
+            std::cerr << "--offsets requires --scan" << std::endl;
+            return EXIT_FAILURE;
+        }
+        // NOTE -r ļҲͱ˸ʽ
+        if (replace && output_codec != compression::C_SAME) {
+            std::cerr << "--compress cannot be used with -r" << std::endl;
+            return EXIT_FAILURE;
+        }
 
-        for (int i = arg_idx; i < argc; i++ ) {
-            if (replace) {
-                b.translate(argv[i], "", true);
+        // NOTE ͻģʽػóפĹʵʵĹ·
+        // ڱ̵ cwd ܵģʽʱѱ̵ stdin/stdout ػ
+        // ̣-j ػ̾
+        if (!client_path.empty()) {
+            if (!manifest_path.empty()) {
+                std::cerr << "--manifest cannot be used with --client" << std::endl;
+                return EXIT_FAILURE;
+            }
+            if (backend != SequenceSM::B_DENSE) {
+                std::cerr << "--backend cannot be used with --client" << std::endl;
+                return EXIT_FAILURE;
+            }
+            if (output_codec != compression::C_SAME) {
+                std::cerr << "--compress cannot be used with --client" << std::endl;
+                return EXIT_FAILURE;
+            }
+            if (!batch_io || io_engine != BatchTranslator::E_AUTO) {
+                std::cerr << "--io cannot be used with --client" << std::endl;
+                return EXIT_FAILURE;
+            }
+            if (!train_paths.empty()) {
+                std::cerr << "--train cannot be used with --client" << std::endl;
+                return EXIT_FAILURE;
+            }
+            serve::Request req;
+            req.m_rule_path = rule_path;
+            req.m_replace = replace;
+            req.m_fsync = use_fsync;
+            req.m_mmap = use_mmap;
+            req.m_stats = !stats_path.empty();
+            req.m_skip_noop = skip_noop;
+            std::vector<std::string> errors;
+            if (pipe_mode) {
+                req.m_in_fd = STDIN_FILENO;
+                req.m_out_fd = STDOUT_FILENO;
             }
             else {
-                b.translate(argv[i], std::string(argv[i]) + ".ts", false);
+                std::vector<FileJob> jobs;
+                for (int i = arg_idx; i < argc; i++ ) {
+                    if (sss::is_equal(argv[i], "-")) {
+                        std::cerr << "`-' must be the only target" << std::endl;
+                        return EXIT_FAILURE;
+                    }
+                    req.m_targets.push_back(absolute_path(argv[i]));
+                }
+                for (const auto& dir : walk_dirs) {
+                    walk_dir(absolute_path(dir), output_suffixes(replace), jobs, errors);
+                }
+                for (const auto& job : jobs) {
+                    req.m_targets.push_back(job.m_path);
+                }
+                for (const auto& msg : errors) {
+                    std::cout << msg << std::endl;
+                }
             }
+            std::string stats_json;
+            bool is_ok = TranslateClient(client_path).run(req, pipe_mode ? std::cerr : std::cout, stats_json);
+            if (!stats_path.empty()) {
+                write_stats(stats_path, stats_json);
+            }
+            return is_ok && errors.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        ByteStreamEditor b;
+        b.set_use_cache(use_cache);
+        b.set_backend(backend);
+        b.load(rule_path);
+        // NOTE ͬһĶԵһΪ׼İĸʽ
+        // file:line:棬 max_reported 
+        const std::vector<RuleLoader::Issue>& issues = b.load_issues();
+        for (size_t i = 0; i < issues.size() && i < max_reported; ++i) {
+            std::cerr << rule_path << ":" << issues[i].m_line << ": "
+                      << (issues[i].m_kind == RuleLoader::Issue::I_DUPLICATE ? "duplicate" : "conflicting")
+                      << " key ignored, line " << issues[i].m_first_line << " wins\n";
+        }
+        if (issues.size() > max_reported) {
+            std::cerr << rule_path << ": " << issues.size() - max_reported
+                      << " more duplicate or conflicting keys\n";
+        }
+        // NOTE ѵֻı״̬ıţ䣻 RunStats Ƽغʱ֮ǰ
+        // "trained" ǶԵ
+        if (!train_paths.empty()) {
+            if (backend != SequenceSM::B_DENSE) {
+                std::cerr << "--train cannot be used with --backend double-array" << std::endl;
+                return EXIT_FAILURE;
+            }
+            TrainStats train_stats = b.train(train_paths);
+            std::cerr << "trained on " << train_stats.m_bytes << " bytes: "
+                      << train_stats.m_visited << " of " << train_stats.m_state_cnt - 1u
+                      << " states visited; "
+                      << (train_stats.m_saved ? "order saved to the rule cache" : "order kept for this run only")
+                      << std::endl;
+            if (argc == arg_idx && walk_dirs.empty()) {
+                return EXIT_SUCCESS;
+            }
+        }
+        b.set_use_mmap(use_mmap);
+        b.set_fsync(use_fsync);
+        b.set_skip_noop(skip_noop);
+        b.set_output_codec(output_codec);
+
+        // NOTE ÿд FileStatsRunStats ֻռ
+        std::unique_ptr<RunStats> run_stats;
+        if (!stats_path.empty()) {
+            run_stats.reset(new RunStats(rule_path, b.load_times()));
+        }
+
+        // NOTE ܵģʽ׼ݣʾϢд׼
+        if (pipe_mode) {
+            FileStats file_stats;
+            file_stats.m_path = "-";
+            b.translate(STDIN_FILENO, STDOUT_FILENO, run_stats ? &file_stats : nullptr);
+            if (run_stats) {
+                file_stats.m_ok = true;
+                run_stats->add(std::move(file_stats));
+                write_stats(stats_path, *run_stats, b.sm());
+            }
+            return EXIT_SUCCESS;
+        }
+
+        std::vector<FileJob> jobs;
+        for (int i = arg_idx; i < argc; i++ ) {
+            if (sss::is_equal(argv[i], "-")) {
+                std::cerr << "`-' must be the only target" << std::endl;
+                return EXIT_FAILURE;
+            }
+            uint64_t size = 0;
+            file_size(argv[i], size);
+            jobs.emplace_back(argv[i], size);
+        }
+        std::vector<std::string> errors;
+        for (const auto& dir : walk_dirs) {
+            walk_dir(dir, output_suffixes(replace), jobs, errors);
+        }
+        // NOTE ɨģʽ±׼ǽʾϢд׼
+        for (const auto& msg : errors) {
+            (scan || list_changed ? std::cerr : std::cout) << msg << std::endl;
+        }
+        if (scan || list_changed) {
+            bool is_ok = run_scan(b, jobs, jobs_cnt, list_changed, scan_offsets);
+            return is_ok && errors.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        // NOTE ʹļ嵥дأļ¼´
+        std::unique_ptr<Manifest> manifest;
+        if (!manifest_path.empty()) {
+            manifest.reset(new Manifest(manifest_path, Manifest::fingerprint(b.sm())));
+            b.set_manifest(manifest.get());
+        }
+
+        // NOTE Сļ򿪡дͬʱ;BatchTranslatorļԼ
+        // -r--manifest ʱȫļ
+        std::vector<FileJob> small_jobs;
+        if (batch_io && !replace && !manifest) {
+            auto is_small = [](const FileJob& job) {
+                return job.m_size <= BatchTranslator::max_file_size;
+            };
+            if (size_t(std::count_if(jobs.begin(), jobs.end(), is_small)) >= BatchTranslator::min_batch) {
+                auto mid = std::stable_partition(jobs.begin(), jobs.end(),
+                                                 [&is_small](const FileJob& job) { return !is_small(job); });
+                small_jobs.assign(mid, jobs.end());
+                jobs.erase(mid, jobs.end());
+            }
+        }
+
+        TaskScheduler scheduler(jobs_cnt);
+        // NOTE ļ߳߳зֵļ
+        b.set_chunk_workers(std::max<size_t>(1u, scheduler.worker_cnt() / std::max<size_t>(1u, jobs.size())));
+        if (scheduler.worker_cnt() > 1) {
+            // NOTE ļȴһشļ
+            std::stable_sort(jobs.begin(), jobs.end(),
+                             [](const FileJob& lhs, const FileJob& rhs) {
+                                 return lhs.m_size > rhs.m_size;
+                             });
+        }
+
+        // NOTE ÿռԼϢһδӡ
+        std::mutex log_mutex;
+        std::atomic<size_t> failed_cnt(errors.size());
+        std::vector<TaskScheduler::Task> tasks;
+        for (const auto& job : jobs) {
+            const std::string& path = job.m_path;
+            tasks.push_back([&b, &path, &log_mutex, &failed_cnt, &run_stats, replace]() {
+                std::ostringstream log;
+                FileStats file_stats;
+                file_stats.m_path = path;
+                FileStats * stats = run_stats ? &file_stats : nullptr;
+                try {
+                    if (replace) {
+                        b.translate(path, "", true, log, stats);
+                    }
+                    else {
+                        b.translate(path, b.output_path(path), false, log, stats);
+                    }
+                    file_stats.m_ok = true;
+                }
+                catch (std::exception& e) {
+                    log << e.what() << std::endl;
+                    failed_cnt++;
+                }
+                if (run_stats) {
+                    run_stats->add(std::move(file_stats));
+                }
+                std::lock_guard<std::mutex> lock(log_mutex);
+                std::cout << log.str() << std::flush;
+            });
+        }
+        scheduler.run(std::move(tasks));
+        if (!small_jobs.empty()) {
+            BatchTranslator batch(b, scheduler.worker_cnt(), io_engine);
+            batch.run(small_jobs, run_stats != nullptr,
+                      [&log_mutex, &failed_cnt, &run_stats](size_t , bool ok, const std::string& log, FileStats& stats) {
+                          if (!ok) {
+                              failed_cnt++;
+                          }
+                          if (run_stats) {
+                              run_stats->add(std::move(stats));
+                          }
+                          std::lock_guard<std::mutex> lock(log_mutex);
+                          std::cout << log << std::flush;
+                      });
+        }
+        if (manifest) {
+            try {
+                manifest->save();
+            }
+            catch (std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                failed_cnt++;
+            }
+        }
+        if (run_stats) {
+            write_stats(stats_path, *run_stats, b.sm());
         }
 
-        return EXIT_SUCCESS;
+        return failed_cnt ? EXIT_FAILURE : EXIT_SUCCESS;
     }
     catch (std::exception& e) {
-        std::cout << e.what() << std::endl;
+        std::cerr << e.what() << std::endl;
     }
     catch (...) {
-        std::cout << "unknown exception" << std::endl;
+        std::cerr << "unknown exception" << std::endl;
     }
+    return EXIT_FAILURE;
 }
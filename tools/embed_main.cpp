@@ -0,0 +1,151 @@
+/**
+ * @brief 规则集的预编译：把规则文件编译好的跳转表，写成一个 C++ 源文件；
+ *        链接进程序后，即是一个内置规则集（见 EmbeddedRules.hpp）；
+ *
+ *  bse-embed [--train corpus ...] rule-file out.cpp [name]
+ *
+ *  name 默认取规则文件名去掉 .rule 后缀；给了 --train 时，先按样本重新编号
+ *  状态（见 ByteStreamEditor::train()），内置的即是训练过的表；通常经 CMake 函数 bse_embed_rules()
+ *  调用，而不直接使用；
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sss/path.hpp>
+#include <sss/util/PostionThrow.hpp>
+
+#include "ByteStreamEditor.hpp"
+
+namespace  {
+    // NOTE 每行 16 项；空数组不合法，所以至少写一个 0
+    template<typename T>
+    void write_array(std::ostream& o, const char * type, const char * name, const T * data, size_t cnt)
+    {
+        o << "    constexpr " << type << " " << name << "[] = {";
+        if (!cnt) {
+            o << "0";
+        }
+        for (size_t i = 0; i < cnt; ++i) {
+            if (i % 16u == 0u) {
+                o << "\n       ";
+            }
+            o << " " << uint64_t(data[i]) << "u,";
+        }
+        o << "\n    };\n";
+    }
+
+    // NOTE 以 C 字符串字面量的形式写出；只转义必要的字符
+    std::string quote(const std::string& s)
+    {
+        std::string ret = "\"";
+        for (char c : s) {
+            if (c == '"' || c == '\\') {
+                ret += '\\';
+            }
+            ret += c;
+        }
+        ret += '"';
+        return ret;
+    }
+
+    std::string default_name(const std::string& rule_path)
+    {
+        std::string name = sss::path::basename(rule_path);
+        const std::string suffix = ".rule";
+        if (name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+            name.resize(name.size() - suffix.size());
+        }
+        return name;
+    }
+
+    void generate(const SequenceSM& sm, const std::string& name, const std::string& rule_path, std::ostream& o)
+    {
+        const SequenceSM::Table& table = sm.table();
+        const size_t cnt = table.m_state_cnt;
+        if (table.m_backend != SequenceSM::B_DENSE) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              "only dense tables can be embedded");
+        }
+        for (size_t i = 0; i < cnt; ++i) {
+            if (table.m_flags[i] & SequenceSM::F_CALLBACK) {
+                SSS_POSTION_THROW(std::runtime_error,
+                                  "rule set with callback actions cannot be embedded");
+            }
+        }
+
+        // NOTE 只写文件名：生成的源文件与构建所在的目录无关（可重复构建）
+        o << "// generated by bse-embed from " << sss::path::basename(rule_path) << "; do not edit\n"
+            << "#include \"EmbeddedRules.hpp\"\n"
+            << "\n"
+            << "namespace  {\n";
+        ::write_array(o, "uint8_t", "classes", table.m_classes, 256u);
+        ::write_array(o, "uint32_t", "next", table.m_next, cnt * table.m_class_cnt);
+        ::write_array(o, "uint32_t", "depth", table.m_depth, cnt);
+        ::write_array(o, "uint8_t", "flags", table.m_flags, cnt);
+        ::write_array(o, "uint32_t", "value", table.m_value, cnt * 2u);
+        // NOTE char 的符号性随平台而定；按 unsigned char 写，用时再转换
+        ::write_array(o, "unsigned char", "pool", reinterpret_cast<const uint8_t *>(table.m_pool), table.m_pool_size);
+        o << "\n"
+            << "    const EmbeddedRuleSet rule_set = {\n"
+            << "        " << ::quote(name) << ",\n"
+            << "        { " << table.m_state_cnt << "u, " << table.m_max_jump_cnt << "u, "
+            << table.m_class_cnt << "u, classes, next, depth, flags, value, reinterpret_cast<const char *>(pool), " << table.m_pool_size << "u,\n"
+            << "          SequenceSM::B_DENSE, nullptr, nullptr, nullptr, " << table.m_trained << "u }\n"
+            << "    };\n"
+            << "\n"
+            << "    EmbeddedRules::Registrar registrar(&rule_set);\n"
+            << "} // namespace\n";
+    }
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> train_paths;
+    int arg_idx = 1;
+    while (arg_idx + 1 < argc && std::string(argv[arg_idx]) == "--train") {
+        train_paths.push_back(argv[arg_idx + 1]);
+        arg_idx += 2;
+    }
+    if (argc - arg_idx != 2 && argc - arg_idx != 3) {
+        std::cout << sss::path::basename(argv[0]) << " [--train corpus ...] rule-file out.cpp [name]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    try {
+        const std::string rule_path = argv[arg_idx];
+        const std::string out_path = argv[arg_idx + 1];
+        const std::string name = argc - arg_idx == 3 ? argv[arg_idx + 2] : ::default_name(rule_path);
+
+        ByteStreamEditor editor;
+        editor.set_use_cache(false);
+        editor.load(rule_path);
+        if (!train_paths.empty()) {
+            editor.train(train_paths);
+        }
+
+        // NOTE 先写到内存：生成失败时，不留下半个源文件
+        std::ostringstream oss;
+        ::generate(editor.sm(), name, rule_path, oss);
+        std::ofstream ofs(out_path, std::ios_base::out | std::ios_base::binary);
+        if (!ofs.good()) {
+            SSS_POSTION_THROW(std::runtime_error,
+                              "unable to open file `" << out_path << "` to write");
+        }
+        ofs << oss.str();
+        ofs.close();
+        if (!ofs.good()) {
+            std::remove(out_path.c_str());
+            SSS_POSTION_THROW(std::runtime_error,
+                              "write `" << out_path << "` failed");
+        }
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}